@@ -64,7 +64,7 @@ char *lighting_file[NUM_LIGHTING_TYPES] = {0};
 bool combined_gu(0), underwater(0), kbd_text_mode(0), univ_stencil_shadows(1), use_waypoint_app_spots(0), enable_tiled_mesh_ao(0), tiled_terrain_only(0);
 bool show_lightning(0), disable_shader_effects(0), use_waypoints(0), group_back_face_cull(0), start_maximized(0), claim_planet(0), skip_light_vis_test(0);
 bool no_smoke_over_mesh(0), enable_model3d_tex_comp(0), global_lighting_update(0), lighting_update_offline(0), mesh_difuse_tex_comp(1), smoke_dlights(0), keep_keycards_on_death(0);
-bool texture_alpha_in_red_comp(0), use_model2d_tex_mipmaps(1), mt_cobj_tree_build(0), two_sided_lighting(0), inf_terrain_scenery(1), invert_model_nmap_bscale(0);
+bool texture_alpha_in_red_comp(0), use_model2d_tex_mipmaps(1), mt_cobj_tree_build(0), cobj_tree_sah_build(0), cobj_tree_benchmark(0), two_sided_lighting(0), inf_terrain_scenery(1), invert_model_nmap_bscale(0);
 bool gen_tree_roots(1), fast_water_reflect(0), vsync_enabled(0), use_voxel_cobjs(0), disable_sound(0), enable_depth_clamp(0), volume_lighting(0), no_subdiv_model(0);
 bool detail_normal_map(0), init_core_context(0), use_core_context(0), enable_multisample(1), dynamic_smap_bias(0), model3d_wn_normal(0), snow_shadows(0), user_action_key(0);
 bool enable_dlight_shadows(1), tree_indir_lighting(0), ctrl_key_pressed(0), only_pine_palm_trees(0), enable_gamma_correct(0), use_z_prepass(0), reflect_dodgeballs(0);
@@ -74,7 +74,7 @@ bool enable_model3d_custom_mipmaps(1), flatten_tt_mesh_under_models(0), show_map
 bool enable_dpart_shadows(0), enable_tt_model_reflect(1), enable_tt_model_indir(0), auto_calc_tt_model_zvals(0), use_model_lod_blocks(0), enable_translocator(0), enable_grass_fire(0);
 bool disable_model_textures(0), start_in_inf_terrain(0), allow_shader_invariants(1), config_unlimited_weapons(0), disable_tt_water_reflect(0), allow_model3d_quads(1);
 bool enable_timing_profiler(0), fast_transparent_spheres(0), force_ref_cmap_update(0), use_instanced_pine_trees(0), enable_postproc_recolor(0), draw_building_interiors(0);
-bool toggle_room_light(0), merge_model_objects(0), display_frame_time(0);
+bool toggle_room_light(0), merge_model_objects(0), display_frame_time(0), obj_file_parallel_parse(0);
 int xoff(0), yoff(0), xoff2(0), yoff2(0), rand_gen_index(0), mesh_rgen_index(0), camera_change(1), camera_in_air(0), auto_time_adv(0);
 int animate(1), animate2(1), draw_model(0), init_x(STARTING_INIT_X), fire_key(0), do_run(0), init_num_balls(-1), change_wmode_frame(0);
 int game_mode(0), map_mode(0), load_hmv(0), load_coll_objs(1), read_landscape(0), screen_reset(0), mesh_seed(0), rgen_seed(1);
@@ -122,7 +122,7 @@ char player_name[MAX_CHARS] = "Player";
 bool vert_opt_flags[3] = {0}; // {enable, full_opt, verbose}
 
 
-extern bool clear_landscape_vbo, use_dense_voxels, tree_4th_branches, model_calc_tan_vect, water_is_lava, use_grass_tess, def_tex_compress, ship_cube_map_reflection;
+extern bool clear_landscape_vbo, use_dense_voxels, tree_4th_branches, model_calc_tan_vect, water_is_lava, use_grass_tess, def_tex_compress, ship_cube_map_reflection, mesh_gen_cpu_only;
 extern int camera_flight, DISABLE_WATER, DISABLE_SCENERY, camera_invincible, onscreen_display, mesh_freq_filter, show_waypoints, last_inventory_frame;
 extern int tree_coll_level, GLACIATE, UNLIMITED_WEAPONS, destroy_thresh, MAX_RUN_DIST, mesh_gen_mode, mesh_gen_shape, map_drag_x, map_drag_y;
 extern unsigned NPTS, NRAYS, LOCAL_RAYS, GLOBAL_RAYS, DYNAMIC_RAYS, NUM_THREADS, MAX_RAY_BOUNCES, grass_density, max_unique_trees, shadow_map_sz;
@@ -135,7 +135,7 @@ extern point hmv_pos, camera_last_pos;
 extern colorRGBA sunlight_color;
 extern int coll_id[];
 extern float tree_lod_scales[4];
-extern string read_hmap_modmap_fn, write_hmap_modmap_fn, read_voxel_brush_fn, write_voxel_brush_fn, font_texture_atlas_fn;
+extern string read_hmap_modmap_fn, write_hmap_modmap_fn, read_voxel_brush_fn, write_voxel_brush_fn, font_texture_atlas_fn, tex_comp_cache_dir;
 extern vector<bbox> team_starts;
 extern player_state *sstates;
 extern pt_line_drawer obj_pld;
@@ -1621,6 +1621,8 @@ int load_config(string const &config_file) {
 	kwmb.add("use_dense_voxels", use_dense_voxels);
 	kwmb.add("use_voxel_cobjs", use_voxel_cobjs);
 	kwmb.add("mt_cobj_tree_build", mt_cobj_tree_build);
+	kwmb.add("cobj_tree_sah_build", cobj_tree_sah_build);
+	kwmb.add("cobj_tree_benchmark", cobj_tree_benchmark);
 	kwmb.add("global_lighting_update", global_lighting_update);
 	kwmb.add("lighting_update_offline", lighting_update_offline);
 	kwmb.add("two_sided_lighting", two_sided_lighting);
@@ -1652,6 +1654,8 @@ int load_config(string const &config_file) {
 	kwmb.add("tt_triplanar_tex", tt_triplanar_tex);
 	kwmb.add("enable_model3d_bump_maps", enable_model3d_bump_maps);
 	kwmb.add("use_obj_file_bump_grayscale", use_obj_file_bump_grayscale);
+	kwmb.add("obj_file_parallel_parse", obj_file_parallel_parse);
+	kwmb.add("mesh_gen_cpu_only", mesh_gen_cpu_only);
 	kwmb.add("invert_bump_maps", invert_bump_maps);
 	kwmb.add("use_interior_cube_map_refl", use_interior_cube_map_refl);
 	kwmb.add("enable_cube_map_bump_maps", enable_cube_map_bump_maps);
@@ -1837,6 +1841,7 @@ int load_config(string const &config_file) {
 	kwms.add("read_voxel_brush_filename",  read_voxel_brush_fn);
 	kwms.add("write_voxel_brush_filename", write_voxel_brush_fn);
 	kwms.add("font_texture_atlas_fn", font_texture_atlas_fn);
+	kwms.add("tex_comp_cache_dir", tex_comp_cache_dir);
 	kwms.add("sphere_materials_fn", sphere_materials_fn);
 	kwms.add("write_heightmap_png", hmap_out_fn);
 	kwms.add("skybox_cube_map", skybox_cube_map_name);
@@ -2084,7 +2089,8 @@ int load_config(string const &config_file) {
 			alloc_if_req(snow_file, NULL);
 			int write_mode(0);
 			if (fscanf(fp, "%255s%i", snow_file, &write_mode) != 2) cfg_err("snow_file command", error);
-			(write_mode ? write_snow_file : read_snow_file) = 1;
+			if (write_mode == 2) {read_snow_file = write_snow_file = 2;} // cache mode: read if present, otherwise create and write
+			else {(write_mode ? write_snow_file : read_snow_file) = 1;}
 		}
 		// image files
 		else if (str == "mesh_draw_bmp") {
@@ -968,8 +968,8 @@ colorRGBA const DEF_TEX_COLOR(0.0, 0.0, 0.0, 0.0); // black with alpha of 0.0
 class texture_t { // size >= 116
 
 public:
-	char type, format, use_mipmaps, defer_load_type;
-	bool wrap, mirror, invert_y, do_compress, has_binary_alpha, is_16_bit_gray, no_avg_color_alpha_fill, invert_alpha, normal_map;
+	char type, format, use_mipmaps, defer_load_type, do_compress; // do_compress: 0=no, 1=yes, 2=only with the compressed texture cache
+	bool wrap, mirror, invert_y, has_binary_alpha, is_16_bit_gray, no_avg_color_alpha_fill, invert_alpha, normal_map;
 	int width, height, ncolors, bump_tid, alpha_tid;
 	float anisotropy, mipmap_alpha_weight;
 	std::string name;
@@ -979,19 +979,22 @@ protected:
 	unsigned tid;
 	colorRGBA color;
 	vector<unsigned> mm_offsets;
+	unsigned comp_format; // GL internal format of comp_data; kept after comp_data is freed for GPU memory accounting
+	vector<unsigned char> comp_data; // precompressed mipmap chain from the compressed texture cache
+	vector<unsigned> comp_mm_offsets; // start of each mipmap level in comp_data
 	enum {DEFER_TYPE_NONE=0, DEFER_TYPE_DDS, NUM_DEFER_TYPE};
 
 	void maybe_swap_rb(unsigned char *ptr) const;
 
 public:
-	texture_t() : type(0), format(0), use_mipmaps(0), defer_load_type(DEFER_TYPE_NONE), wrap(0), mirror(0), invert_y(0), do_compress(0), has_binary_alpha(0),
+	texture_t() : type(0), format(0), use_mipmaps(0), defer_load_type(DEFER_TYPE_NONE), do_compress(0), wrap(0), mirror(0), invert_y(0), has_binary_alpha(0),
 		is_16_bit_gray(0), no_avg_color_alpha_fill(0), invert_alpha(0), normal_map(0), width(0), height(0), ncolors(0), bump_tid(-1), alpha_tid(-1),
-		anisotropy(1.0), mipmap_alpha_weight(1.0), data(0), orig_data(0), colored_data(0), mm_data(0), tid(0), color(DEF_TEX_COLOR) {}
+		anisotropy(1.0), mipmap_alpha_weight(1.0), data(0), orig_data(0), colored_data(0), mm_data(0), tid(0), color(DEF_TEX_COLOR), comp_format(0) {}
 
-	texture_t(char t, char f, int w, int h, int wrap_mir, int nc, char um, std::string const &n, bool inv=0, bool do_comp=1, float a=1.0, float maw=1.0, bool nm=0)
-		: type(t), format(f), use_mipmaps(um), defer_load_type(DEFER_TYPE_NONE), wrap(wrap_mir != 0), mirror(wrap_mir == 2), invert_y(inv), do_compress(do_comp),
+	texture_t(char t, char f, int w, int h, int wrap_mir, int nc, char um, std::string const &n, bool inv=0, char do_comp=1, float a=1.0, float maw=1.0, bool nm=0)
+		: type(t), format(f), use_mipmaps(um), defer_load_type(DEFER_TYPE_NONE), do_compress(do_comp), wrap(wrap_mir != 0), mirror(wrap_mir == 2), invert_y(inv),
 		has_binary_alpha(0), is_16_bit_gray(0), no_avg_color_alpha_fill(0), invert_alpha(0), normal_map(nm), width(w), height(h), ncolors(nc), bump_tid(-1),
-		alpha_tid(-1), anisotropy(a), mipmap_alpha_weight(maw), name(n), data(0), orig_data(0), colored_data(0), mm_data(0), tid(0), color(DEF_TEX_COLOR) {}
+		alpha_tid(-1), anisotropy(a), mipmap_alpha_weight(maw), name(n), data(0), orig_data(0), colored_data(0), mm_data(0), tid(0), color(DEF_TEX_COLOR), comp_format(0) {}
 	bool is_inverted_y_type() const {return (defer_load_type == DEFER_TYPE_DDS);}
 	void set_existing_tid(unsigned tid_, colorRGBA const &color_) {tid = tid_; color = color_;}
 	void init();
@@ -1033,6 +1036,10 @@ public:
 	void gen_rand_texture(unsigned char val, unsigned char a_add=0, unsigned a_rand=256);
 	void load_from_gl();
 	void deferred_load_and_bind();
+	bool use_comp_cache() const;
+	std::string get_comp_cache_fn() const;
+	unsigned load_or_create_comp_cache();
+	void upload_comp_data() const;
 	void update_texture_data(int x1, int y1, int x2, int y2);
 	int write_to_jpg(std::string const &fn) const;
 	int write_to_bmp(std::string const &fn) const;
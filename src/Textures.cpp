@@ -35,18 +35,19 @@ texture_t def_textures[NUM_PREDEF_TEXTURES] = { // 4 colors without wrap sometim
 // format: 0: RGB RAW, 1: BMP, 2: RGB RAW, 3: RGBA RAW, 4: targa (*tga), 5: jpeg, 6: png, 7: auto, 8: tiff, 9: generate (not loaded from file), 10: DDS, 11:ppm
 // use_mipmaps: 0 = none, 1 = standard OpenGL, 2 = openGL + CPU data, 3 = custom alpha OpenGL, 4 = custom alpha OpenGL using average texture color for transparent pixels
 // wrap_mir: 0 = clamp, 1 = wrap, 2 = mirror
+// do_compress: 0 = none, 1 = compressed (by the driver or from the compressed texture cache), 2 = only compressed when using the compressed texture cache
 // type format width height wrap_mir ncolors use_mipmaps name [invert_y=0 [do_compress=1 [anisotropy=1.0 [mipmap_alpha_weight=1.0 [normal_map=0]]]]]
 //texture_t(0, 6, 512,  512,  1, 3, 0, "ground.png"),
 texture_t(0, 6, 128,  128,  1, 3, 2, "grass.png", 0, 1, LS_TEX_ANISO), // mipmap for small trees?
 //texture_t(0, 5, 0,    0,    1, 3, 2, "grass_new.jpg", 0, 1, LS_TEX_ANISO), // 1024x1024; has texture seams, not as bright as other grass
 texture_t(0, 6, 256,  256,  1, 3, 1, "rock.png"),
 texture_t(0, 5, 512,  512,  1, 3, 1, "water.jpg"),
-texture_t(0, 5, 0,    0,    1, 3, 1, "stucco.jpg", 0, 0), // compression is slow
+texture_t(0, 5, 0,    0,    1, 3, 1, "stucco.jpg", 0, 2), // compression is slow
 texture_t(0, 5, 0,    0,    1, 4, 0, "sky.jpg", 1), // 1024x1024
 texture_t(0, 5, 0,    0,    1, 3, 1, "brick1.jpg"), // brick2?
 texture_t(0, 5, 0,    0,    1, 3, 1, "moon.jpg"),
 texture_t(0, 6, 256,  256,  0, 3, 1, "earth.png", 1),
-texture_t(0, 5, 0,    0,    1, 3, 1, "marble.jpg", 0, 0), // or marble2.jpg, compression is slow
+texture_t(0, 5, 0,    0,    1, 3, 1, "marble.jpg", 0, 2), // or marble2.jpg, compression is slow
 texture_t(0, 7, 0,    0,    1, 3, 2, "snow2.jpg", 0, 1, LS_TEX_ANISO),
 texture_t(0, 5, 0,    0,    0, 4, 4, "leaves/green_maple_leaf.jpg", 1, 1, 4.0), // 960x744
 //texture_t(0, 6, 0,    0,    0, 4, 4, "leaves/maple_leaf.png", 1, 1, 4.0), // 344x410
@@ -54,7 +55,7 @@ texture_t(0, 5, 0,    0,    1, 3, 1, "bark2.jpg"), // 512x512 (Note: must match
 texture_t(0, 5, 512,  512,  1, 3, 2, "desert_sand.jpg", 0, 1, LS_TEX_ANISO),
 texture_t(0, 6, 256,  256,  1, 3, 2, "rock2.png", 0, 1, LS_TEX_ANISO),
 texture_t(0, 5, 512,  512,  1, 3, 1, "camoflage.jpg"),
-texture_t(0, 5, 0,    0,    1, 3, 1, "hedges.jpg", 0, 0), // 1024x1024, compression is slow
+texture_t(0, 5, 0,    0,    1, 3, 1, "hedges.jpg", 0, 2), // 1024x1024, compression is slow
 texture_t(0, 1, 512,  512,  1, 3, 1, "brick1.bmp", 0, 1, 8.0),
 texture_t(0, 5, 512,  512,  1, 3, 1, "manhole.jpg", 1),
 texture_t(0, 5, 0,    0,    0, 4, 4, "leaves/palm_frond_diff.jpg", 0, 1, 4.0), // 512x1024
@@ -64,7 +65,7 @@ texture_t(1, 9, 8,    8,    0, 3, 0, "@gen"),    // not real file - unused place
 texture_t(2, 7, 1024, 1024, 0, 3, LANDSCAPE_MIPMAP, "@landscape_tex"), // for loading real landscape texture
 texture_t(1, 9, 128,  128,  0, 3, 0, "@tree_end"),  // not real file
 texture_t(1, 9, 1024, 1024, 1, 4, 1, "@tree_hemi", 0, 1), // not real file, compression is too slow, mipmap for trees?
-texture_t(0, 5, 0  ,  0,    1, 3, 1, "shingles.jpg", 0, 0, 8.0), // compression is slow
+texture_t(0, 5, 0  ,  0,    1, 3, 1, "shingles.jpg", 0, 2, 8.0), // compression is slow
 texture_t(0, 6, 256,  256,  1, 3, 1, "paneling.png", 0, 1, 16.0),
 texture_t(0, 6, 256,  256,  1, 3, 1, "cblock.png", 0, 1, 8.0),
 texture_t(0, 5, 0,    0,    0, 4, 3, "mj_leaf.jpg", 1), // 128x128
@@ -77,7 +78,7 @@ texture_t(0, 6, 256,  256,  0, 4, 3, "plant2.png", 1),
 texture_t(0, 6, 256,  256,  0, 4, 3, "plant3.png", 1),
 //texture_t(0, 5, 0,    0,    0, 4, 3, "plant3.jpg", 1), // 176x256
 texture_t(0, 5, 0,    0,    0, 4, 4, "leaves/leaf_d.jpg", 1), // 200x500
-texture_t(0, 5, 0,    0,    1, 3, 1, "fence.jpg", 0, 0, 8.0), // 896x896, compression is slow
+texture_t(0, 5, 0,    0,    1, 3, 1, "fence.jpg", 0, 2, 8.0), // 896x896, compression is slow
 texture_t(0, 6, 128,  128,  1, 3, 1, "skull.png"),
 texture_t(0, 6, 64,   64,   1, 3, 1, "radiation.png", 1),
 texture_t(0, 6, 128,  128,  1, 3, 1, "yuck.png"),
@@ -87,7 +88,7 @@ texture_t(0, 6, 256,  256,  0, 4, 1, "blur.png", 0, 0), // disable compression -
 texture_t(0, 6, 256,  256,  1, 4, 1, "blur_s.png"),
 texture_t(0, 5, 0,    0,    0, 4, 3, "pine2.jpg", 1, 1, 1.0, 0.5),
 texture_t(0, 6, 128,  128,  1, 3, 1, "noise.png"),
-texture_t(0, 5, 0,    0,    1, 3, 1, "wood.jpg", 0, 0, 4.0), // 768x768, compression is slow
+texture_t(0, 5, 0,    0,    1, 3, 1, "wood.jpg", 0, 2, 4.0), // 768x768, compression is slow
 texture_t(0, 6, 128,  128,  1, 3, 1, "hb_brick.png", 0, 1, 8.0),
 texture_t(0, 6, 128,  128,  1, 3, 1, "particleb.png", 0, 1, 8.0),
 texture_t(0, 6, 128,  128,  1, 3, 1, "plaster.png"),
@@ -123,8 +124,8 @@ texture_t(0, 5, 0,    0,    1, 3, 1, "mossy_rock.jpg"), // 500x500
 texture_t(0, 5, 0,    0,    1, 3, 1, "bark/bark1.jpg"), // 600x600
 texture_t(0, 5, 0,    0,    1, 3, 1, "bark/bark2.jpg"), // 512x512
 texture_t(0, 5, 0,    0,    1, 3, 1, "bark/bark2-normal.jpg", 0, 0, 4.0, 1.0, 1), // 512x512, no compress
-texture_t(0, 5, 0,    0,    1, 3, 1, "bark/bark_lendrick.jpg", 0, 0), // 892x892, compression is slow
-texture_t(0, 6, 0,    0,    1, 3, 1, "bark/bark_lylejk.png", 0, 0), // 1024x768, compression is slow
+texture_t(0, 5, 0,    0,    1, 3, 1, "bark/bark_lendrick.jpg", 0, 2), // 892x892, compression is slow
+texture_t(0, 6, 0,    0,    1, 3, 1, "bark/bark_lylejk.png", 0, 2), // 1024x768, compression is slow
 // normal/caustic maps
 texture_t(0, 4, 0,    0,    1, 3, 1, "normal_maps/water_normal.tga", 0, 0, 8.0, 1.0, 1), // 512x512, no compress
 texture_t(0, 6, 0,    0,    1, 3, 1, "normal_maps/ocean_water_normal.png", 0, 0, 4.0, 1.0, 1), // 1024x1024 (Note: compression disabled as it causes artifacts)
@@ -155,7 +156,7 @@ texture_t(0, 5, 0,    0,    1, 3, 1, "raindrop_dots.jpg"),
 texture_t(0, 5, 0,    0,    1, 3, 1, "spaceship1.jpg"),
 texture_t(0, 5, 0,    0,    1, 3, 1, "spaceship2.jpg"),
 texture_t(0, 6, 0,    0,    0, 4, 1, "atlas/blood.png"),
-texture_t(0, 5, 0,    0,    1, 3, 1, "lichen.jpg", 0, 0), // 1500x1500, compression is probably slow
+texture_t(0, 5, 0,    0,    1, 3, 1, "lichen.jpg", 0, 2), // 1500x1500, compression is probably slow
 texture_t(0, 5, 0,    0,    1, 3, 1, "bark/palm_bark.jpg"), // 512x512
 texture_t(0, 5, 0,    0,    0, 4, 0, "daisy.jpg", 0, 1, 4.0), // 1024x1024 - no mipmap to avoid filtering artifacts making distant flowers look square (but not too bad with mode 3)
 texture_t(0, 5, 0,    0,    1, 3, 1, "lava.jpg"), // 512x512
@@ -193,6 +194,7 @@ typedef map<string, unsigned> name_map_t;
 name_map_t texture_name_map;
 
 bool textures_inited(0), def_tex_compress(1);
+string tex_comp_cache_dir; // compressed texture cache directory; empty = disabled
 int landscape_changed(0), lchanged0(0), skip_regrow(0), ltx1(0), lty1(0), ltx2(0), lty2(0), ls0_invalid(1);
 unsigned sky_zval_tid;
 float def_tex_aniso(2.0);
@@ -258,6 +260,22 @@ void set_landscape_texture_from_file() {
 }
 
 
+void load_compressed_texture_cache() { // must be called after all CPU-side modifications to file textures
+
+	if (tex_comp_cache_dir.empty()) return; // disabled
+	timer_t timer("Compressed Texture Cache");
+	unsigned num_loaded(0), num_created(0);
+
+#pragma omp parallel for schedule(dynamic) reduction(+:num_loaded, num_created)
+	for (int i = 0; i < (int)textures.size(); ++i) {
+		if (is_tex_disabled(i) || !textures[i].use_comp_cache()) continue;
+		unsigned const ret(textures[i].load_or_create_comp_cache());
+		if (ret == 1) {++num_loaded;} else if (ret == 2) {++num_created;}
+	}
+	cout << "Compressed texture cache: loaded " << num_loaded << ", created " << num_created << endl;
+}
+
+
 void load_textures() {
 
 	timer_t timer("Texture Load");
@@ -275,6 +293,7 @@ void load_textures() {
 	}
 	cout << " done" << endl;
 	textures[BULLET_D_TEX].merge_in_alpha_channel(textures[BULLET_A_TEX]);
+	load_compressed_texture_cache();
 	gen_smoke_texture();
 	gen_plasma_texture();
 	gen_disintegrate_texture();
@@ -498,6 +517,8 @@ void texture_t::free_client_mem() {
 	delete [] data;
 	data = orig_data = colored_data = NULL;
 	free_mm_data();
+	comp_data.clear();
+	comp_mm_offsets.clear();
 }
 
 void texture_t::gl_delete() {
@@ -513,7 +534,7 @@ GLenum texture_t::calc_internal_format() const {
 
 	assert(ncolors >= 1 && ncolors <= 4);
 	if (is_16_bit_gray) {return GL_R16;} // compressed?
-	return get_internal_texture_format(ncolors, (COMPRESS_TEXTURES && do_compress && type != 2), 0); // linear_space=0
+	return get_internal_texture_format(ncolors, (COMPRESS_TEXTURES && do_compress == 1 && type != 2), 0); // linear_space=0
 }
 
 GLenum texture_t::calc_format() const {
@@ -534,9 +555,11 @@ void texture_t::do_gl_init(bool free_after_upload) {
 	//RESET_TIME;
 	setup_texture(tid, (use_mipmaps != 0 && !defer_load()), wrap, wrap, mirror, mirror, 0, anisotropy);
 	if (defer_load()) {deferred_load_and_bind();} // FIXME: mipmaps?
+	else if (!comp_data.empty()) {upload_comp_data();}
 	else {
 		assert(is_allocated());
 		assert(width > 0 && height > 0);
+		comp_format = 0; // not precompressed
 		glTexImage2D(GL_TEXTURE_2D, 0, calc_internal_format(), width, height, 0, calc_format(), get_data_format(), data);
 		if (use_mipmaps == 1 || use_mipmaps == 2) {gen_mipmaps();}
 		if (use_mipmaps == 3 || use_mipmaps == 4) {create_custom_mipmaps();}
@@ -546,6 +569,25 @@ void texture_t::do_gl_init(bool free_after_upload) {
 	//PRINT_TIME("Texture Init");
 }
 
+bool texture_t::use_comp_cache() const { // only 8-bit RGB/RGBA textures read from files using standard mipmaps
+	if (type != 0 || defer_load() || !is_allocated() || is_16_bit_gray || (ncolors != 3 && ncolors != 4)) return 0;
+	if (use_mipmaps != 0 && use_mipmaps != 1) return 0; // custom mipmaps are generated later
+	return (do_compress == 2 || (do_compress == 1 && COMPRESS_TEXTURES));
+}
+
+void texture_t::upload_comp_data() const {
+
+	unsigned const num_levels(comp_mm_offsets.size());
+	assert(comp_format != 0 && num_levels > 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (num_levels - 1));
+
+	for (unsigned level = 0; level < num_levels; ++level) {
+		unsigned const start(comp_mm_offsets[level]), end((level+1 < num_levels) ? comp_mm_offsets[level+1] : comp_data.size());
+		assert(start < end && end <= comp_data.size());
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, comp_format, max(1, (width >> level)), max(1, (height >> level)), 0, (end - start), &comp_data[start]);
+	}
+}
+
 void texture_t::upload_cube_map_face(unsigned ix) {
 	assert(ix < 6);
 	assert(ncolors == 3);
@@ -1939,9 +1981,20 @@ float texture_t::get_component(float u, float v, int comp) const {
 
 unsigned texture_t::get_gpu_mem() const {
 	if (!is_bound()) return 0;
+
+	if (comp_format != 0) { // exact size of the precompressed mipmap chain, which may have already been freed
+		unsigned const block_bytes((comp_format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 8 : 16);
+		unsigned mem(0);
+
+		for (unsigned w = width, h = height;; w = max(1U, w/2), h = max(1U, h/2)) {
+			mem += ((w+3)/4)*((h+3)/4)*block_bytes; // 4x4 blocks
+			if (!use_mipmaps || (w == 1 && h == 1)) break;
+		}
+		return mem;
+	}
 	unsigned mem(num_bytes());
 	if (use_mipmaps) {mem += mem/3;} // 33% overhead
-	if (do_compress) {mem /= 4;} // assumes DXT2-DXT5 4:1 compression
+	if (do_compress == 1) {mem /= 4;} // assumes DXT2-DXT5 4:1 compression
 	return mem;
 }
 
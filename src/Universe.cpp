@@ -1086,53 +1086,129 @@ void add_nearby_uobj_text(text_drawer_t &text_drawer) {
 void universe_t::init() {
 
 	assert(U_BLOCKS & 1); // U_BLOCKS is odd
+	reset_prefetch();
+	point const upt(get_scaled_upt());
 
 	for (unsigned i = 0; i < U_BLOCKS; ++i) { // z
 		for (unsigned j = 0; j < U_BLOCKS; ++j) { // y
 			for (unsigned k = 0; k < U_BLOCKS; ++k) { // x
 				int const ii[3] = {(int)k, (int)j, (int)i};
-				cells[i][j][k].gen_cell(ii);
+				cells[i][j][k]->gen_cell(ii, upt);
 			}
 		}
 	}
 }
 
 
-void universe_t::shift_cells(int dx, int dy, int dz) {
+bool is_out_of_cell_block(int i, int j, int k) {
+	return (i < 0 || i >= int(U_BLOCKS) || j < 0 || j >= int(U_BLOCKS) || k < 0 || k >= int(U_BLOCKS));
+}
 
-	assert((abs(dx) + abs(dy) + abs(dz)) == 1);
-	vector3d const vxyz((float)dx, (float)dy, (float)dz);
+void universe_t::get_new_slab_ixs(int dx, int dy, int dz, cell_ixs_t ixs[U_BLOCKS_SQ]) const { // cells with no source cell after a shift by {dx, dy, dz}
+
+	unsigned n(0);
 
 	for (unsigned i = 0; i < U_BLOCKS; ++i) { // z
 		for (unsigned j = 0; j < U_BLOCKS; ++j) { // y
 			for (unsigned k = 0; k < U_BLOCKS; ++k) { // x
-				int const i2(i + dz), j2(j + dy), k2(k + dx);
-				bool const zout(i2 < 0 || i2 >= int(U_BLOCKS));
-				bool const yout(j2 < 0 || j2 >= int(U_BLOCKS));
-				bool const xout(k2 < 0 || k2 >= int(U_BLOCKS));
-
-				if (xout || yout || zout) { // allocate new cell
-					int const ii[3]     = {(int)k, (int)j, (int)i};
-					temp.cells[i][j][k].gen = 0;
-					temp.cells[i][j][k].gen_cell(ii);
-				}
-				else {
-					cells[i2][j2][k2].gen           = 1;
-					temp.cells[i][j][k]             = cells[i2][j2][k2];
-					temp.cells[i][j][k].rel_center -= vxyz*CELL_SIZE;
-				}
+				if (!is_out_of_cell_block(i+dz, j+dy, k+dx)) continue;
+				assert(n < U_BLOCKS_SQ);
+				ixs[n].ix[0] = k; ixs[n].ix[1] = j; ixs[n].ix[2] = i;
+				++n;
 			}
 		}
 	}
+	assert(n == U_BLOCKS_SQ);
+}
+
+
+void universe_t::reset_prefetch() {
+
+	for (unsigned n = 0; n < num_prefetched; ++n) {spare_cells[n]->free_uobj();}
+	num_prefetched = 0;
+}
+
+
+void universe_t::shift_cells(int dx, int dy, int dz) { // Note: uxyz has already been updated
+
+	assert((abs(dx) + abs(dy) + abs(dz)) == 1);
+	vector3d const vxyz((float)dx, (float)dy, (float)dz);
+	bool const use_prefetch(prefetch_dir[0] == dx && prefetch_dir[1] == dy && prefetch_dir[2] == dz &&
+		prefetch_uxyz[0] == uxyz[0] && prefetch_uxyz[1] == uxyz[1] && prefetch_uxyz[2] == uxyz[2]);
+	ucell *prev[U_BLOCKS][U_BLOCKS][U_BLOCKS], *leaving[U_BLOCKS_SQ];
+	memcpy(prev, cells, sizeof(cells));
+	unsigned num_leaving(0);
+
 	for (unsigned i = 0; i < U_BLOCKS; ++i) { // z
 		for (unsigned j = 0; j < U_BLOCKS; ++j) { // y
 			for (unsigned k = 0; k < U_BLOCKS; ++k) { // x
-				if (cells[i][j][k].gen == 0) cells[i][j][k].free_uobj();
-				cells[i][j][k]     = temp.cells[i][j][k];
-				cells[i][j][k].gen = 0;
+				if (is_out_of_cell_block(i-dz, j-dy, k-dx)) { // this cell shifts out of the block
+					assert(num_leaving < U_BLOCKS_SQ);
+					leaving[num_leaving++] = prev[i][j][k];
+				}
+				if (is_out_of_cell_block(i+dz, j+dy, k+dx)) continue; // new cell, filled in below
+				ucell *const cell(prev[i+dz][j+dy][k+dx]);
+				cell->rel_center -= vxyz*CELL_SIZE;
+				cells[i][j][k]    = cell;
 			}
 		}
 	}
+	assert(num_leaving == U_BLOCKS_SQ);
+	cell_ixs_t slab[U_BLOCKS_SQ];
+	get_new_slab_ixs(dx, dy, dz, slab);
+	point const upt(get_scaled_upt());
+
+	for (unsigned n = 0; n < U_BLOCKS_SQ; ++n) { // reuse the cells that left the block for the new slab
+		int const *const ii(slab[n].ix);
+		ucell *&cell(cells[ii[2]][ii[1]][ii[0]]);
+		leaving[n]->free_uobj();
+
+		if (use_prefetch && n < num_prefetched) { // swap in the prefetched cell
+			cell = spare_cells[n];
+			spare_cells[n] = leaving[n];
+		}
+		else {
+			cell = leaving[n];
+			cell->gen_cell(ii, upt);
+		}
+	}
+	if (use_prefetch) {num_prefetched = 0;} // spare cells were swapped with freed cells
+	else {reset_prefetch();} // prefetched cells are for a different shift and are no longer valid
+	UNROLL_3X(prefetch_dir[i_] = 0;)
+}
+
+
+void universe_t::prefetch_cells(point const &camera, vector3d const &velocity) { // camera is relative to the center cell
+
+	// generate the slab of cells the camera is approaching over several frames so that shift_cells() has less work to do
+	unsigned const MAX_CELLS_PER_FRAME = 4;
+	float const PREFETCH_START_DIST = 0.25*CELL_SIZE; // start when the camera is in the outer half of the center cell
+	unsigned dim(0);
+
+	for (unsigned d = 1; d < 3; ++d) {
+		if (fabs(camera[d]) > fabs(camera[dim])) {dim = d;}
+	}
+	if (fabs(camera[dim]) < PREFETCH_START_DIST) return; // not close to any cell boundary
+	int const sign((camera[dim] < 0.0) ? -1 : 1);
+	if (velocity[dim]*sign < 0.0) return; // moving away from this boundary
+	int dir[3] = {0, 0, 0}, target_uxyz[3];
+	dir[dim] = sign;
+	UNROLL_3X(target_uxyz[i_] = uxyz[i_] + dir[i_];)
+
+	if (dir[0] != prefetch_dir[0] || dir[1] != prefetch_dir[1] || dir[2] != prefetch_dir[2] ||
+		target_uxyz[0] != prefetch_uxyz[0] || target_uxyz[1] != prefetch_uxyz[1] || target_uxyz[2] != prefetch_uxyz[2])
+	{
+		reset_prefetch(); // new target slab
+		UNROLL_3X(prefetch_dir[i_] = dir[i_]; prefetch_uxyz[i_] = target_uxyz[i_];)
+	}
+	if (num_prefetched == U_BLOCKS_SQ) return; // done
+	cell_ixs_t slab[U_BLOCKS_SQ];
+	get_new_slab_ixs(dir[0], dir[1], dir[2], slab);
+	point const upt(CELL_SIZE*target_uxyz[0], CELL_SIZE*target_uxyz[1], CELL_SIZE*target_uxyz[2]);
+
+	for (unsigned n = 0; n < MAX_CELLS_PER_FRAME && num_prefetched < U_BLOCKS_SQ; ++n, ++num_prefetched) {
+		spare_cells[num_prefetched]->gen_cell(slab[num_prefetched].ix, upt);
+	}
 }
 
 
@@ -1153,11 +1229,11 @@ inline int gen_rand_seed2(point const &center) {
 }
 
 
-void ucell::gen_cell(int const ii[3]) {
+void ucell::gen_cell(int const ii[3], point const &scaled_upt) {
 
 	if (gen) return; // already generated
 	UNROLL_3X(rel_center[i_] = CELL_SIZE*(float(ii[i_] - (int)U_BLOCKSo2));)
-	pos    = rel_center + get_scaled_upt();
+	pos    = rel_center + scaled_upt;
 	radius = 0.5*CELL_SIZE;
 	set_rand2_state(gen_rand_seed1(pos), gen_rand_seed2(pos));
 	get_rseeds();
@@ -2057,6 +2133,8 @@ void uobj_solid::gen_colorAB(float delta) {
 // *** TEXTURES ***
 
 
+unsigned const PROGRESSIVE_TEX_MIN_SIZE = 128;
+
 void urev_body::check_gen_texture(unsigned size) {
 
 	if (use_procedural_shader()) return; // no texture used
@@ -2066,16 +2144,26 @@ void urev_body::check_gen_texture(unsigned size) {
 		if (!glIsTexture(tid)) {create_gas_giant_texture();} // texture has not been generated
 		return;
 	}
-	unsigned const tsize0(get_texture_size(size));
+	unsigned tsize0(get_texture_size(size));
 
 	if (!glIsTexture(tid)) { // texture has not been generated
 		gen_surface();
+		// start with a lower resolution texture to avoid a stall when first approaching a planet; the full resolution texture is generated progressively
+		if (tsize0 >= PROGRESSIVE_TEX_MIN_SIZE && !has_cached_surface(tsize0)) {tsize0 >>= 2;}
+	}
+	else if (tsize0 == tsize) { // nothing to do
+		if (surface->pending_gen.size > 0) {surface->pending_gen.clear();} // size changed back before the pending texture was done
+		return;
 	}
-	else if (tsize0 != tsize) { // new texture size
+	else if (tsize0 >= PROGRESSIVE_TEX_MIN_SIZE && !has_cached_surface(tsize0)) { // generate across frames, and keep using the old texture until done
+		vector<unsigned char> data;
+		if (!gen_texture_data_progressive(tsize0, data)) return; // not done yet
 		::free_texture(tid); // delete old texture
+		upload_rocky_texture(tsize0, data);
+		return;
 	}
-	else {
-		return; // nothing to do
+	else { // new texture size
+		::free_texture(tid); // delete old texture
 	}
 	create_rocky_texture(tsize0); // new texture
 }
@@ -2083,10 +2171,18 @@ void urev_body::check_gen_texture(unsigned size) {
 
 void urev_body::create_rocky_texture(unsigned size) {
 
+	assert(size <= MAX_TEXTURE_SIZE);
+	vector<unsigned char> data(3*size*size);
+	gen_texture_data_and_heightmap(&data.front(), size);
+	upload_rocky_texture(size, data);
+}
+
+
+void urev_body::upload_rocky_texture(unsigned size, vector<unsigned char> const &data) {
+
 	tsize = size;
 	assert(tsize <= MAX_TEXTURE_SIZE);
-	vector<unsigned char> data(3*tsize*tsize);
-	gen_texture_data_and_heightmap(&data.front(), tsize);
+	assert(data.size() == 3*tsize*tsize);
 	setup_texture(tid, 0, 1, 0);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, tsize, tsize, 0, GL_RGB, GL_UNSIGNED_BYTE, &data.front());
 }
@@ -2225,7 +2321,7 @@ void universe_t::free_context() { // should be OK even if universe isn't setup
 	for (unsigned z = 0; z < U_BLOCKS; ++z) { // z
 		for (unsigned y = 0; y < U_BLOCKS; ++y) { // y
 			for (unsigned x = 0; x < U_BLOCKS; ++x) { // x
-				ucell &cell(cells[z][y][x]);
+				ucell &cell(*cells[z][y][x]);
 				cell.free_context();
 				if (cell.galaxies == NULL) continue;
 				
@@ -2245,6 +2341,7 @@ void universe_t::free_context() { // should be OK even if universe isn't setup
 			}
 		}
 	}
+	for (unsigned i = 0; i < U_BLOCKS_SQ; ++i) {spare_cells[i]->free_context();} // may hold VBOs from when they were in the block
 	planet_manager.clear();
 }
 
@@ -2771,7 +2868,7 @@ int universe_t::get_closest_object(s_object &result, point pos, int max_level, b
 	result.init();
 
 	// find the correct cell
-	point const cell_origin(cells[0][0][0].pos);
+	point const cell_origin(cells[0][0][0]->pos);
 	UNROLL_3X(result.cellxyz[i_] = int((posc[i_] - cell_origin[i_])/CELL_SIZE);)
 	
 	if (bad_cell_xyz(result.cellxyz)) {
@@ -2789,6 +2886,7 @@ int universe_t::get_closest_object(s_object &result, point pos, int max_level, b
 	unsigned const ng((unsigned)cell.galaxies->size());
 	unsigned const go((first_galaxy_to_try >= 0 && first_galaxy_to_try < int(ng)) ? last_galaxy : 0);
 	bool found_system(0);
+	static thread_local vector<unsigned> ast_ixs; // asteroid broadphase query results
 
 	for (unsigned gc_ = 0; gc_ < ng && !found_system; ++gc_) { // find galaxy
 		unsigned gc(gc_);
@@ -2812,13 +2910,14 @@ int universe_t::get_closest_object(s_object &result, point pos, int max_level, b
 		if (include_asteroids) { // check for asteroid field collisions
 			for (vector<uasteroid_field>::const_iterator i = galaxy.asteroid_fields.begin(); i != galaxy.asteroid_fields.end(); ++i) {
 				if (!dist_less_than(pos, i->pos, expand*i->radius+r_add)) continue;
+				i->get_asteroids_near(pos, r_add, expand, ast_ixs);
 
-				// asteroid positions are dynamic, so spatial subdivision is difficult - we just do a slow linear iteration here
-				for (uasteroid_field::const_iterator j = i->begin(); j != i->end(); ++j) {
-					if (!dist_less_than(pos, j->pos, expand*j->radius+r_add)) continue;
-					result.assign(gc, -1, -1, p2p_dist(pos, j->pos), UTYPE_ASTEROID, NULL);
+				for (vector<unsigned>::const_iterator a = ast_ixs.begin(); a != ast_ixs.end(); ++a) {
+					uasteroid const &j((*i)[*a]);
+					if (!dist_less_than(pos, j.pos, expand*j.radius+r_add)) continue;
+					result.assign(gc, -1, -1, p2p_dist(pos, j.pos), UTYPE_ASTEROID, NULL);
 					result.asteroid_field = (i - galaxy.asteroid_fields.begin());
-					result.asteroid       = (j - i->begin());
+					result.asteroid       = *a;
 				}
 			}
 		}
@@ -2859,12 +2958,15 @@ int universe_t::get_closest_object(s_object &result, point pos, int max_level, b
 
 				if (include_asteroids && system.asteroid_belt != nullptr) { // check for asteroid belt collisions
 					if (system.asteroid_belt->sphere_might_intersect(pos, expand*system.asteroid_belt->get_max_asteroid_radius()+r_add)) {
-						// asteroid positions are dynamic, so spatial subdivision is difficult - we just do a slow linear iteration here
-						for (uasteroid_field::const_iterator j = system.asteroid_belt->begin(); j != system.asteroid_belt->end(); ++j) {
-							if (!dist_less_than(pos, j->pos, expand*j->radius+r_add)) continue;
-							result.assign(gc, cl, s, p2p_dist(pos, j->pos), UTYPE_ASTEROID, NULL);
+						uasteroid_belt const &belt(*system.asteroid_belt);
+						belt.get_asteroids_near(pos, r_add, expand, ast_ixs);
+
+						for (vector<unsigned>::const_iterator a = ast_ixs.begin(); a != ast_ixs.end(); ++a) {
+							uasteroid const &j(belt[*a]);
+							if (!dist_less_than(pos, j.pos, expand*j.radius+r_add)) continue;
+							result.assign(gc, cl, s, p2p_dist(pos, j.pos), UTYPE_ASTEROID, NULL);
 							result.asteroid_field = AST_BELT_ID; // special asteroid belt identifier
-							result.asteroid       = (j - system.asteroid_belt->begin());
+							result.asteroid       = *a;
 						}
 					}
 				}
@@ -2967,7 +3069,7 @@ bool universe_t::get_trajectory_collisions(line_query_state &lqs, s_object &resu
 	point end(start + dir*dist);
 
 	// calculate cell block boundaries
-	point const p_low(cells[0][0][0].pos), p_hi(cells[U_BLOCKS-1][U_BLOCKS-1][U_BLOCKS-1].pos);
+	point const p_low(cells[0][0][0]->pos), p_hi(cells[U_BLOCKS-1][U_BLOCKS-1][U_BLOCKS-1]->pos);
 
 	for (unsigned d = 0; d < 3; ++d) {
 		c1[d] = p_low[d] - CELL_SIZEo2;
@@ -3361,7 +3463,7 @@ vector3d ustar::get_solar_wind_accel(point const &obj_pos, float obj_mass, float
 
 void urev_body::free_texture() { // and also free vbos
 
-	if (surface != nullptr) {surface->free_context();}
+	if (surface != nullptr) {surface->free_context(); surface->pending_gen.clear();}
 	::free_texture(tid);
 	tsize = 0;
 }
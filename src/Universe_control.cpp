@@ -353,7 +353,7 @@ void process_univ_objects() {
 
 		// skip orbiting objects (no collisions or gravity effects, temperature is mostly constant)
 		s_object clobj; // closest object
-		bool const include_asteroids(!particle); // disable particle-asteroid collisions because they're too slow
+		bool const include_asteroids(1); // asteroid queries use a per-frame spatial hash broadphase, so particles can collide with asteroids as well
 		int const found_close(orbiting ? 0 : universe.get_object_closest_to_pos(clobj, obj_pos, include_asteroids, 1.0, (no_coll ? 0.0 : radius)));
 		bool temp_known(0), has_rings(0);
 		float limit_speed_dist(clobj.dist);
@@ -540,6 +540,7 @@ void check_shift_universe() {
 		}
 	}
 	if (moved) {shift_univ_objs(move, 1);} // advance all free objects by a cell
+	universe.prefetch_cells(camera, get_player_velocity());
 	had_init_shift = 1;
 }
 
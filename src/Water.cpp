@@ -8,6 +8,7 @@
 #include "openal_wrap.h"
 #include "shaders.h"
 #include "gl_ext_arb.h"
+#include <climits>
 
 
 float    const RIPPLE_DAMP1        = 0.95;
@@ -81,6 +82,29 @@ struct water_section {
 };
 
 
+struct ripple_bounds_t { // range of mesh cells that may have nonzero ripples
+	int x1, y1, x2, y2; // inclusive
+
+	ripple_bounds_t() {clear();}
+	void clear() {x1 = y1 = INT_MAX; x2 = y2 = INT_MIN;}
+	bool empty() const {return (x1 > x2 || y1 > y2);}
+	void expand(int xa, int ya, int xb, int yb) {x1 = min(x1, xa); y1 = min(y1, ya); x2 = max(x2, xb); y2 = max(y2, yb);}
+};
+
+
+struct ripple_nbor_t { // neighbor offset, weight, and the inside8 bit the neighbor uses to flow back into this cell
+	int di, dj;
+	float weight;
+	short rev_bit;
+};
+
+// inside8 bits: 00 0- -0 0+ +0 -- +- ++ -+  22  11
+//               01 02 04 08 10 20 40 80 100 200 400
+ripple_nbor_t const ripple_nbors[8] = {
+	{ 0, -1, 1.0f, 0x08}, { 0,  1, 1.0f, 0x02}, {-1,  0, 1.0f, 0x10}, { 1,  0, 1.0f, 0x04},
+	{-1, -1, SQRTOFTWOINV, 0x80}, { 1,  1, SQRTOFTWOINV, 0x20}, { 1, -1, SQRTOFTWOINV, 0x100}, {-1,  1, SQRTOFTWOINV, 0x40}};
+
+
 
 // Global Variables
 bool water_is_lava(0);
@@ -90,6 +114,7 @@ vector<valley> valleys;
 vector<water_spring> water_springs;
 vector<water_section> wsections;
 spillover spill;
+ripple_bounds_t ripple_bounds;
 
 extern bool using_lightmap, has_snow, fast_water_reflect, enable_clip_plane_z, begin_motion;
 extern int display_mode, frame_counter, game_mode, TIMESCALE2, I_TIMESCALE2, world_mode, rand_gen_index, animate, animate2, blood_spilled;
@@ -692,6 +717,51 @@ inline void update_water_edges(int i, int j) {
 }
 
 
+inline bool is_ripple_active(int i, int j) {return (wminside[i][j] && !(water_matrix[i][j] < z_min_matrix[i][j]) /*&& get_water_enabled(j, i)*/);}
+inline float get_ripple_rval(int i, int j) {float rval(ripples[i][j].rval); fix_fp_mag(rval); return rval;}
+
+void update_ripple_water_height(int i, int j, float rm_atten, float rdamp1, float rdamp2, bool update_iter) {
+
+	float ripple_zval(0.0);
+
+	if (wminside[i][j]) {
+		float const zval(rdamp1*(get_ripple_rval(i, j) + rdamp2*ripples[i][j].acc)); // ripple wave height
+		ripple_zval = ((fabs(zval) < TOLERANCE) ? 0.0 : zval); // prevent small floating point numbers
+	}
+	if (wminside[i][j] == 1) { // dynamic water
+		int const wsi(watershed_matrix[i][j].wsi);
+		assert(size_t(wsi) < valleys.size());
+
+		if (water_matrix[i][j] < z_min_matrix[i][j] && fabs(ripples[i][j].rval) < 1.0E-4 && fabs(ripples[i][j].acc) < 1.0E-4) { // under ground - no ripple
+			if (update_iter) water_matrix[i][j] = valleys[wsi].zval;
+			return;
+		}
+		float const depth(valleys[wsi].depth);
+
+		if (depth < 0) {
+			ripples[i][j].rval *= rm_atten;
+			if (update_iter) water_matrix[i][j] = valleys[wsi].zval;
+			return;
+		}
+		float const zval(max(min(ripple_zval, depth), -depth)); // max ripple height equals water depth
+		ripples[i][j].rval = rm_atten*zval;
+		water_matrix[i][j] = valleys[wsi].zval + zval;
+	}
+	else if (wminside[i][j] == 2) { // fixed water
+		ripples[i][j].rval = rm_atten*ripple_zval;
+		water_matrix[i][j] = water_plane_z + min(MAX_RIPPLE_HEIGHT, ripple_zval);
+		water_matrix[i][j] = max(water_matrix[i][j], zbottom);
+	}
+	else if (update_iter) {
+		if (get_water_enabled(j, i)) {
+			update_water_edges(i, j);
+		}
+		else {
+			ripples[i][j].rval = 0.0; // not sure if this is correct, or if there is something else that should be done here
+		}
+	}
+}
+
 void compute_ripples() {
 
 	if (DISABLE_WATER) return;
@@ -703,134 +773,66 @@ void compute_ripples() {
 		float const tstep(max(fticks, 0.25f)); // ensure some min amount of damping to prevent unstable ripples when the framerate is very high
 		float const rm_atten(pow(RIPPLE_MAT_ATTEN, tstep)), rdamp1(pow(RIPPLE_DAMP1, tstep)), rdamp2(RIPPLE_DAMP2*tstep);
 		start_ripple = 0;
-
-		for (int i = 0; i < MESH_Y_SIZE; ++i) {
-			for (int j = 0; j < MESH_X_SIZE; ++j) {
-				if (!wminside[i][j] || water_matrix[i][j] < z_min_matrix[i][j] /*|| !get_water_enabled(j, i)*/) continue;
-				short const i8(watershed_matrix[i][j].inside8);
-				fix_fp_mag(ripples[i][j].rval);
-				float const rmij(ripples[i][j].rval);
-				float &acc(ripples[i][j].acc);
-				fix_fp_mag(acc);
-				acc *= rm_atten;
-				if (!start_ripple && fabs(acc) > 1.0E-6) start_ripple = 1;
-
-				// 00 0- -0 0+ +0 -- +- ++ -+  22  11
-				// 01 02 04 08 10 20 40 80 100 200 400
-				if (point_interior_to_mesh(j, i)) { // fast mode
-					float const d0( rmij - ripples[i  ][j-1].rval);
-					if (i8 & 0x02)  ripples[i  ][j-1].acc += d0;
-					float const d2( rmij - ripples[i  ][j+1].rval);
-					if (i8 & 0x08)  ripples[i  ][j+1].acc += d2;
-					float const d4((rmij - ripples[i-1][j-1].rval)*SQRTOFTWOINV);
-					if (i8 & 0x20)  ripples[i-1][j-1].acc += d4;
-					float const d1( rmij - ripples[i-1][j  ].rval);
-					if (i8 & 0x04)  ripples[i-1][j  ].acc += d1;
-					float const d7((rmij - ripples[i-1][j+1].rval)*SQRTOFTWOINV);
-					if (i8 & 0x100) ripples[i-1][j+1].acc += d7;
-					float const d5((rmij - ripples[i+1][j-1].rval)*SQRTOFTWOINV);
-					if (i8 & 0x40)  ripples[i+1][j-1].acc += d5;
-					float const d3( rmij - ripples[i+1][j  ].rval);
-					if (i8 & 0x10)  ripples[i+1][j  ].acc += d3;
-					float const d6((rmij - ripples[i+1][j+1].rval)*SQRTOFTWOINV);
-					if (i8 & 0x80)  ripples[i+1][j+1].acc += d6;
-					acc -= d0 + d1 + d2 + d3 + d4 + d5 + d6 + d7;
+		// process the cells that may have ripples plus a one cell border that ripples can spread into;
+		// the full mesh is processed on update iters so that water levels are updated everywhere
+		ripple_bounds_t const &rb(ripple_bounds);
+		bool const rb_empty(rb.empty());
+		int const x1(rb_empty ? 0 : max(rb.x1-1, 0)), x2(rb_empty ? -1 : min(rb.x2+1, MESH_X_SIZE-1));
+		int const y1(rb_empty ? 0 : max(rb.y1-1, 0)), y2(rb_empty ? -1 : min(rb.y2+1, MESH_Y_SIZE-1));
+
+		// gather form: each cell only writes its own acc, and rval is not modified in this pass, so rows can be processed in parallel
+#pragma omp parallel for schedule(static,8)
+		for (int i = y1; i <= y2; ++i) {
+			for (int j = x1; j <= x2; ++j) {
+				bool const active(is_ripple_active(i, j));
+				float const rmij(get_ripple_rval(i, j));
+				float acc(ripples[i][j].acc);
+
+				if (active) {
 					fix_fp_mag(acc);
-					continue;
-				}
-				if (j > 0) {
-					float const dz(rmij - ripples[i][j-1].rval);
-					if (i8 & 0x02) ripples[i][j-1].acc += dz;
-					acc -= dz;
-
-					if (i > 0) {
-						float const dz((rmij - ripples[i-1][j-1].rval)*SQRTOFTWOINV);
-						if (i8 & 0x20) ripples[i-1][j-1].acc += dz;
-						acc -= dz;
-					}
-					if (i < MESH_Y_SIZE-1) {
-						float const dz((rmij - ripples[i+1][j-1].rval)*SQRTOFTWOINV);
-						if (i8 & 0x40) ripples[i+1][j-1].acc += dz;
-						acc -= dz;
-					}
+					acc *= rm_atten;
+					if (fabs(acc) > 1.0E-6) {start_ripple = 1;}
 				}
-				if (i > 0) {
-					float const dz(rmij - ripples[i-1][j].rval);
-					if (i8 & 0x04) ripples[i-1][j].acc += dz;
-					acc -= dz;
+				for (unsigned n = 0; n < 8; ++n) {
+					ripple_nbor_t const &nb(ripple_nbors[n]);
+					int const ii(i + nb.di), jj(j + nb.dj);
+					if (point_outside_mesh(jj, ii)) continue;
+					float const d(nb.weight*(rmij - get_ripple_rval(ii, jj))); // flow from this cell into the neighbor
+					if (active) {acc -= d;}
+					if ((watershed_matrix[ii][jj].inside8 & nb.rev_bit) && is_ripple_active(ii, jj)) {acc -= d;} // flow from the neighbor into this cell
 				}
-				if (j < MESH_X_SIZE-1) {
-					float const dz(rmij - ripples[i][j+1].rval);
-					if (i8 & 0x08) ripples[i][j+1].acc += dz;
-					acc -= dz;
-
-					if (i < MESH_Y_SIZE-1) {
-						float const dz((rmij - ripples[i+1][j+1].rval)*SQRTOFTWOINV);
-						if (i8 & 0x80) ripples[i+1][j+1].acc += dz;
-						acc -= dz;
-					}
-					if (i > 0) {
-						float const dz((rmij - ripples[i-1][j+1].rval)*SQRTOFTWOINV);
-						if (i8 & 0x100) ripples[i-1][j+1].acc += dz;
-						acc -= dz;
-					}
-				}
-				if (i < MESH_Y_SIZE-1) {
-					float const dz(rmij - ripples[i+1][j].rval);
-					if (i8 & 0x10) ripples[i+1][j].acc += dz;
-					acc -= dz;
-				}
-				fix_fp_mag(acc);
+				if (active) {fix_fp_mag(acc);}
+				ripples[i][j].acc = acc;
 			} // for j
 		} // for i
 		if (DEBUG_RIPPLE_TIME) dtime1 += GET_DELTA_TIME;
+		int const ux1(update_iter ? 0 : x1), ux2(update_iter ? MESH_X_SIZE-1 : x2);
+		int const uy1(update_iter ? 0 : y1), uy2(update_iter ? MESH_Y_SIZE-1 : y2);
+		static vector<int> row_x1, row_x2; // range of cells with ripples in each row
+		row_x1.resize(MESH_Y_SIZE);
+		row_x2.resize(MESH_Y_SIZE);
 		
-		for (int i = 0; i < MESH_Y_SIZE; ++i) {
-			for (int j = 0; j < MESH_X_SIZE; ++j) {
-				float ripple_zval(0.0);
-
-				if (wminside[i][j]) {
-					float const zval(rdamp1*(ripples[i][j].rval + rdamp2*ripples[i][j].acc)); // ripple wave height
-					ripple_zval = ((fabs(zval) < TOLERANCE) ? 0.0 : zval); // prevent small floating point numbers
-				}
-				if (wminside[i][j] == 1) { // dynamic water
-					int const wsi(watershed_matrix[i][j].wsi);
-					assert(size_t(wsi) < valleys.size());
+#pragma omp parallel for schedule(static,8)
+		for (int i = uy1; i <= uy2; ++i) {
+			int rx1(INT_MAX), rx2(INT_MIN);
 
-					if (water_matrix[i][j] < z_min_matrix[i][j] && fabs(ripples[i][j].rval) < 1.0E-4 && fabs(ripples[i][j].acc) < 1.0E-4) { // under ground - no ripple
-						if (update_iter) water_matrix[i][j] = valleys[wsi].zval;
-						continue;
-					}
-					float const depth(valleys[wsi].depth);
-
-					if (depth < 0) {
-						ripples[i][j].rval *= rm_atten;
-						if (update_iter) water_matrix[i][j] = valleys[wsi].zval;
-						continue;
-					}
-					float const zval(max(min(ripple_zval, depth), -depth)); // max ripple height equals water depth
-					ripples[i][j].rval = rm_atten*zval;
-					water_matrix[i][j] = valleys[wsi].zval + zval;
-				}
-				else if (wminside[i][j] == 2) { // fixed water
-					ripples[i][j].rval = rm_atten*ripple_zval;
-					water_matrix[i][j] = water_plane_z + min(MAX_RIPPLE_HEIGHT, ripple_zval);
-					water_matrix[i][j] = max(water_matrix[i][j], zbottom);
-				}
-				else if (update_iter) {
-					if (get_water_enabled(j, i)) {
-						update_water_edges(i, j);
-					}
-					else {
-						ripples[i][j].rval = 0.0; // not sure if this is correct, or if there is something else that should be done here
-					}
-				}
-			} // for j
+			for (int j = ux1; j <= ux2; ++j) {
+				update_ripple_water_height(i, j, rm_atten, rdamp1, rdamp2, update_iter);
+				if (wminside[i][j] && (fabs(ripples[i][j].rval) > TOLERANCE || fabs(ripples[i][j].acc) > TOLERANCE)) {rx1 = min(rx1, j); rx2 = max(rx2, j);}
+			}
+			row_x1[i] = rx1;
+			row_x2[i] = rx2;
 		} // for i
+		ripple_bounds.clear();
+
+		for (int i = uy1; i <= uy2; ++i) {
+			if (row_x1[i] <= row_x2[i]) {ripple_bounds.expand(row_x1[i], i, row_x2[i], i);}
+		}
 		if (DEBUG_RIPPLE_TIME) dtime2 += GET_DELTA_TIME;
 	}
 	else { // no ripple
 		matrix_clear_2d(ripples);
+		ripple_bounds.clear();
 
 		// must clear ripples at least once at the beginning
 		if (NO_ICE_RIPPLES || counter == 0 || temperature > W_FREEZE_POINT) {
@@ -920,6 +922,7 @@ void add_splash(point const &pos, int xpos, int ypos, float energy, float radius
 			if (((i - ypos)*(i - ypos) + (j - xpos)*(j - ypos)) <= radsq && wminside[i][j]) {ripples[i][j].rval += splash_size;}
 		}
 	}
+	ripple_bounds.expand(x1, y1, x2, y2);
 	start_ripple = 1;
 }
 
@@ -940,6 +943,8 @@ void add_waves() { // add waves due to wind
 	
 #pragma omp parallel for schedule(static,8) num_threads(2)
 	for (int y = 0; y < MESH_Y_SIZE; ++y) {
+		int rx1(INT_MAX), rx2(INT_MIN);
+
 		for (int x = 0; x < MESH_X_SIZE; ++x) {
 			if (!wminside[y][x] || !get_water_enabled(x, y)) continue; // only in water
 			float const wh(water_matrix[y][x]), depth(wh - mesh_height[y][x]);
@@ -957,9 +962,14 @@ void add_waves() { // add waves due to wind
 			else if (fabs(ripples[y][x].rval) < 0.1*wval) { // don't add wind if already rippling to prevent instability
 				ripples[y][x].rval += wval;
 			}
+			rx1 = min(rx1, x); rx2 = max(rx2, x);
 			start_ripple = 1;
+		} // for x
+		if (rx1 <= rx2) {
+#pragma omp critical(ripple_bounds_update)
+			ripple_bounds.expand(rx1, y, rx2, y);
 		}
-	}
+	} // for y
 	//PRINT_TIME("Add Waves");
 }
 
@@ -27,6 +27,7 @@ float    const AST_COLL_RAD     = 0.25; // limit collisions of large objects for
 float    const AST_PROC_HEIGHT  = 0.1; // height values of procedural shader asteroids
 float    const AST_CLOUD_DIST_SCALE = 64.0;
 float    const AST_CLOUD_POS_RAND   = 0.75;
+unsigned const AST_MT_MIN_COUNT     = 1024; // min number of asteroids to use multiple threads for physics and VFC
 
 int const DEFAULT_AST_TEX    = MOON_TEX; // ROCK_TEX or MOON_TEX
 unsigned const comet_tids[2] = {ROCK_SPHERE_TEX, ICE_TEX};
@@ -928,6 +929,74 @@ void uasteroid_cont::gen_asteroids() {
 	clear();
 	gen_asteroid_placements();
 	sort(begin(), end()); // sort by inst_id to help reduce rendering context switch time (probably irrelevant when instancing is enabled)
+	invalidate_coll_grid();
+}
+
+
+void uasteroid_cont::update_coll_grid() const {
+
+	// asteroid positions are dynamic, so the grid is rebuilt once per frame rather than maintained incrementally;
+	// may be called concurrently by the ship and draw threads, so cg_frame is only updated once the grid is complete
+	if (cg_frame.load() == frame_counter) return; // Note: any change to the set of asteroids invalidates the grid
+#pragma omp critical(asteroid_coll_grid)
+	if (cg_frame.load() != frame_counter) {
+		unsigned const num(size());
+		unsigned num_buckets(1);
+		while (num_buckets < num) {num_buckets <<= 1;}
+		cg_mask       = num_buckets - 1;
+		cg_max_radius = 0.0;
+		for (const_iterator i = begin(); i != end(); ++i) {cg_max_radius = max(cg_max_radius, i->radius);}
+		cg_cell_sz     = max(4.0f*cg_max_radius, TOLERANCE);
+		cg_cell_sz_inv = 1.0/cg_cell_sz;
+		vector<unsigned> buckets(num);
+		cg_start.clear();
+		cg_start.resize(num_buckets+1, 0);
+
+		for (unsigned i = 0; i < num; ++i) { // counting sort by bucket
+			point const &p(operator[](i).pos);
+			buckets[i] = get_cg_bucket(int(floor(p.x*cg_cell_sz_inv)), int(floor(p.y*cg_cell_sz_inv)), int(floor(p.z*cg_cell_sz_inv)));
+			++cg_start[buckets[i]+1];
+		}
+		for (unsigned b = 0; b < num_buckets; ++b) {cg_start[b+1] += cg_start[b];}
+		vector<unsigned> pos(cg_start.begin(), cg_start.end()-1);
+		cg_ixs.resize(num);
+		for (unsigned i = 0; i < num; ++i) {cg_ixs[pos[buckets[i]]++] = i;}
+		cg_frame.store(frame_counter); // publish the grid
+	}
+}
+
+
+// returns sorted indices of asteroids that may be within radius + ast_radius_scale*asteroid_radius of pos; may contain false positives
+void uasteroid_cont::get_asteroids_near(point const &pos, float radius, float ast_radius_scale, vector<unsigned> &ixs) const {
+
+	unsigned const MAX_QUERY_CELLS = 512;
+	ixs.clear();
+	if (empty()) return;
+	update_coll_grid();
+	// pad by half a cell in case asteroids have moved since the grid was built this frame
+	float const qr(radius + ast_radius_scale*cg_max_radius + 0.5*cg_cell_sz);
+	int lo[3], hi[3];
+	unsigned num_cells(1);
+
+	for (unsigned d = 0; d < 3; ++d) {
+		lo[d] = int(floor((pos[d] - qr)*cg_cell_sz_inv));
+		hi[d] = int(floor((pos[d] + qr)*cg_cell_sz_inv));
+		num_cells *= unsigned(hi[d] - lo[d] + 1);
+	}
+	if (num_cells > MAX_QUERY_CELLS || num_cells > size()) { // large query relative to the number of asteroids, return them all
+		for (unsigned i = 0; i < size(); ++i) {ixs.push_back(i);}
+		return;
+	}
+	for (int z = lo[2]; z <= hi[2]; ++z) {
+		for (int y = lo[1]; y <= hi[1]; ++y) {
+			for (int x = lo[0]; x <= hi[0]; ++x) {
+				unsigned const b(get_cg_bucket(x, y, z));
+				ixs.insert(ixs.end(), (cg_ixs.begin() + cg_start[b]), (cg_ixs.begin() + cg_start[b+1]));
+			}
+		}
+	}
+	sort(ixs.begin(), ixs.end()); // different cells can map to the same bucket
+	ixs.erase(unique(ixs.begin(), ixs.end()), ixs.end());
 }
 
 // Note: same as sphere_shadow.part shader, but we do this per-cloud on the CPU rather than per-pixel as a likely optimization
@@ -1086,10 +1155,10 @@ void uasteroid_field::apply_physics(point_d const &pos_, point const &camera) {
 	if (!animate2 || empty()) return;
 	float const sphere_size(calc_sphere_size((pos + pos_), camera, AST_RADIUS_SCALE*radius));
 	if (sphere_size < 2.0) return; // asteroids are too small/far away
+	int const num(size());
 
-	for (iterator i = begin(); i != end(); ++i) {
-		i->apply_field_physics(pos, radius);
-	}
+#pragma omp parallel for schedule(static) if (num >= (int)AST_MT_MIN_COUNT)
+	for (int i = 0; i < num; ++i) {operator[](i).apply_field_physics(pos, radius);} // independent per asteroid
 	if (sphere_size < 8.0) return; // asteroids are too small/far away
 
 	// check for collisions between asteroids
@@ -1148,7 +1217,10 @@ void uasteroid_belt_system::apply_physics(upos_point_type const &pos_, point con
 	//RESET_TIME;
 	calc_colliders();
 	upos_point_type const opn(orbital_plane_normal);
-	for (iterator i = begin(); i != end(); ++i) {i->apply_belt_physics(pos, opn, orbit_scale, colliders);}
+	int const num(size());
+
+#pragma omp parallel for schedule(static) if (num >= (int)AST_MT_MIN_COUNT)
+	for (int i = 0; i < num; ++i) {operator[](i).apply_belt_physics(pos, opn, orbit_scale, colliders);} // colliders are read-only here
 	calc_shadowers();
 	//PRINT_TIME("Physics"); // < 1ms
 	// no collision detection between asteroids as it's rare and too slow
@@ -1164,10 +1236,13 @@ void uasteroid_belt_planet::apply_physics(upos_point_type const &pos_, point con
 	if (planet) { // move all asteroids along the planet's orbit
 		upos_point_type const delta_pos(planet->pos - pos);
 		pos = planet->pos;
+		int const num(size());
 
-		for (iterator i = begin(); i != end(); ++i) {
-			if (animate2) {i->rot_ang += fticks*i->rot_ang0;} // rotation
-			i->pos += delta_pos; // must always update pos, even when physics are disabled
+#pragma omp parallel for schedule(static) if (num >= (int)AST_MT_MIN_COUNT)
+		for (int i = 0; i < num; ++i) {
+			uasteroid &a(operator[](i));
+			if (animate2) {a.rot_ang += fticks*a.rot_ang0;} // rotation
+			a.pos += delta_pos; // must always update pos, even when physics are disabled
 		}
 	}
 	calc_shadowers();
@@ -1301,6 +1376,22 @@ void shadowed_uobject::upload_shadow_casters(shader_t &s) const {
 }
 
 
+void uasteroid_cont::calc_visible_asteroids(point_d const &pos_, point const &camera) {
+
+	int const num(size());
+	vis_flags.resize(num);
+
+	// VFC and size tests are independent and read-only, so do them in parallel, then compact in index order so that draw order is unchanged
+#pragma omp parallel for schedule(static) if (num >= (int)AST_MT_MIN_COUNT)
+	for (int i = 0; i < num; ++i) {vis_flags[i] = operator[](i).is_visible(pos_, camera);}
+	draw_ixs.clear();
+
+	for (int i = 0; i < num; ++i) {
+		if (vis_flags[i]) {draw_ixs.push_back(i);}
+	}
+}
+
+
 void uasteroid_cont::draw(point_d const &pos_, point const &camera, shader_t &s, bool sun_light_already_set) {
 
 	point_d const afpos(pos + pos_);
@@ -1323,7 +1414,8 @@ void uasteroid_cont::draw(point_d const &pos_, point const &camera, shader_t &s,
 	s.add_uniform_float("crater_scale", ((has_sun && !is_ice) ? 1.0 : 0.0));
 	int const loc(s.get_attrib_loc("inst_xform_matrix", 1)); // shader should include: attribute mat4 inst_xform_matrix;
 	set_multisample(0); // disable AA for a big framerate increase (why?)
-	for (const_iterator i = begin(); i != end(); ++i) {i->draw(pos_, camera, s, pld);} // move in front of far clipping plane?
+	calc_visible_asteroids(pos_, camera);
+	for (auto i = draw_ixs.begin(); i != draw_ixs.end(); ++i) {operator[](*i).draw(pos_, camera, s, pld);} // move in front of far clipping plane?
 	asteroid_model_gen.final_draw(loc, force_tid_to); // flush and drawing buffers/state (will do the actual rendering here in instanced mode)
 	set_multisample(1); // reset
 	if (is_ice) {s.clear_specular();} // reset specular
@@ -1343,6 +1435,7 @@ void uasteroid_cont::remove_asteroid(unsigned ix) {
 	assert(ix < size());
 	//std::swap(at(ix), back()); pop_back();
 	erase(begin()+ix); // probably okay if empty after this call
+	invalidate_coll_grid(); // indices have changed
 }
 
 void uasteroid_belt::remove_asteroid(unsigned ix) {
@@ -1459,11 +1552,17 @@ void uasteroid::apply_belt_physics(upos_point_type const &af_pos, upos_point_typ
 }
 
 
-void uasteroid::draw(point_d const &pos_, point const &camera, shader_t &s, pt_line_drawer &pld) const {
+bool uasteroid::is_visible(point_d const &pos_, point const &camera) const {
+
+	point_d const apos(pos_ + pos);
+	if (!univ_sphere_vis_no_inside_test(apos, radius)) return 0;
+	return !sphere_size_less_than(apos, camera, radius, 1.0); // too small/far away
+}
+
+
+void uasteroid::draw(point_d const &pos_, point const &camera, shader_t &s, pt_line_drawer &pld) const { // Note: caller must check is_visible()
 
 	point_d const apos(pos_ + pos);
-	if (!univ_sphere_vis_no_inside_test(apos, radius)) return;
-	if (sphere_size_less_than(apos, camera, radius, 1.0)) return; // too small/far away
 	asteroid_model_gen.draw(inst_id, apos, radius*scale, camera, rot_axis, rot_ang, s, pld);
 }
 
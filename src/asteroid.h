@@ -4,6 +4,7 @@
 #pragma once
 
 #include "universe.h"
+#include <atomic>
 
 unsigned const AF_GRID_SZ = 12;
 
@@ -39,6 +40,7 @@ public:
 		float belt_radius, float belt_width, float belt_thickness, float max_radius, float &ri_max, float &plane_dmax);
 	void apply_field_physics(point const &af_pos, float af_radius);
 	void apply_belt_physics(upos_point_type const &af_pos, upos_point_type const &op_normal, vector3d const &orbit_scale, vector<sphere_t> const &colliders);
+	bool is_visible(point_d const &pos_, point const &camera) const;
 	void draw(point_d const &pos_, point const &camera, shader_t &s, pt_line_drawer &pld) const;
 	void destroy();
 	void set_velocity(vector3d const &v) {velocity = v;}
@@ -68,17 +70,44 @@ public:
 };
 
 
+// frame number of a lazily built per-frame structure that can be queried from multiple threads; the release store publishes the structure,
+// so readers that see the current frame from load() can use it without a lock; copies are invalid so that the structure is rebuilt
+class atomic_frame_t {
+	std::atomic<int> frame;
+public:
+	atomic_frame_t() : frame(-1) {}
+	atomic_frame_t(atomic_frame_t const &) : frame(-1) {}
+	atomic_frame_t &operator=(atomic_frame_t const &) {invalidate(); return *this;}
+	int load() const {return frame.load(std::memory_order_acquire);}
+	void store(int f) {frame.store(f, std::memory_order_release);}
+	void invalidate() {frame.store(-1, std::memory_order_relaxed);}
+};
+
+
 class uasteroid_cont : public uobject_base, public shadowed_uobject, public vector<uasteroid> {
 
 	int rseed;
+
+	// collision broadphase: spatial hash of asteroid centers, rebuilt on the first query of each frame
+	mutable vector<unsigned> cg_start, cg_ixs; // asteroids in bucket b are cg_ixs[cg_start[b]..cg_start[b+1])
+	mutable float cg_cell_sz, cg_cell_sz_inv, cg_max_radius;
+	mutable unsigned cg_mask;
+	mutable atomic_frame_t cg_frame; // stored only after the grid is complete
+
+	unsigned get_cg_bucket(int x, int y, int z) const {return ((unsigned(x)*73856093U) ^ (unsigned(y)*19349663U) ^ (unsigned(z)*83492791U)) & cg_mask;}
+	void update_coll_grid() const;
 protected:
 	pt_line_drawer pld; // for drawing
+	vector<unsigned char> vis_flags; // per-asteroid visibility for the current draw call
+	vector<unsigned> draw_ixs; // visible asteroids in index order
 
+	void calc_visible_asteroids(point_d const &pos_, point const &camera);
 	virtual void gen_asteroid_placements() = 0;
 	virtual void remove_asteroid(unsigned ix);
+	void invalidate_coll_grid() {cg_frame.invalidate();}
 
 public:
-	uasteroid_cont() : rseed(0) {}
+	uasteroid_cont() : rseed(0), cg_cell_sz(0.0), cg_cell_sz_inv(0.0), cg_max_radius(0.0), cg_mask(0) {}
 	virtual ~uasteroid_cont() {}
 	void init(point const &pos, float radius);
 	virtual bool get_is_ice() const {return 0;}
@@ -89,6 +118,7 @@ public:
 	void free_uobj() {clear();}
 	void begin_render(shader_t &shader, bool custom_lighting) {begin_render(shader, shadow_casters.size(), custom_lighting);}
 	float calc_shadow_atten(point const &cpos) const;
+	void get_asteroids_near(point const &pos, float radius, float ast_radius_scale, vector<unsigned> &ixs) const;
 
 	static void begin_render(shader_t &shader, unsigned num_shadow_casters, bool custom_lighting);
 	static void end_render(shader_t &shader);
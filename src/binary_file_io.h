@@ -6,6 +6,14 @@
 
 #include "3DWorld.h"
 #include <zlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using std::string;
 
@@ -63,3 +71,61 @@ struct binary_file_writer : public binary_file_io {
 	}
 };
 
+class mapped_file_t { // read-only memory mapped file
+	char const *data;
+	size_t sz;
+#ifdef _WIN32
+	HANDLE fh, mh;
+#else
+	int fd;
+#endif
+	mapped_file_t(mapped_file_t const &) = delete; // forbidden
+	void operator=(mapped_file_t const &) = delete; // forbidden
+public:
+#ifdef _WIN32
+	mapped_file_t() : data(nullptr), sz(0), fh(INVALID_HANDLE_VALUE), mh(NULL) {}
+#else
+	mapped_file_t() : data(nullptr), sz(0), fd(-1) {}
+#endif
+	~mapped_file_t() {close();}
+	bool is_open() const {return (data != nullptr);}
+	char const *get_data() const {return data;}
+	size_t size() const {return sz;}
+
+	bool open(string const &filename) { // Note: fails for empty files
+		close();
+#ifdef _WIN32
+		fh = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (fh == INVALID_HANDLE_VALUE) return 0;
+		LARGE_INTEGER fsz;
+		if (!GetFileSizeEx(fh, &fsz) || fsz.QuadPart == 0) {close(); return 0;}
+		sz = (size_t)fsz.QuadPart;
+		mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mh == NULL) {close(); return 0;}
+		data = (char const *)MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+#else
+		fd = ::open(filename.c_str(), O_RDONLY);
+		if (fd < 0) return 0;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {close(); return 0;}
+		sz = (size_t)st.st_size;
+		void *const ptr(mmap(nullptr, sz, PROT_READ, MAP_PRIVATE, fd, 0));
+		if (ptr != MAP_FAILED) {data = (char const *)ptr; madvise(ptr, sz, MADV_SEQUENTIAL);}
+#endif
+		if (data == nullptr) {close(); return 0;}
+		return 1;
+	}
+	void close() {
+#ifdef _WIN32
+		if (data) {UnmapViewOfFile(data);}
+		if (mh != NULL) {CloseHandle(mh); mh = NULL;}
+		if (fh != INVALID_HANDLE_VALUE) {CloseHandle(fh); fh = INVALID_HANDLE_VALUE;}
+#else
+		if (data) {munmap((void *)data, sz);}
+		if (fd >= 0) {::close(fd); fd = -1;}
+#endif
+		data = nullptr;
+		sz   = 0;
+	}
+};
+
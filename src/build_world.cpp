@@ -25,6 +25,7 @@ unsigned const BLOOD_PER_SMILEY   = 300;
 unsigned const LG_STEPS_PER_FRAME = 10;
 unsigned const SM_STEPS_PER_FRAME = 1;
 unsigned const SHRAP_DLT_IX_MOD   = 8;
+unsigned const MIN_PAR_LINE_COLLS = 256; // min number of objects in a group to precompute line collisions in parallel
 float const STAR_INNER_RAD        = 0.4;
 float const ROTATE_RATE           = 25.0;
 
@@ -301,6 +302,57 @@ void object_line_coll(dwobject &obj, point const &old_pos, float radius, unsigne
 }
 
 
+struct obj_line_coll_t { // line collision query result for one object, valid only if the object's line is unchanged when it's used
+	point p1, p2;
+	int cindex;
+	bool valid;
+	obj_line_coll_t() : cindex(-1), valid(0) {}
+	bool matches(point const &pos1, point const &pos2) const {return (valid && p1 == pos1 && p2 == pos2);}
+};
+
+vector<obj_line_coll_t> obj_line_colls; // for the group currently being processed
+unsigned obj_line_colls_cobj_change_count(0); // cobj change count at the time obj_line_colls was computed
+
+
+unsigned get_obj_steps_per_frame(dwobject const &obj, int type, unsigned flags, bool large_radius) {
+
+	if (obj.flags & CAMERA_VIEW) {return 4*LG_STEPS_PER_FRAME;} // smaller timesteps if camera view
+	if (type == PLASMA || type == BALL || type == SAWBLADE) {return 3*LG_STEPS_PER_FRAME;}
+	if (is_rocket_type(type)) {return 2*LG_STEPS_PER_FRAME;}
+	if (large_radius /*|| type == STAR5 || type == SHELLC*/ || type == FRAGMENT) {return LG_STEPS_PER_FRAME;}
+	if (type == SHRAPNEL) {return max(1, min(((obj.direction == W_GRENADE) ? 4 : 20), int(0.2*obj.velocity.mag())));}
+	if (type == PRECIP || (flags & PRECIPITATION)) {return 1;}
+	return SM_STEPS_PER_FRAME;
+}
+
+
+// the per-object line collision query is the most expensive part of advancing many small objects such as precipitation;
+// it's read-only, so run it for all airborne objects in parallel up front, and the serial object advance loop uses the result
+// if the object's line is still the same when it gets there (the object may have been teleported, recreated, etc.)
+// and no cobjs have been added or removed since, since a cindex of -1 computed here may miss a newly added cobj
+void precompute_obj_line_colls(obj_group const &objg, int type, size_t num, float time, float grav_dz, float radius, bool large_radius) {
+
+	obj_line_colls.resize(num);
+	obj_line_colls_cobj_change_count = get_cobj_change_count();
+
+#pragma omp parallel for schedule(static,64)
+	for (int j = 0; j < (int)num; ++j) {
+		dwobject const &obj(objg.get_obj(j));
+		obj_line_coll_t &lc(obj_line_colls[j]);
+		lc.valid = 0;
+		if (obj.status != 1 || ((obj.flags & XY_STOPPED) && (obj.flags & Z_STOPPED))) continue;
+		if (obj.pos.z >= czmax || obj.pos.z <= czmin || !is_over_mesh(obj.pos)) continue;
+		if (get_obj_steps_per_frame(obj, type, objg.flags, large_radius) >= LG_STEPS_PER_FRAME) continue; // no line test for this object
+		lc.p1 = obj.pos;
+		lc.p2 = obj.pos + obj.velocity*time;
+		lc.p2.z -= grav_dz;
+		if (dist_less_than(lc.p1, lc.p2, radius)) continue; // no line test in this case
+		check_coll_line(lc.p1, lc.p2, lc.cindex, -1, 0, 0); // return value is unused
+		lc.valid = 1;
+	}
+}
+
+
 void set_global_state() {
 
 	camera_view = 0;
@@ -390,6 +442,8 @@ void process_groups() {
 		if (reflective) {cp.metalness = dodgeball_metalness; cp.tscale = 0.0; cp.color = WHITE; cp.spec_color = WHITE; cp.shine = 100.0;} // reflective metal sphere
 		size_t const iter_count((large_radius || type == MAT_SPHERE || app_rate > 0) ? max_objs : objg.end_id); // optimization to use end_id when valid
 		bool defer_remove_cobj(0);
+		bool const precomp_line_colls(MORE_COLL_TSTEPS && !large_radius && type != SMILEY && iter_count >= MIN_PAR_LINE_COLLS);
+		if (precomp_line_colls) {precompute_obj_line_colls(objg, type, iter_count, time, grav_dz, radius, large_radius);}
 
 		for (size_t jj = 0; jj < iter_count; ++jj) {
 			unsigned const j(unsigned((type == SMILEY) ? (jj + scounter)%max_objs : jj)); // handle smiley permutation
@@ -472,20 +526,19 @@ void process_groups() {
 
 						// What about rolling objects (type_flags & OBJ_ROLLS) on the ground (status == 3)?
 						if (obj.status == 1 && is_over_mesh(pos) && !((obj_flags & XY_STOPPED) && (obj_flags & Z_STOPPED))) {
-							if (obj.flags & CAMERA_VIEW) {spf = 4*LG_STEPS_PER_FRAME;} // smaller timesteps if camera view
-							else if (type == PLASMA || type == BALL || type == SAWBLADE) {spf = 3*LG_STEPS_PER_FRAME;}
-							else if (is_rocket_type(type)) {spf = 2*LG_STEPS_PER_FRAME;}
-							else if (large_radius /*|| type == STAR5 || type == SHELLC*/ || type == FRAGMENT) {spf = LG_STEPS_PER_FRAME;}
-							else if (type == SHRAPNEL) {spf = max(1, min(((obj.direction == W_GRENADE) ? 4 : 20), int(0.2*obj.velocity.mag())));}
-							else if (type == PRECIP || (flags & PRECIPITATION)) {spf = 1;}
-							else {spf = SM_STEPS_PER_FRAME;}
+							spf = get_obj_steps_per_frame(obj, type, flags, large_radius);
 
 							if (MORE_COLL_TSTEPS && obj.status == 1 && spf < LG_STEPS_PER_FRAME && pos.z < czmax && pos.z > czmin) {
 								point pos2(pos + obj.velocity*time); // makes precipitation slower, but collision detection is more correct
 								pos2.z -= grav_dz; // maybe want to try with and without this?
 								// Note: we only do the line intersection test if the object moves by more than its radius this frame (static leaves don't)
 								// Note: could also test pos.z > v_collision_matrix[y][x].zmax
-								if (!dist_less_than(pos, pos2, radius)) {check_coll_line(pos, pos2, cindex, -1, 0, 0);} // return value is unused
+								if (!dist_less_than(pos, pos2, radius)) {
+									if (precomp_line_colls && obj_line_colls[j].matches(pos, pos2) && get_cobj_change_count() == obj_line_colls_cobj_change_count) {
+										cindex = obj_line_colls[j].cindex; // use the precomputed result
+									}
+									else {check_coll_line(pos, pos2, cindex, -1, 0, 0);} // return value is unused
+								}
 							}
 							assert(spf > 0);
 
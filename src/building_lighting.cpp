@@ -7,8 +7,11 @@
 #include "lightmap.h" // for light_source
 #include "cobj_bsp_tree.h"
 #include <thread>
+#include <atomic>
 
 bool const USE_BKG_THREAD = 1;
+unsigned const NUM_LIGHT_RAY_CHUNKS = 32; // primary rays of each light are split into this many independently traced chunks; must be <= 32
+unsigned const MAX_LIGHTS_PER_BATCH = 4; // lights traced together in one background job; partial results are shown as chunks complete
 
 extern int MESH_Z_SIZE, display_mode, display_framerate, camera_surf_collide, animate2;
 extern unsigned LOCAL_RAYS, MAX_RAY_BOUNCES, NUM_THREADS;
@@ -38,14 +41,13 @@ public:
 	bool ray_cast(point const &p1, point const &p2, vector3d &cnorm, colorRGBA &ccolor, float &t) const {
 		if (nodes.empty()) return 0;
 		bool ret(0);
-		node_ix_mgr nixm(nodes, p1, p2);
+		quant_node_ix_mgr nixm(*this, p1, p2);
 		unsigned const num_nodes((unsigned)nodes.size());
 
-		for (unsigned nix = 0; nix < num_nodes;) {
-			tree_node const &n(nodes[nix]);
-			if (!nixm.check_node(nix)) continue; // Note: modifies nix
+		for (unsigned nix = 0, start = 0, end = 0; nix < num_nodes;) {
+			if (!nixm.check_node(nix, start, end)) continue; // Note: modifies nix
 
-			for (unsigned i = n.start; i < n.end; ++i) { // check leaves
+			for (unsigned i = start; i < end; ++i) { // check leaves
 				if (ray_cast_cube(p1, p2, objects[i], cnorm, t)) {ccolor = objects[i].color; ret = 1;}
 			}
 		}
@@ -157,12 +159,20 @@ void building_t::gather_interior_cubes(vect_colored_cube_t &cc) const {
 
 
 class building_indir_light_mgr_t {
+	struct light_job_t { // one chunk of primary rays for one light
+		unsigned light_id, chunk;
+		bool done;
+		light_job_t(unsigned l, unsigned c) : light_id(l), chunk(c), done(0) {}
+	};
 	bool is_running, is_done, kill_thread, lighting_updated, needs_to_join;
-	int cur_bix, cur_light;
-	unsigned cur_tid;
+	int cur_bix;
+	unsigned cur_tid, num_chunks_published;
+	std::atomic<unsigned> num_chunks_done; // for the current batch, incremented by the job as each chunk finishes
 	vector<unsigned char> tex_data;
 	vector<unsigned> light_ids;
+	vector<light_job_t> cur_batch; // written by the job only through the done flags; modified by the main thread only when no job is running
 	set<unsigned> lights_complete;
+	map<unsigned, unsigned> light_chunks_done; // light_id => bit mask of completed ray chunks, for lights that were partially traced
 	cube_bvh_t bvh;
 	lmap_manager_t lmgr;
 	std::thread rt_thread;
@@ -175,20 +185,47 @@ class building_indir_light_mgr_t {
 		lmgr.alloc(tot_sz, MESH_X_SIZE, MESH_Y_SIZE, MESH_SIZE[2], (unsigned char **)nullptr, init_lmcell);
 	}
 	void start_lighting_compute(building_t const &b) {
-		assert(cur_light >= 0);
+		assert(!cur_batch.empty());
 		init_lmgr(0); // clear_lighting=0
+		num_chunks_done = num_chunks_published = 0;
 		is_running = 1;
 		lighting_updated = 1;
 
-		if (USE_BKG_THREAD) { // start a thread to compute cur_light for building b
-			rt_thread = std::thread(&building_indir_light_mgr_t::cast_light_ray, this, b);
+		if (USE_BKG_THREAD) { // start a thread to compute cur_batch for building b
+			rt_thread = std::thread(&building_indir_light_mgr_t::cast_light_rays, this, b);
 			needs_to_join = 1;
 		}
 		else {
-			timer_t timer("Ray Cast Building Light");
-			cast_light_ray(b);
+			timer_t timer("Ray Cast Building Lights");
+			cast_light_rays(b);
 		}
 	}
+	void setup_next_batch() { // add all remaining chunks of the highest priority incomplete lights
+		assert(cur_batch.empty());
+		unsigned num_lights(0);
+
+		for (auto i = light_ids.begin(); i != light_ids.end() && num_lights < MAX_LIGHTS_PER_BATCH; ++i) {
+			if (lights_complete.find(*i) != lights_complete.end()) continue; // already done
+			auto it(light_chunks_done.find(*i));
+			unsigned const done_mask((it == light_chunks_done.end()) ? 0 : it->second);
+
+			for (unsigned c = 0; c < NUM_LIGHT_RAY_CHUNKS; ++c) {
+				if (!(done_mask & (1U << c))) {cur_batch.emplace_back(*i, c);}
+			}
+			++num_lights;
+		} // for i
+	}
+	void finish_batch() { // record completed chunks; chunks skipped due to cancellation are traced in a later batch
+		unsigned const all_chunks_mask((NUM_LIGHT_RAY_CHUNKS == 32) ? ~0U : ((1U << NUM_LIGHT_RAY_CHUNKS) - 1));
+
+		for (auto i = cur_batch.begin(); i != cur_batch.end(); ++i) {
+			if (!i->done) continue;
+			unsigned &done_mask(light_chunks_done[i->light_id]);
+			done_mask |= (1U << i->chunk);
+			if (done_mask == all_chunks_mask) {lights_complete.insert(i->light_id); light_chunks_done.erase(i->light_id);}
+		}
+		cur_batch.clear();
+	}
 	void calc_reflect_ray(point &pos, point const &cpos, vector3d &dir, vector3d const &cnorm, rand_gen_t &rgen, float tolerance) const {
 		vector3d v_ref;
 		calc_reflection_angle(dir, v_ref, cnorm);
@@ -198,12 +235,25 @@ class building_indir_light_mgr_t {
 		if (dot_product(dir, cnorm) < 0.0) {dir.negate();} // make sure it points away from the surface (is this needed?)
 		pos = cpos + tolerance*dir; // move slightly away from the surface
 	}
-	void cast_light_ray(building_t const &b) {
-		// Note: modifies lmgr, but otherwise thread safe
+	void cast_light_rays(building_t const &b) {
+		// Note: modifies lmgr and the done flags of cur_batch, but otherwise thread safe
 		unsigned const num_rt_threads(NUM_THREADS - (USE_BKG_THREAD ? 1 : 0)); // reserve a thread for the main thread if running in the background
+
+		// all chunks of all lights in the batch are traced in a single parallel loop
+#pragma omp parallel for schedule(dynamic,1) num_threads(num_rt_threads)
+		for (int i = 0; i < (int)cur_batch.size(); ++i) {
+			if (kill_thread) continue; // cancelled; only whole chunks are added to the lighting, so that they can be resumed later
+			light_job_t &job(cur_batch[i]);
+			cast_light_ray_chunk(b, job.light_id, job.chunk);
+			job.done = 1;
+			++num_chunks_done;
+		}
+		is_running = 0;
+	}
+	void cast_light_ray_chunk(building_t const &b, unsigned light_id, unsigned chunk) {
 		vector<room_object_t> const &objs(b.interior->room_geom->objs);
-		assert((unsigned)cur_light < objs.size());
-		room_object_t const &ro(objs[cur_light]);
+		assert(light_id < objs.size());
+		room_object_t const &ro(objs[light_id]);
 		colorRGBA const lcolor(ro.get_color());
 		cube_t const scene_bounds(get_scene_bounds_bcube()); // expected by lmap update code
 		point const ray_scale(scene_bounds.get_size()/b.bcube.get_size()), llc_shift(scene_bounds.get_llc() - b.bcube.get_llc()*ray_scale);
@@ -213,13 +263,11 @@ class building_indir_light_mgr_t {
 		if (b.has_pri_hall()) {weight *= 0.8;} // floorplan is open and well lit, indir lighting value seems too high
 		if (b.is_house) {weight *= 2.0;} // houses have dimmer lights and seem to work better with more indir
 		unsigned const NUM_PRI_SPLITS = 16;
-		int const num_rays(LOCAL_RAYS/NUM_PRI_SPLITS);
+		unsigned const num_rays(LOCAL_RAYS/NUM_PRI_SPLITS), ray_start((chunk*num_rays)/NUM_LIGHT_RAY_CHUNKS), ray_end(((chunk+1)*num_rays)/NUM_LIGHT_RAY_CHUNKS);
 
-#pragma omp parallel for schedule(dynamic) num_threads(num_rt_threads)
-		for (int n = 0; n < num_rays; ++n) {
-			if (kill_thread) continue;
+		for (unsigned n = ray_start; n < ray_end; ++n) {
 			rand_gen_t rgen;
-			rgen.set_state(n+1, cur_light);
+			rgen.set_state(n+1, light_id);
 			vector3d pri_dir(rgen.signed_rand_vector_spherical(1.0).get_norm());
 			pri_dir.z = -fabs(pri_dir.z); // make sure dir points down
 			point origin, init_cpos, cpos;
@@ -254,7 +302,6 @@ class building_indir_light_mgr_t {
 				} // for bounce
 			} // for splits
 		} // for n
-		is_running = 0;
 	}
 	void wait_for_finish(bool force_kill) {
 		// Note: for now the time taken to process a light should be pretty fast so we just block until finished; set kill_thread=1 to be faster
@@ -270,15 +317,17 @@ class building_indir_light_mgr_t {
 		if (needs_to_join) {rt_thread.join(); needs_to_join = 0;}
 	}
 public:
-	building_indir_light_mgr_t() : is_running(0), is_done(0), kill_thread(0), lighting_updated(0), needs_to_join(0), cur_bix(-1), cur_light(-1), cur_tid(0) {}
+	building_indir_light_mgr_t() : is_running(0), is_done(0), kill_thread(0), lighting_updated(0), needs_to_join(0), cur_bix(-1), cur_tid(0), num_chunks_published(0), num_chunks_done(0) {}
 
 	void clear() {
+		end_rt_job(); // must finish before clearing cur_batch
 		is_done = lighting_updated = 0;
-		cur_bix = cur_light = -1;
+		cur_bix = -1;
 		tex_data.clear();
 		light_ids.clear();
+		cur_batch.clear();
 		lights_complete.clear();
-		end_rt_job();
+		light_chunks_done.clear();
 		lmgr.reset_all(); // clear lighting values back to 0
 		bvh.clear();
 	}
@@ -302,21 +351,29 @@ public:
 			oss << "Lights: " << lights_complete.size() << " / " << light_ids.size();
 			lighting_update_text = oss.str();
 		}
-		if (is_running) return; // still running, let it continue
+		if (is_running) { // still running, let it continue
+			unsigned const chunks_done(num_chunks_done);
+
+			if (chunks_done > num_chunks_published) { // show partial results for chunks completed since the last update
+				// Note: reads lmgr while the job is writing to it, so chunks in progress may be partially included; this is okay for a progressive update
+				update_volume_light_texture();
+				num_chunks_published = chunks_done;
+				tid = cur_tid;
+			}
+			return;
+		}
 
 		if (lighting_updated) { // update lighting texture based on incremental progress
 			maybe_join_thread();
 			update_volume_light_texture();
 			lighting_updated = 0;
 		}
-		// nothing is running and there is more work to do, find the nearest light to the target and process it
-		if (cur_light >= 0) {lights_complete.insert(cur_light); cur_light = -1;} // mark the most recent light as complete
+		// nothing is running and there is more work to do, find the nearest lights to the target and process them
+		maybe_join_thread(); // in case the job was cancelled after the last texture update
+		finish_batch();
 		b.order_lights_by_priority(target, light_ids);
-
-		for (auto i = light_ids.begin(); i != light_ids.end(); ++i) {
-			if (lights_complete.find(*i) == lights_complete.end()) {cur_light = *i; break;} // find an incomplete light
-		}
-		if (cur_light >= 0) {start_lighting_compute(b);} // this light is next
+		setup_next_batch();
+		if (!cur_batch.empty()) {start_lighting_compute(b);} // these lights are next
 		else {is_done = 1;} // no more lights to process
 		//cout << "Process light " << lights_complete.size() << " of " << light_ids.size() << endl;
 		tid = cur_tid;
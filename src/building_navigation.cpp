@@ -6,6 +6,7 @@
 #include "buildings.h"
 #include "city.h" // for pedestrian_t
 #include <queue>
+#include <cfloat>
 #pragma warning(disable : 26812) // prefer enum class over enum
 
 
@@ -45,9 +46,72 @@ class building_nav_graph_t {
 	unsigned num_rooms, num_stairs;
 	float stairs_extend;
 	vector<node_t> nodes;
+	// lazily computed query acceleration data; cleared when the graph is modified
+	mutable vector<unsigned> comp_ids; // connected component ID of each node
+	mutable vector<vector<float>> stairs_dists; // [2*stairs+up_or_down][room] => graph distance from stairs to room without passing through other stairs
+
 	node_t       &get_node(unsigned room)       {assert(room < nodes.size()); return nodes[room];}
 	node_t const &get_node(unsigned room) const {assert(room < nodes.size()); return nodes[room];}
 
+	void invalidate_cached_data() {
+		comp_ids.clear();
+		stairs_dists.clear();
+	}
+	void calc_comp_ids() const {
+		comp_ids.resize(nodes.size(), 0);
+		vector<uint8_t> seen(nodes.size(), 0);
+		vector<unsigned> pend;
+		unsigned ncomp(0);
+
+		for (unsigned n = 0; n < nodes.size(); ++n) {
+			if (seen[n]) continue; // node already processed
+			pend.push_back(n);
+			seen[n] = 1;
+
+			while (!pend.empty()) {
+				unsigned const cur(pend.back());
+				node_t const &node(get_node(cur));
+				pend.pop_back();
+				comp_ids[cur] = ncomp;
+
+				for (auto i = node.conn_rooms.begin(); i != node.conn_rooms.end(); ++i) {
+					if (!seen[i->ix]) {pend.push_back(i->ix); seen[i->ix] = 1;}
+				}
+			} // end while()
+			++ncomp;
+		} // for n
+	}
+	vector<float> const &get_stairs_dists(unsigned node_ix, bool up_or_down) const { // Dijkstra's algorithm from this stairs node, using the same costs as A*
+		assert(node_ix >= num_rooms && node_ix < nodes.size());
+		if (stairs_dists.empty()) {stairs_dists.resize(2*num_stairs);}
+		vector<float> &dists(stairs_dists[2*(node_ix - num_rooms) + up_or_down]);
+		if (!dists.empty()) return dists; // already computed
+		dists.resize(nodes.size(), FLT_MAX); // FLT_MAX = unreachable
+		std::priority_queue<pair<float, unsigned> > open_queue;
+		dists[node_ix] = 0.0;
+		open_queue.push(make_pair(0.0f, node_ix));
+
+		while (!open_queue.empty()) {
+			float const cur_dist(-open_queue.top().first);
+			unsigned const cur(open_queue.top().second);
+			open_queue.pop();
+			if (cur_dist > dists[cur]) continue; // stale queue entry
+			node_t const &cur_node(get_node(cur));
+			point const center(cur_node.get_center(0.0));
+
+			for (auto i = cur_node.conn_rooms.begin(); i != cur_node.conn_rooms.end(); ++i) {
+				node_t const &conn_node(get_node(i->ix));
+				if (conn_node.is_stairs) continue; // don't pass through other stairs
+				vector2d const &pt(i->pt[up_or_down]);
+				float const new_dist(cur_dist + p2p_dist_xy(center, pt) + p2p_dist_xy(pt, conn_node.get_center(0.0)));
+				if (new_dist >= dists[i->ix]) continue; // not better
+				dists[i->ix] = new_dist;
+				open_queue.push(make_pair(-new_dist, i->ix));
+			} // for i
+		} // end while()
+		return dists;
+	}
+
 	void remove_connection(unsigned from, unsigned to) {
 		auto &conn(get_node(from).conn_rooms);
 
@@ -64,6 +128,7 @@ public:
 		num_stairs = num_stairs_;
 		nodes.resize(num_rooms + num_stairs);
 		for (unsigned n = num_rooms; n < nodes.size(); ++n) {nodes[n].is_stairs = 1;}
+		invalidate_cached_data();
 	}
 	void set_room_bcube  (unsigned room,   cube_t const &c) {get_node(room).bcube = c;}
 	void set_stairs_bcube(unsigned stairs, cube_t const &c) {get_node(stairs + num_rooms).bcube = c;}
@@ -80,35 +145,30 @@ public:
 		entry_d.d[dim][!dir] = entry_d.d[dim][ dir] - extend; // shrink to zero area at the entrance to the stairs when going down
 		get_node(room).add_conn_room(node_ix2, entry_u, entry_d);
 		n2.add_conn_room(room, entry_u, entry_d);
+		invalidate_cached_data();
 	}
 	void connect_rooms(unsigned room1, unsigned room2, cube_t const &conn_bcube) { // graph is bidirectional
 		assert(room1 < num_rooms && room2 < num_rooms);
 		get_node(room1).add_conn_room(room2, conn_bcube, conn_bcube);
 		get_node(room2).add_conn_room(room1, conn_bcube, conn_bcube);
+		invalidate_cached_data();
 	}
 	void disconnect_room_pair(unsigned room1, unsigned room2) { // remove connections in both directions
 		assert(room1 != room2 && room1 < num_rooms && room2 < num_rooms);
 		remove_connection(room1, room2);
 		remove_connection(room2, room1);
+		invalidate_cached_data();
 	}
 	bool is_room_connected_to(unsigned room1, unsigned room2) const { // Note: likely faster than running full A* algorithm
 		assert(room1 < num_rooms && room2 < num_rooms);
 		if (room1 == room2) return 1;
-		vector<uint8_t> seen(nodes.size(), 0);
-		vector<unsigned> pend;
-		pend.push_back(room1);
-		seen[room1] = 1;
-
-		while (!pend.empty()) {
-			node_t const &node(get_node(pend.back()));
-			pend.pop_back();
-
-			for (auto i = node.conn_rooms.begin(); i != node.conn_rooms.end(); ++i) {
-				if (i->ix == room2) return 1; // found, done
-				if (!seen[i->ix]) {pend.push_back(i->ix); seen[i->ix] = 1;}
-			}
-		} // end while()
-		return 0; // not found
+		if (comp_ids.empty()) {calc_comp_ids();} // computed once, then reused across queries
+		return (comp_ids[room1] == comp_ids[room2]);
+	}
+	// returns the A* path cost between room and this stairs node without passing through other stairs, or FLT_MAX if unreachable
+	float get_stairs_room_dist(unsigned stairs_node_ix, unsigned room, bool up_or_down) const {
+		assert(room < num_rooms);
+		return get_stairs_dists(stairs_node_ix, up_or_down)[room];
 	}
 	unsigned count_connected_components() const {
 		if (nodes.empty()) return 0;
@@ -564,8 +624,22 @@ bool building_t::find_route_to_point(point const &from, point const &to, float r
 		vector<unsigned> nearest_stairs;
 		find_nearest_stairs(from, to, nearest_stairs, 1); // straight_only=1; pass in loc1.part_ix if both loc part_ix values are equal?
 		bool const up_or_down(loc1.floor > loc2.floor); // 0=up, 1=down
+		// use the cached stairs distance tables to drop stairs that can't reach both rooms and to order the rest by path length,
+		// rather than running A* to/from each stairwell in turn; the stable sort keeps the distance order of find_nearest_stairs() for ties
+		vector<pair<float, unsigned>> stairs_by_dist;
+
+		for (auto s = nearest_stairs.begin(); s != nearest_stairs.end(); ++s) {
+			unsigned const stairs_room_ix(*s + interior->rooms.size()); // map to graph space
+			float const d1(interior->nav_graph->get_stairs_room_dist(stairs_room_ix, loc1.room_ix,  up_or_down));
+			float const d2(interior->nav_graph->get_stairs_room_dist(stairs_room_ix, loc2.room_ix, !up_or_down));
+			if (d1 == FLT_MAX || d2 == FLT_MAX) continue; // no path through these stairs
+			stairs_by_dist.emplace_back((d1 + d2), *s);
+		}
+		stable_sort(stairs_by_dist.begin(), stairs_by_dist.end(), [](pair<float, unsigned> const &a, pair<float, unsigned> const &b) {return (a.first < b.first);});
+		nearest_stairs.clear();
+		for (auto s = stairs_by_dist.begin(); s != stairs_by_dist.end(); ++s) {nearest_stairs.push_back(s->second);}
 
-		for (auto s = nearest_stairs.begin(); s != nearest_stairs.end(); ++s) { // try using stairs, closest to furthest
+		for (auto s = nearest_stairs.begin(); s != nearest_stairs.end(); ++s) { // try using stairs, shortest path to longest
 			assert(*s < interior->stairwells.size());
 			stairwell_t const &stairs(interior->stairwells[*s]);
 			unsigned const stairs_room_ix(*s + interior->rooms.size()); // map to graph space
@@ -113,7 +113,9 @@ bool car_t::front_intersects_car(car_t const &c) const {
 
 void car_t::honk_horn_if_close() const {
 	point const pos(get_center());
-	if (dist_less_than((pos + get_tiled_terrain_model_xlate()), get_camera_pos(), 1.0)) {gen_sound(SOUND_HORN, pos);}
+	if (!dist_less_than((pos + get_tiled_terrain_model_xlate()), get_camera_pos(), 1.0)) return;
+#pragma omp critical(car_honk) // may be called from multiple car update threads
+	gen_sound(SOUND_HORN, pos);
 }
 
 void car_t::honk_horn_if_close_and_fast() const {
@@ -702,7 +704,7 @@ bool car_manager_t::check_car_for_ped_colls(car_t &car) const {
 	coll_area.d[car.dim][car.dir] += (car.dir ? 1.25 : -1.25)*car.get_length(); // extend the front
 	coll_area.d[!car.dim][0] -= 0.5*car.get_width();
 	coll_area.d[!car.dim][1] += 0.5*car.get_width();
-	static rand_gen_t rgen;
+	static thread_local rand_gen_t rgen; // called from multiple car update threads
 
 	for (auto i = peds.begin(); i != peds.end(); ++i) {
 		if (coll_area.contains_pt_xy_exp(i->pos, i->radius)) {
@@ -739,7 +741,8 @@ void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed
 #pragma omp critical(modify_car_data)
 	{
 		if (car_destroyed) {remove_destroyed_cars();} // at least one car was destroyed in the previous frame - remove it/them
-		sort(cars.begin(), cars.end(), comp_car_road_then_pos(camera_pdu.pos - dstate.xlate)); // sort by city/road/position for intersection tests and tile shadow map binds
+		// sort by city/road/position for intersection tests and tile shadow map binds; most cars are still in order from the previous frame
+		resort_mostly_sorted(cars.begin(), cars.end(), comp_car_road_then_pos(camera_pdu.pos - dstate.xlate));
 	}
 	entering_city.clear();
 	car_blocks.clear();
@@ -747,52 +750,70 @@ void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed
 	bool saw_parked(0);
 	//unsigned num_on_conn_road(0);
 
-	for (auto i = cars.begin(); i != cars.end(); ++i) { // move cars
+	for (auto i = cars.begin(); i != cars.end(); ++i) { // build per-city car blocks
 		unsigned const cix(i - cars.begin());
-		i->car_in_front = nullptr; // reset for this frame
 
 		if (car_blocks.empty() || i->cur_city != car_blocks.back().cur_city) {
 			if (!saw_parked && !car_blocks.empty()) {car_blocks.back().first_parked = cix;} // no parked cars in prev city
 			saw_parked = 0; // reset for next city
 			car_blocks.emplace_back(cix, i->cur_city);
 		}
-		if (i->is_parked()) {
-			if (!saw_parked) {car_blocks.back().first_parked = cix; saw_parked = 1;}
-			continue; // no update for parked cars
-		}
-		i->move(speed);
-		if (i->entering_city) {entering_city.push_back(cix);} // record for use in collision detection
-		if (!i->stopped_at_light && i->is_almost_stopped() && i->in_isect()) {get_car_isec(*i).stoplight.mark_blocked(i->dim, i->dir);} // blocking intersection
-		register_car_at_city(*i);
+		if (i->is_parked() && !saw_parked) {car_blocks.back().first_parked = cix; saw_parked = 1;}
 	} // for i
 	if (!saw_parked && !car_blocks.empty()) {car_blocks.back().first_parked = cars.size();} // no parked cars in final city
 	car_blocks.emplace_back(cars.size(), 0); // add terminator
-
-	for (auto i = cars.begin(); i != cars.end(); ++i) { // collision detection
-		if (i->is_parked()) continue; // no collisions for parked cars
-		bool const on_conn_road(i->cur_city == CONN_CITY_IX);
-		float const length(i->get_length()), max_check_dist(max(3.0f*length, (length + i->get_max_lookahead_dist()))); // max of collision dist and car-in-front dist
-
-		for (auto j = i+1; j != cars.end(); ++j) { // check for collisions with cars on the same road (can't test seg because they can be on diff segs but still collide)
-			if (i->cur_city != j->cur_city || i->cur_road != j->cur_road) break; // different cities or roads
-			if (!on_conn_road && i->cur_road_type == j->cur_road_type && abs((int)i->cur_seg - (int)j->cur_seg) > (on_conn_road ? 1 : 0)) break; // diff road segs or diff isects
-			check_collision(*i, *j);
-			i->register_adj_car(*j);
-			j->register_adj_car(*i);
-			if (!dist_xy_less_than(i->get_center(), j->get_center(), max_check_dist)) break;
+	unsigned const num_blocks(car_blocks.size() - 1);
+	entering_city_by_block.resize(num_blocks);
+
+	// first phase: move cars and check for collisions with cars on the same road; each city is independent, so process them in parallel
+#pragma omp parallel for schedule(dynamic,1)
+	for (int b = 0; b < (int)num_blocks; ++b) {
+		car_block_t const &cb(car_blocks[b]);
+		vector<unsigned> &block_entering_city(entering_city_by_block[b]);
+		block_entering_city.clear();
+
+		for (unsigned cix = cb.start; cix < cb.first_parked; ++cix) { // move cars, skipping parked cars
+			car_t &car(cars[cix]);
+			car.car_in_front = nullptr; // reset for this frame
+			car.move(speed);
+			if (car.entering_city) {block_entering_city.push_back(cix);} // record for use in collision detection
+			if (!car.stopped_at_light && car.is_almost_stopped() && car.in_isect()) {get_car_isec(car).stoplight.mark_blocked(car.dim, car.dir);} // blocking intersection
+			register_car_at_city(car);
 		}
-		if (on_conn_road) { // on connector road, check before entering intersection to a city
-			for (auto ix = entering_city.begin(); ix != entering_city.end(); ++ix) {
-				if (*ix != unsigned(i - cars.begin())) {check_collision(*i, cars[*ix]);}
+		for (unsigned cix = cb.first_parked; cix < car_blocks[b+1].start; ++cix) {cars[cix].car_in_front = nullptr;} // reset for this frame
+
+		for (auto i = cars.begin()+cb.start; i != cars.begin()+cb.first_parked; ++i) { // collision detection, skipping parked cars
+			bool const on_conn_road(i->cur_city == CONN_CITY_IX);
+			float const length(i->get_length()), max_check_dist(max(3.0f*length, (length + i->get_max_lookahead_dist()))); // max of collision dist and car-in-front dist
+
+			for (auto j = i+1; j != cars.end(); ++j) { // check for collisions with cars on the same road (can't test seg because they can be on diff segs but still collide)
+				if (i->cur_city != j->cur_city || i->cur_road != j->cur_road) break; // different cities or roads
+				if (!on_conn_road && i->cur_road_type == j->cur_road_type && abs((int)i->cur_seg - (int)j->cur_seg) > (on_conn_road ? 1 : 0)) break; // diff road segs or diff isects
+				check_collision(*i, *j);
+				i->register_adj_car(*j);
+				j->register_adj_car(*i);
+				if (!dist_xy_less_than(i->get_center(), j->get_center(), max_check_dist)) break;
 			}
-			//++num_on_conn_road;
-		}
-		if (i->in_isect()) {
-			int const next_car(find_next_car_after_turn(*i)); // Note: calculates in i->car_in_front
-			if (next_car >= 0) {check_collision(*i, cars[next_car]);} // make sure we collide with the correct car
-		}
-		if (!peds_crossing_roads.peds.empty()) {check_car_for_ped_colls(*i);}
-	} // for i
+			if (!peds_crossing_roads.peds.empty()) {check_car_for_ped_colls(*i);}
+		} // for i
+	} // for b
+	for (auto b = entering_city_by_block.begin(); b != entering_city_by_block.end(); ++b) {entering_city.insert(entering_city.end(), b->begin(), b->end());}
+
+	// second phase: interactions that can cross city boundaries, processed serially in car order so that results are deterministic
+	for (auto cb = car_blocks.begin(); cb+1 < car_blocks.end(); ++cb) {
+		for (auto i = cars.begin()+cb->start; i != cars.begin()+cb->first_parked; ++i) {
+			if (i->cur_city == CONN_CITY_IX) { // on connector road, check before entering intersection to a city
+				for (auto ix = entering_city.begin(); ix != entering_city.end(); ++ix) {
+					if (*ix != unsigned(i - cars.begin())) {check_collision(*i, cars[*ix]);}
+				}
+				//++num_on_conn_road;
+			}
+			if (i->in_isect()) {
+				int const next_car(find_next_car_after_turn(*i)); // Note: calculates in i->car_in_front
+				if (next_car >= 0) {check_collision(*i, cars[next_car]);} // make sure we collide with the correct car
+			}
+		} // for i
+	} // for cb
 	update_cars(); // run update logic
 
 	if (map_mode) { // create cars_by_road
@@ -191,6 +191,27 @@ struct comp_car_road_then_pos {
 	bool operator()(car_t const &c1, car_t const &c2) const;
 };
 
+// re-sorts a range that is mostly sorted from the previous frame in O(n + k*log(k)) time, where k is the number of out-of-order elements;
+// out-of-order elements are moved to the end of the range, sorted, and merged back in; the relative order of the other elements is kept
+template<typename I, typename C> void resort_mostly_sorted(I begin, I end, C const &comp) {
+	if (end - begin < 2) return;
+	I out(begin); // end of the in-order elements, which are compacted in place
+	vector<typename std::iterator_traits<I>::value_type> displaced;
+
+	for (I i = begin; i != end; ++i) {
+		bool const before_prev(out != begin && comp(*i, *(out-1)));
+		// if this element is after the next one, but the next one is in order, then this is the element that moved
+		bool const after_next(!before_prev && (i+1) != end && comp(*(i+1), *i) && (out == begin || !comp(*(i+1), *(out-1))));
+		if (before_prev || after_next) {displaced.push_back(std::move(*i)); continue;}
+		if (out != i) {*out = std::move(*i);}
+		++out;
+	}
+	if (displaced.empty()) return; // already sorted
+	std::move(displaced.begin(), displaced.end(), out);
+	std::sort(out, end, comp);
+	std::inplace_merge(begin, out, end, comp);
+}
+
 
 class road_mat_mgr_t {
 
@@ -592,6 +613,7 @@ class car_manager_t {
 	car_draw_state_t dstate;
 	rand_gen_t rgen;
 	vector<unsigned> entering_city;
+	vector<vector<unsigned>> entering_city_by_block; // per car block, merged into entering_city
 	cube_t garages_bcube;
 	unsigned first_parked_car, first_garage_car;
 	bool car_destroyed;
@@ -655,9 +677,9 @@ struct pedestrian_t : public waiting_obj_t {
 	void stop();
 	void go();
 	bool check_for_safe_road_crossing(ped_manager_t const &ped_mgr, cube_t const &plot_bcube, cube_t const &next_plot_bcube, vect_cube_t *dbg_cubes=nullptr) const;
-	bool check_ped_ped_coll_range(vector<pedestrian_t> &peds, unsigned pid, unsigned ped_start, unsigned target_plot, float prox_radius, vector3d &force);
+	bool check_ped_ped_coll_range(vector<pedestrian_t> &peds, unsigned pid, vector<unsigned> const &cands, unsigned min_ix, unsigned target_plot, float prox_radius, vector3d &force);
 	bool check_ped_ped_coll(ped_manager_t const &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, float delta_dir);
-	bool check_ped_ped_coll_stopped(vector<pedestrian_t> &peds, unsigned pid);
+	bool check_ped_ped_coll_stopped(ped_manager_t const &ped_mgr, vector<pedestrian_t> &peds, unsigned pid);
 	bool check_inside_plot(ped_manager_t &ped_mgr, point const &prev_pos, cube_t const &plot_bcube, cube_t const &next_plot_bcube);
 	bool check_road_coll(ped_manager_t const &ped_mgr, cube_t const &plot_bcube, cube_t const &next_plot_bcube) const;
 	bool is_valid_pos(vect_cube_t const &colliders, bool &ped_at_dest, ped_manager_t const *const ped_mgr) const;
@@ -693,10 +715,24 @@ class path_finder_t {
 	path_t cur_path, best_path, partial_path;
 	bool debug;
 
+	struct path_cache_key_t { // avoid set + plot bounds + gap hash, quantized entry and dest positions
+		uint64_t avoid_hash;
+		int entry[2], dest[2];
+		bool operator<(path_cache_key_t const &k) const {
+			if (avoid_hash != k.avoid_hash) return (avoid_hash < k.avoid_hash);
+			if (entry[0] != k.entry[0]) return (entry[0] < k.entry[0]);
+			if (entry[1] != k.entry[1]) return (entry[1] < k.entry[1]);
+			if (dest [0] != k.dest [0]) return (dest [0] < k.dest [0]);
+			return (dest[1] < k.dest[1]);
+		}
+	};
+	map<path_cache_key_t, vector<point>> path_cache; // memoized successful results of find_best_path()
+
 	bool add_pt_to_path(point const &p, path_t &path) const;
 	bool add_pts_around_cube_xy(path_t &path, path_t const &cur_path, path_t::const_iterator p, cube_t const &c, bool dir);
 	void find_best_path_recur(path_t const &cur_path, unsigned depth);
 	bool shorten_path(path_t &path) const;
+	path_cache_key_t get_path_cache_key() const;
 public:
 	path_finder_t(bool debug_=0) : gap(0.0f), debug(debug_) {}
 	vect_cube_t &get_avoid_vector() {return avoid;}
@@ -707,6 +743,22 @@ public:
 	unsigned run(point const &pos_, point const &dest_, cube_t const &plot_bcube_, float gap_, point &new_dest);
 };
 
+class ped_grid_t { // spatial hash of city peds for ped-ped proximity queries, rebuilt each frame
+
+	vector<float> px, py; // SoA ped positions at build time
+	vector<unsigned> cell_start, ped_ixs; // peds in hash bucket b are ped_ixs[cell_start[b]..cell_start[b+1])
+	float cell_sz, cell_sz_inv, pad; // pad accounts for peds moving after the grid was built
+	unsigned hash_mask;
+
+	int get_cell(float v) const {return int(floor(v*cell_sz_inv));}
+	unsigned get_bucket(int x, int y) const {return ((unsigned(x)*73856093U) ^ (unsigned(y)*19349663U)) & hash_mask;}
+public:
+	ped_grid_t() : cell_sz(0.0), cell_sz_inv(0.0), pad(0.0), hash_mask(0) {}
+	bool empty() const {return ped_ixs.empty();}
+	void build(vector<pedestrian_t> const &peds);
+	void get_peds_near(point const &pos, float radius, vector<unsigned> &ixs) const;
+};
+
 class ped_manager_t { // pedestrians
 
 	struct city_ixs_t {
@@ -721,6 +773,7 @@ class ped_manager_t { // pedestrians
 	vector<city_ixs_t> by_city; // first ped/plot index for each city
 	vector<unsigned> by_plot;
 	vector<unsigned char> need_to_sort_city;
+	ped_grid_t ped_grid;
 	vector<car_city_vect_t> cars_by_city;
 	vector<point> bldg_ppl_pos;
 	rand_gen_t rgen;
@@ -772,6 +825,7 @@ public:
 	void next_frame();
 	pedestrian_t const *get_ped_at(point const &p1, point const &p2) const;
 	unsigned get_first_ped_at_plot(unsigned plot) const {assert(plot < by_plot.size()); return by_plot[plot];}
+	ped_grid_t const &get_ped_grid() const {return ped_grid;}
 	void get_peds_crossing_roads(ped_city_vect_t &pcv) const;
 	void draw(vector3d const &xlate, bool use_dlights, bool shadow_only, bool is_dlight_shadows);
 	void draw_peds_in_building(int first_ped_ix, unsigned bix, shader_t &s, vector3d const &xlate, bool dlight_shadow_only);
@@ -80,14 +80,13 @@ public:
 		float const dist_sq(v1.mag_sq());
 		vector3d const v1n(v1/dist_sq);
 		float light(1.0); // start off fully lit
-		node_ix_mgr nixm(nodes, pos, sun_pos);
+		quant_node_ix_mgr nixm(*this, pos, sun_pos);
 		unsigned const num_nodes((unsigned)nodes.size());
 
-		for (unsigned nix = 0; nix < num_nodes;) {
-			tree_node const &n(nodes[nix]);
-			if (!nixm.check_node(nix)) continue;
+		for (unsigned nix = 0, start = 0, end = 0; nix < num_nodes;) {
+			if (!nixm.check_node(nix, start, end)) continue;
 
-			for (unsigned i = n.start; i < n.end; ++i) { // check leaves
+			for (unsigned i = start; i < end; ++i) { // check leaves
 				particle_cloud const &pc(mgr[objects[i].id]);
 				vector3d const v2(sun_pos, pc.pos);
 				if (v2.mag_sq() > dist_sq) continue; // further from the sun
@@ -4,14 +4,22 @@
 
 #include "3DWorld.h"
 #include "cobj_bsp_tree.h"
+#include <xmmintrin.h>
+#include <cfloat> // for FLT_MAX
 
 
 unsigned const MAX_LEAF_SIZE = 2;
 float const POLY_TOLER       = 1.0E-6;
 float const OVERLAP_AMT      = 0.02;
+float const REFIT_MAX_SA_GROW = 2.0; // rebuild refit subtrees when their surface area grows by more than this factor
+unsigned const REFIT_MIN_REBUILD_NODES = 8; // subtrees with fewer nodes are only refit
+unsigned const SAH_NUM_BINS  = 16;
+unsigned const BENCH_NUM_RAYS = 1000000;
+float const BENCH_QUERY_RADIUS = 0.005; // fraction of scene diagonal
+float const VIEW_TOLER       = 1.0E-5; // relative to coordinate magnitude
 
 
-extern bool mt_cobj_tree_build, begin_motion;
+extern bool mt_cobj_tree_build, cobj_tree_sah_build, cobj_tree_benchmark, begin_motion;
 extern int display_mode, frame_counter, cobj_counter;
 extern coll_obj_group coll_objects;
 extern vector<unsigned> falling_cobjs;
@@ -94,6 +102,61 @@ bool cobj_tree_base::check_for_leaf(unsigned num, unsigned skip_dims) {
 }
 
 
+struct sah_bin_t {
+	cube_t bc;
+	unsigned count;
+
+	sah_bin_t() : count(0) {}
+	void add(cube_t const &c) {if (count++ == 0) {bc = c;} else {bc.union_with_cube(c);}}
+	void add(sah_bin_t const &b) {
+		if (b.count == 0) return;
+		if (count == 0) {bc = b.bc;} else {bc.union_with_cube(b.bc);}
+		count += b.count;
+	}
+};
+
+// binned surface area heuristic for the 3-way split used by these trees, where objects go before, after, or straddling the split plane;
+// straddling objects are assumed to cover the entire node; returns false if no split plane separates the objects
+template<typename F> bool find_sah_split(cube_t const &bcube, unsigned start, unsigned end, unsigned skip_dims, F const &get_bc, unsigned &dim, float &sval) {
+
+	unsigned const num(end - start);
+	sah_bin_t lo_bins[3][SAH_NUM_BINS], hi_bins[3][SAH_NUM_BINS]; // objects binned by their low/high edges
+	float scale[3];
+	UNROLL_3X(scale[i_] = (((skip_dims & (1 << i_)) || bcube.get_sz_dim(i_) <= 0.0) ? 0.0 : SAH_NUM_BINS/bcube.get_sz_dim(i_));)
+
+	for (unsigned i = start; i < end; ++i) {
+		cube_t const bc(get_bc(i));
+
+		for (unsigned d = 0; d < 3; ++d) {
+			if (scale[d] == 0.0) continue;
+			lo_bins[d][min(SAH_NUM_BINS-1, unsigned(max(0.0f, (bc.d[d][0] - bcube.d[d][0])*scale[d])))].add(bc);
+			hi_bins[d][min(SAH_NUM_BINS-1, unsigned(max(0.0f, (bc.d[d][1] - bcube.d[d][0])*scale[d])))].add(bc);
+		}
+	}
+	float const node_sa(cobj_tree_base::get_cube_sa(bcube));
+	float best_cost(FLT_MAX);
+
+	for (unsigned d = 0; d < 3; ++d) {
+		if (scale[d] == 0.0) continue;
+		sah_bin_t left[SAH_NUM_BINS], right[SAH_NUM_BINS]; // objects ending before / starting after plane p
+		for (unsigned p = 1; p < SAH_NUM_BINS; ++p) {left[p] = left[p-1]; left[p].add(hi_bins[d][p-1]);}
+		right[SAH_NUM_BINS-1] = lo_bins[d][SAH_NUM_BINS-1];
+		for (unsigned p = SAH_NUM_BINS-1; p > 1; --p) {right[p-1] = right[p]; right[p-1].add(lo_bins[d][p-1]);}
+
+		for (unsigned p = 1; p < SAH_NUM_BINS; ++p) {
+			unsigned const nl(left[p].count), nr(right[p].count), nm(num - nl - nr);
+			if (nl == num || nr == num || nm == num) continue; // no progress
+			float const cost((nl ? nl*cobj_tree_base::get_cube_sa(left[p].bc) : 0.0f) + (nr ? nr*cobj_tree_base::get_cube_sa(right[p].bc) : 0.0f) + nm*node_sa);
+			if (cost >= best_cost) continue;
+			best_cost = cost;
+			dim  = d;
+			sval = bcube.d[d][0] + p/scale[d];
+		}
+	}
+	return (best_cost < FLT_MAX);
+}
+
+
 // performance critical
 template<bool xneg, bool yneg, bool zneg> bool get_line_clip(point const &p1, vector3d const &dinv, float const d[3][2]) {
 
@@ -144,6 +207,57 @@ bool cobj_tree_base::node_ix_mgr::check_node(unsigned &nix) const {
 	return 1;
 }
 
+bool cobj_tree_base::quant_node_ix_mgr::check_node(unsigned &nix, unsigned &start, unsigned &end) const {
+
+	if (tree.qnodes.empty()) { // not quantized
+		tree_node const &n(nodes[nix]);
+		start = n.start; end = n.end;
+		return node_ix_mgr::check_node(nix);
+	}
+	quant_node_t const &n(tree.qnodes[nix]);
+	float d[3][2];
+	tree.get_quant_node_bounds(n, d);
+
+	if (!get_line_clip_func(p1, dinv, d)) {
+		assert(n.next_node_id > nix);
+		nix = n.next_node_id; // failed the bbox test
+		return 0;
+	}
+	start = n.start; end = n.end;
+	++nix;
+	return 1;
+}
+
+
+// must be called after any change to nodes
+void cobj_tree_base::build_quant_nodes() {
+
+	unsigned const QMAX = 65535;
+	qnodes.resize(nodes.size());
+	if (nodes.empty()) return;
+	cube_t const &root(nodes[0]);
+	qorigin = root.get_llc();
+
+	for (unsigned d = 0; d < 3; ++d) { // leave one step of margin at each end for float error
+		float const sz(root.get_sz_dim(d));
+		qstep[d] = ((sz > 0.0) ? sz/(QMAX - 2) : 0.0);
+		qorigin[d] -= qstep[d];
+	}
+	for (unsigned i = 0; i < nodes.size(); ++i) {
+		tree_node const &n(nodes[i]);
+		quant_node_t &qn(qnodes[i]);
+		qn.start = n.start; qn.end = n.end; qn.next_node_id = n.next_node_id;
+
+		for (unsigned d = 0; d < 3; ++d) {
+			if (qstep[d] == 0.0) {qn.q[d][0] = qn.q[d][1] = 1; continue;} // flat in this dim
+			// round outward, plus one step so that the dequantized value is conservative
+			float const lo(floor((n.d[d][0] - qorigin[d])/qstep[d]) - 1.0f), hi(ceil((n.d[d][1] - qorigin[d])/qstep[d]) + 1.0f);
+			qn.q[d][0] = (unsigned short)max(0.0f, min(float(QMAX), lo));
+			qn.q[d][1] = (unsigned short)max(0.0f, min(float(QMAX), hi));
+		}
+	}
+}
+
 
 // *** cobj_tree_simple_type_t ***
 
@@ -164,6 +278,10 @@ inline float get_vhi(sphere_t const &s, unsigned dim) {return (s.pos[dim] + s.ra
 inline float get_vlo(cube_t const &c,   unsigned dim) {return c.d[dim][0];}
 inline float get_vhi(cube_t const &c,   unsigned dim) {return c.d[dim][1];}
 
+inline cube_t get_obj_bcube(coll_tquad const &t) {return t.get_bcube();}
+inline cube_t get_obj_bcube(sphere_t   const &s) {cube_t c; c.set_from_sphere(s); return c;}
+inline cube_t get_obj_bcube(cube_t     const &c) {return c;}
+
 
 template<typename T> void cobj_tree_simple_type_t<T>::build_tree(unsigned nix, unsigned skip_dims, unsigned depth) {
 
@@ -176,7 +294,10 @@ template<typename T> void cobj_tree_simple_type_t<T>::build_tree(unsigned nix, u
 
 	// determine split dimension and value
 	float max_sz(0), sval(0);
-	unsigned const dim(n.get_split_dim(max_sz, sval, skip_dims));
+	unsigned dim(0);
+	auto get_bc([this](unsigned i) {return get_obj_bcube(objects[i]);});
+	if (cobj_tree_sah_build && find_sah_split(n, n.start, n.end, skip_dims, get_bc, dim, sval)) {max_sz = n.get_sz_dim(dim);}
+	else {dim = n.get_split_dim(max_sz, sval, skip_dims);}
 
 	if (max_sz == 0) { // can't split
 		register_leaf(num);
@@ -234,6 +355,7 @@ template<typename T> void cobj_tree_simple_type_t<T>::build_tree_top(bool verbos
 	if (!objects.empty()) {build_tree(0, 0, 0);}
 	nodes[0].next_node_id = (unsigned)nodes.size();
 	for (unsigned i = 0; i < 3; ++i) {vector<T>().swap(temp_bins[i]);}
+	build_quant_nodes();
 
 	if (verbose) {
 		cout << "objects: " << objects.size() << ", cap: " << objects.capacity() << ", nodes: " << nodes.size() << ", cap: " << nodes.capacity()
@@ -292,14 +414,13 @@ bool cobj_tree_tquads_t::check_coll_line(point const &p1, point const &p2, point
 	if (nodes.empty()) return 0;
 	bool ret(0);
 	float t(0.0), tmin(0.0), tmax(1.0);
-	node_ix_mgr nixm(nodes, p1, p2);
+	quant_node_ix_mgr nixm(*this, p1, p2);
 	unsigned const num_nodes((unsigned)nodes.size());
 
-	for (unsigned nix = 0; nix < num_nodes;) {
-		tree_node const &n(nodes[nix]);
-		if (!nixm.check_node(nix)) continue; // Note: modifies nix
+	for (unsigned nix = 0, start = 0, end = 0; nix < num_nodes;) {
+		if (!nixm.check_node(nix, start, end)) continue; // Note: modifies nix
 
-		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
+		for (unsigned i = start; i < end; ++i) { // check leaves
 			// Note: we test cobj against the original (unclipped) p1 and p2 so that t is correct
 			// Note: we probably don't need to return cnorm and cpos in inexact mode, but it shouldn't be too expensive to do so
 			if (ignore_cobj >= 0 && (int)objects[i].cid == ignore_cobj)   continue;
@@ -346,7 +467,7 @@ void cobj_tree_sphere_t::get_ids_int_sphere(point const &center, float radius, v
 	unsigned const num_nodes((unsigned)nodes.size());
 
 	for (unsigned nix = 0; nix < num_nodes;) {
-		tree_node const &n(nodes[nix]);
+		tree_node const n(get_traversal_node(nix));
 		assert(n.start <= n.end);
 
 		if (!sphere_cube_intersect(center, radius, n)) {
@@ -396,6 +517,10 @@ void cobj_bvh_tree::clear() {
 
 	cobj_tree_base::clear();
 	cixs.resize(0);
+	sorted_cids.resize(0);
+	build_sa.resize(0);
+	views.clear();
+	can_refit = 0;
 }
 
 
@@ -432,6 +557,121 @@ void cobj_bvh_tree::build_tree_from_cixs(bool do_mt_build) {
 		nodes.resize(ptd.get_next_node_ix());
 	}
 	nodes[root].next_node_id = (unsigned)nodes.size();
+	can_refit = !do_mt_build; // the MT build leaves gaps of unused nodes that can't be refit
+	update_views();
+	build_quant_nodes();
+}
+
+
+// *** cobj_bvh_tree refit ***
+
+// nodes are stored in depth first order: node nix has its kids in [nix+1, next_node_id), where each kid is followed by its next sibling at kid.next_node_id
+
+void cobj_bvh_tree::init_build_sa() {
+
+	build_sa.resize(nodes.size());
+	for (unsigned i = 0; i < nodes.size(); ++i) {build_sa[i] = get_cube_sa(nodes[i]);}
+}
+
+
+// must be called after any change to the order of cixs or to the bcubes of the cobjs they refer to
+void cobj_bvh_tree::update_views() {
+
+	views.clear();
+	views.reserve(cixs.size());
+
+	for (unsigned i = 0; i < cixs.size(); ++i) {
+		views.emplace_back(get_cobj(i));
+		cobj_view_t &v(views.back());
+		v.expand_by(VIEW_TOLER*(1.0 + v.get_max_extent())); // views are only used for rejection, so they must be conservative; also gives flat cobjs nonzero thickness
+	}
+}
+
+
+void cobj_bvh_tree::refit_node_bboxes() { // bottom up, so kids are always processed before their parents
+
+	for (unsigned nix = (unsigned)nodes.size(); nix-- > 0;) {
+		tree_node &n(nodes[nix]);
+		if (n.start < n.end) {calc_node_bbox(n); continue;} // leaf
+		assert(nix+1 < n.next_node_id); // branch must have at least one kid
+		n.copy_from(nodes[nix+1]);
+		for (unsigned kid = nodes[nix+1].next_node_id; kid < n.next_node_id; kid = nodes[kid].next_node_id) {n.union_with_cube(nodes[kid]);}
+	}
+}
+
+
+unsigned cobj_bvh_tree::rebuild_subtree(unsigned nix) { // returns the new next_node_id of nix
+
+	assert(nix < nodes.size());
+	unsigned const old_end(nodes[nix].next_node_id);
+	unsigned start(nodes.size()), end(0);
+
+	for (unsigned i = nix; i < old_end; ++i) { // find the range of leaves, which is contiguous within a subtree
+		if (nodes[i].start == nodes[i].end) continue; // not a leaf
+		start = min(start, nodes[i].start);
+		end   = max(end,   nodes[i].end);
+	}
+	assert(start < end);
+	vector<tree_node> tail(nodes.begin()+old_end, nodes.end());
+	nodes.resize(nix + get_conservative_num_nodes(end - start));
+	nodes[nix] = tree_node(start, end);
+	per_thread_data ptd(nix+1, nodes.size(), 1);
+	build_tree(nix, 0, 0, ptd);
+	unsigned const new_end(ptd.get_next_node_ix());
+	int const delta(int(new_end) - int(old_end));
+	nodes.resize(new_end);
+	nodes[nix].next_node_id = new_end;
+
+	for (unsigned i = 0; i < nix; ++i) { // update ancestors, which are the only earlier nodes that skip past this subtree
+		if (nodes[i].next_node_id >= old_end) {nodes[i].next_node_id += delta;}
+	}
+	for (auto i = tail.begin(); i != tail.end(); ++i) {i->next_node_id += delta;}
+	copy(tail.begin(), tail.end(), back_inserter(nodes));
+	vector<float> sa_tail(build_sa.begin()+old_end, build_sa.end());
+	build_sa.resize(new_end);
+	for (unsigned i = nix; i < new_end; ++i) {build_sa[i] = get_cube_sa(nodes[i]);}
+	copy(sa_tail.begin(), sa_tail.end(), back_inserter(build_sa));
+	assert(build_sa.size() == nodes.size());
+	return new_end;
+}
+
+
+unsigned cobj_bvh_tree::rebuild_poor_subtrees() { // top down, returns the number of subtrees rebuilt
+
+	unsigned num_rebuilt(0);
+
+	for (unsigned nix = 0; nix < nodes.size();) {
+		tree_node const &n(nodes[nix]);
+		if (n.start < n.end) {++nix; continue;} // leaf, nothing to rebuild
+		bool const poor(get_cube_sa(n) > REFIT_MAX_SA_GROW*build_sa[nix]);
+		if (!poor || n.next_node_id - nix < REFIT_MIN_REBUILD_NODES) {++nix; continue;} // good enough, or too small to matter
+		nix = rebuild_subtree(nix);
+		++num_rebuilt;
+	}
+	return num_rebuilt;
+}
+
+
+// for trees built from a small set of moving cobjs: if the set of cobjs is unchanged, refit the node bboxes
+// to the new cobj positions and only rebuild subtrees whose quality has degraded; otherwise, do a full rebuild
+void cobj_bvh_tree::refit_or_rebuild(vector<unsigned> const &cids) {
+
+	if (cids.empty()) {clear(); return;}
+	vector<unsigned> sorted(cids);
+	sort(sorted.begin(), sorted.end());
+
+	if (!can_refit || sorted != sorted_cids) { // cobjs were added or removed, or not built yet
+		clear();
+		add_cobj_ids(cids);
+		build_tree_from_cixs(0);
+		sorted_cids.swap(sorted);
+		init_build_sa();
+		return;
+	}
+	refit_node_bboxes();
+	rebuild_poor_subtrees();
+	update_views();
+	build_quant_nodes();
 }
 
 
@@ -442,17 +682,17 @@ bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpo
 	if (nodes.empty()) return 0;
 	bool ret(0);
 	float t(0.0), tmin(0.0), tmax(1.0), max_alpha(0.0);
-	node_ix_mgr nixm(nodes, p1, p2);
+	quant_node_ix_mgr nixm(*this, p1, p2);
 	unsigned const num_nodes((unsigned)nodes.size());
 
-	for (unsigned nix = 0; nix < num_nodes;) {
-		tree_node const &n(nodes[nix]);
-		if (!nixm.check_node(nix)) continue; // Note: modifies nix
+	for (unsigned nix = 0, start = 0, end = 0; nix < num_nodes;) {
+		if (!nixm.check_node(nix, start, end)) continue; // Note: modifies nix
 
-		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
+		for (unsigned i = start; i < end; ++i) { // check leaves
 			// Note: we test cobj against the original (unclipped) p1 and p2 so that t is correct
 			// Note: we probably don't need to return cnorm and cpos in inexact mode, but it shouldn't be too expensive to do so
 			if ((int)cixs[i] == ignore_cobj) continue;
+			if (view_rejects_line(i, nixm))  continue; // cheap bcube test before touching the cobj
 			coll_obj const &c(get_cobj(i));
 			if (!obj_ok(c))                  continue;
 			if (skip_non_drawn  && !c.cp.might_be_drawn())                    continue;
@@ -477,6 +717,93 @@ bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpo
 }
 
 
+// SSE slab test of one node bcube against all rays of a packet; performance critical
+class packet_line_clipper_t {
+	__m128 px, py, pz, dx, dy, dz, tmax;
+	unsigned valid_mask;
+public:
+	packet_line_clipper_t(cobj_ray_packet_t const &rp) {
+		float v[6][RAY_PACKET_SIZE] = {}, t[RAY_PACKET_SIZE] = {};
+
+		for (unsigned r = 0; r < rp.num_rays; ++r) {
+			vector3d dinv(rp.p2[r] - rp.p1[r]);
+			dinv.invert();
+			UNROLL_3X(v[i_][r] = rp.p1[r][i_]; v[i_+3][r] = dinv[i_];)
+			t[r] = 1.0;
+		}
+		px = _mm_loadu_ps(v[0]); py = _mm_loadu_ps(v[1]); pz = _mm_loadu_ps(v[2]);
+		dx = _mm_loadu_ps(v[3]); dy = _mm_loadu_ps(v[4]); dz = _mm_loadu_ps(v[5]);
+		tmax = _mm_loadu_ps(t); // unused lanes have tmax=0 and never pass
+		valid_mask = ((1U << rp.num_rays) - 1);
+	}
+	float get_tmax(unsigned r) const {
+		float t[RAY_PACKET_SIZE];
+		_mm_storeu_ps(t, tmax);
+		return t[r];
+	}
+	void set_tmax(unsigned r, float t) { // shorten a ray after a hit
+		float v[RAY_PACKET_SIZE];
+		_mm_storeu_ps(v, tmax);
+		v[r] = t;
+		tmax = _mm_loadu_ps(v);
+	}
+	unsigned get_hit_mask(float const d[3][2]) const { // returns a bit for each ray that intersects the cube
+		__m128 tn(_mm_setzero_ps()), tf(tmax);
+		__m128 t1(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(d[0][0]), px), dx)), t2(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(d[0][1]), px), dx));
+		tn = _mm_max_ps(tn, _mm_min_ps(t1, t2)); tf = _mm_min_ps(tf, _mm_max_ps(t1, t2));
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(d[1][0]), py), dy); t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(d[1][1]), py), dy);
+		tn = _mm_max_ps(tn, _mm_min_ps(t1, t2)); tf = _mm_min_ps(tf, _mm_max_ps(t1, t2));
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(d[2][0]), pz), dz); t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(d[2][1]), pz), dz);
+		tn = _mm_max_ps(tn, _mm_min_ps(t1, t2)); tf = _mm_min_ps(tf, _mm_max_ps(t1, t2));
+		return (unsigned(_mm_movemask_ps(_mm_cmplt_ps(tn, tf))) & valid_mask);
+	}
+};
+
+// finds the closest hit for each ray in the packet, same as check_coll_line() with exact=1 and test_alpha=0;
+// only updates cpos/cnorm/cindex of rays that hit something closer than their current p2
+void cobj_bvh_tree::check_coll_line_exact_packet(cobj_ray_packet_t &rp) const {
+
+	if (nodes.empty() || rp.empty()) return;
+	assert(rp.num_rays <= RAY_PACKET_SIZE);
+	packet_line_clipper_t clipper(rp);
+	unsigned const num_nodes((unsigned)nodes.size());
+	float t(0.0);
+	vector3d cnorm;
+
+	for (unsigned nix = 0; nix < num_nodes;) {
+		tree_node const &n(nodes[nix]);
+		unsigned const mask(clipper.get_hit_mask(n.d));
+
+		if (mask == 0) { // no rays hit the bbox
+			assert(n.next_node_id > nix);
+			nix = n.next_node_id;
+			continue;
+		}
+		++nix;
+
+		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
+			unsigned cmask(mask);
+			if (!views.empty() && !views[i].may_move) {cmask &= clipper.get_hit_mask(views[i].d);} // test the cobj bcube against all rays at once
+			if (cmask == 0) continue;
+			coll_obj const &c(get_cobj(i));
+			if (!obj_ok(c)) continue;
+
+			for (unsigned r = 0; r < rp.num_rays; ++r) {
+				if (!(cmask & (1U << r)))          continue; // this ray missed the node or cobj bcube
+				if ((int)cixs[i] == rp.ignore_cobj[r]) continue;
+				point const &p1(rp.p1[r]);
+				if (rp.skip_init_colls[r] && c.contains_pt(p1) && c.contains_point(p1)) continue;
+				if (!c.line_int_exact(p1, rp.p2[r], t, cnorm, 0.0, clipper.get_tmax(r))) continue;
+				rp.cindex[r] = cixs[i];
+				rp.cnorm [r] = cnorm;
+				rp.cpos  [r] = p1 + (rp.p2[r] - p1)*t;
+				clipper.set_tmax(r, t);
+			}
+		}
+	}
+}
+
+
 bool cobj_bvh_tree::check_point_contained(point const &p, int &cindex) const {
 
 	unsigned const num_nodes((unsigned)nodes.size());
@@ -490,6 +817,7 @@ bool cobj_bvh_tree::check_point_contained(point const &p, int &cindex) const {
 			continue;
 		}
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
+			if (!views.empty() && !views[i].may_move && !views[i].contains_pt(p)) continue;
 			coll_obj const &c(get_cobj(i));
 			if (c.contains_point(p) && obj_ok(c)) {cindex = cixs[i]; return 1;}
 		}
@@ -514,7 +842,8 @@ void cobj_bvh_tree::get_intersecting_cobjs(cube_t const &cube, vector<unsigned>
 			continue;
 		}
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
-			if ((int)cixs[i] == ignore_cobj) continue;
+			if ((int)cixs[i] == ignore_cobj)     continue;
+			if (view_rejects_cube(i, cube, toler)) continue;
 			coll_obj const &c(get_cobj(i));
 			if (check_ccounter && c.counter == cobj_counter) continue;
 			if (!cube.intersects(c, toler) || !obj_ok(c))    continue;
@@ -530,14 +859,13 @@ bool cobj_bvh_tree::is_cobj_contained(point const &viewer, point const *const pt
 
 	assert(npts > 0);
 	if (nodes.empty()) return 0;
-	node_ix_mgr nixm(nodes, viewer, pts[0]);
+	quant_node_ix_mgr nixm(*this, viewer, pts[0]);
 	unsigned const num_nodes((unsigned)nodes.size());
 
-	for (unsigned nix = 0; nix < num_nodes;) {
-		tree_node const &n(nodes[nix]);
-		if (!nixm.check_node(nix)) continue; // Note: modifies nix
+	for (unsigned nix = 0, start = 0, end = 0; nix < num_nodes;) {
+		if (!nixm.check_node(nix, start, end)) continue; // Note: modifies nix
 
-		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
+		for (unsigned i = start; i < end; ++i) { // check leaves
 			if ((int)cixs[i] == ignore_cobj) continue;
 			coll_obj const &c(get_cobj(i));
 				
@@ -555,14 +883,13 @@ void cobj_bvh_tree::get_coll_line_cobjs(point const &pos1, point const &pos2, in
 
 	assert(cobjs || cqc);
 	if (nodes.empty()) return;
-	node_ix_mgr nixm(nodes, pos1, pos2);
+	quant_node_ix_mgr nixm(*this, pos1, pos2);
 	unsigned const num_nodes((unsigned)nodes.size());
 
-	for (unsigned nix = 0; nix < num_nodes;) {
-		tree_node const &n(nodes[nix]);
-		if (!nixm.check_node(nix)) continue; // Note: modifies nix
+	for (unsigned nix = 0, start = 0, end = 0; nix < num_nodes;) {
+		if (!nixm.check_node(nix, start, end)) continue; // Note: modifies nix
 			
-		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
+		for (unsigned i = start; i < end; ++i) { // check leaves
 			if ((int)cixs[i] == ignore_cobj) continue;
 			coll_obj const &c(get_cobj(i));
 			if (!obj_ok(c)) continue;
@@ -603,7 +930,7 @@ void cobj_bvh_tree::get_coll_sphere_cobjs(point const &center, float radius, int
 		++nix;
 		
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
-			if ((int)cixs[i] != ignore_cobj && get_cobj(i).intersects(bcube)) vcd.check_cobj(cixs[i]);
+			if ((int)cixs[i] != ignore_cobj && !view_rejects_cube(i, bcube) && get_cobj(i).intersects(bcube)) vcd.check_cobj(cixs[i]);
 		}
 	}
 }
@@ -686,7 +1013,10 @@ void cobj_bvh_tree::build_tree(unsigned nix, unsigned skip_dims, unsigned depth,
 	
 	// determine split dimension and value
 	float max_sz(0), sval(0);
-	unsigned const dim(n.get_split_dim(max_sz, sval, skip_dims));
+	unsigned dim(0);
+	auto get_bc([this](unsigned i) {return cube_t(get_cobj(i));});
+	if (cobj_tree_sah_build && find_sah_split(n, n.start, n.end, skip_dims, get_bc, dim, sval)) {max_sz = n.get_sz_dim(dim);}
+	else {dim = n.get_split_dim(max_sz, sval, skip_dims);}
 
 	if (max_sz == 0) { // can't split
 		register_leaf(num);
@@ -764,7 +1094,6 @@ cobj_bvh_tree &get_tree(bool dynamic) {
 
 void build_static_moving_cobj_tree() {
 
-	cobj_tree_static_moving.clear();
 	vector<unsigned> moving_cids(falling_cobjs);
 		
 	for (auto i = moving_cobjs.begin(); i != moving_cobjs.end(); ++i) {
@@ -773,16 +1102,83 @@ void build_static_moving_cobj_tree() {
 	for (platform_cont::const_iterator i = platforms.begin(); i != platforms.end(); ++i) {
 		copy(i->cobjs.begin(), i->cobjs.end(), back_inserter(moving_cids));
 	}
-	if (!moving_cids.empty()) {
-		cobj_tree_static_moving.add_cobj_ids(moving_cids);
-		cobj_tree_static_moving.build_tree_from_cixs(0);
+	cobj_tree_static_moving.refit_or_rebuild(moving_cids); // usually only refits, since the same cobjs tend to move each frame
+}
+
+// compares build time and line/cube query throughput of the median split and SAH builders on the current static cobjs,
+// with and without the compact cobj views
+void benchmark_cobj_tree_builders() {
+
+	cube_t scene_bc;
+	if (!get_tree(0).get_root_bcube(scene_bc)) return; // no static cobjs
+	vector<pair<point, point>> rays(BENCH_NUM_RAYS);
+	rand_gen_t rgen;
+	for (auto i = rays.begin(); i != rays.end(); ++i) {*i = make_pair(rgen.gen_rand_cube_point(scene_bc), rgen.gen_rand_cube_point(scene_bc));}
+	float const query_radius(BENCH_QUERY_RADIUS*p2p_dist(scene_bc.get_llc(), scene_bc.get_urc()));
+	bool const prev_sah_build(cobj_tree_sah_build);
+
+	for (unsigned sah = 0; sah < 2; ++sah) {
+		cobj_tree_sah_build = (sah != 0);
+		cobj_bvh_tree tree(&coll_objects, 1, 0, 0, 0, 0);
+		int const build_start(GET_TIME_MS());
+		tree.add_cobjs(0);
+		int const build_time(GET_TIME_MS() - build_start);
+		cout << (sah ? "SAH" : "Median") << " cobj tree: cobjs: " << tree.get_num_objs() << ", nodes: " << tree.get_num_nodes()
+			 << ", node mem: " << tree.get_nodes_mem()/1024 << "KB, build: " << build_time << "ms" << endl;
+
+		for (unsigned pass = 0; pass < 3; ++pass) { // views and quantized nodes first, since clearing them can't be undone
+			bool const use_views(pass == 0), use_qnodes(pass < 2);
+			if (pass == 1) {tree.clear_views();}
+			if (pass == 2) {tree.clear_quant_nodes();}
+			int const line_start(GET_TIME_MS());
+			unsigned num_hits(0), num_cands(0), num_sphere_colls(0);
+
+#pragma omp parallel for schedule(dynamic,1024) reduction(+:num_hits)
+			for (int i = 0; i < (int)rays.size(); ++i) {
+				point cpos;
+				vector3d cnorm;
+				int cindex(-1);
+				num_hits += tree.check_coll_line(rays[i].first, rays[i].second, cpos, cnorm, cindex, -1, 1, 0, 0, 0, 0);
+			}
+			int const cube_start(GET_TIME_MS());
+
+#pragma omp parallel reduction(+:num_cands)
+			{
+				vector<unsigned> cands;
+
+#pragma omp for schedule(dynamic,1024)
+				for (int i = 0; i < (int)rays.size(); ++i) {
+					cube_t cube(rays[i].first, rays[i].first);
+					cube.expand_by(query_radius);
+					cands.clear();
+					tree.get_intersecting_cobjs(cube, cands, -1, 0.0, 0, -1);
+					num_cands += cands.size();
+				}
+			}
+			int const sphere_start(GET_TIME_MS());
+
+			// the same sphere query path used for object physics; rain is used because it's the most common case,
+			// and because its collisions have no side effects outside of the temp object
+#pragma omp parallel for schedule(dynamic,1024) reduction(+:num_sphere_colls)
+			for (int i = 0; i < (int)rays.size(); ++i) {
+				dwobject obj(RAIN, rays[i].first);
+				vert_coll_detector vcd(obj, -1, 0, 0, NULL);
+				num_sphere_colls += (vcd.check_coll_tree(tree) != 0);
+			}
+			int const line_time(max(1, (cube_start - line_start))), cube_time(max(1, (sphere_start - cube_start))), sphere_time(max(1, (GET_TIME_MS() - sphere_start)));
+			cout << "  views: " << use_views << ", quant nodes: " << use_qnodes << ", rays: " << rays.size() << ", hits: " << num_hits << ", line query: " << line_time << "ms ("
+				 << 0.001f*rays.size()/line_time << " Mrays/s), cube query cands: " << num_cands << ", cube query: " << cube_time << "ms"
+				 << ", sphere query colls: " << num_sphere_colls << ", sphere query: " << sphere_time << "ms" << endl;
+		}
 	}
+	cobj_tree_sah_build = prev_sah_build;
 }
 
 void build_cobj_tree(bool dynamic, bool verbose) {
 	
 	if (!dynamic) { // static
 		get_tree(0).add_cobjs(verbose);
+		if (cobj_tree_benchmark) {benchmark_cobj_tree_builders();}
 		cobj_tree_occlude.add_cobjs(verbose);
 		//cout << "occluders: " << cobj_tree_occlude.get_num_objs() << endl;
 		//cobj_tree_triangles.add_cobjs(coll_objects, verbose);
@@ -805,6 +1201,21 @@ bool check_coll_line_exact_tree(point const &p1, point const &p2, point &cpos, v
 	return ret;
 }
 
+// packet version of check_coll_line_exact_tree() for static cobjs with test_alpha=0, skip_non_drawn=0, and skip_movable=0; used for coherent lighting rays
+void check_coll_line_exact_tree_packet(cobj_ray_packet_t &rp, bool include_voxels, bool no_stat_moving) {
+
+	get_tree(0).check_coll_line_exact_packet(rp);
+
+	for (unsigned r = 0; r < rp.num_rays; ++r) { // these trees are small or not BVHs, so use the single ray query
+		int cindex(-1);
+		// Note: cpos starts at p2 and is moved to the closest hit point, so we make a copy to use as the end point
+		if (!no_stat_moving && cobj_tree_static_moving.check_coll_line(rp.p1[r], point(rp.cpos[r]), rp.cpos[r], rp.cnorm[r], cindex, rp.ignore_cobj[r], 1, 0, 0, rp.skip_init_colls[r], 0)) {
+			rp.cindex[r] = cindex;
+		}
+		if (include_voxels && check_voxel_coll_line(rp.p1[r], point(rp.cpos[r]), rp.cpos[r], rp.cnorm[r], cindex, rp.ignore_cobj[r], 1)) {rp.cindex[r] = cindex;}
+	}
+}
+
 // can use with snow shadows, grass shadows, tree leaf shadows
 bool check_coll_line_tree(point const &p1, point const &p2, int &cindex, int ignore_cobj, bool dynamic,
 	int test_alpha, bool skip_non_drawn, bool include_voxels, bool skip_init_colls, bool skip_movable)
@@ -19,7 +19,17 @@ protected:
 		tree_node(unsigned s, unsigned e, cube_t const &cube) : cube_t(cube), start(s), end(e), next_node_id(0) {}
 	};
 
+	// compact copy of a node used for line query traversal; the bcube is quantized to 16 bits per value relative to the root bcube,
+	// rounded outward so that it always contains the original bcube
+	struct quant_node_t { // size = 24
+		unsigned short q[3][2];
+		unsigned start, end, next_node_id;
+	};
+
 	vector<tree_node> nodes;
+	vector<quant_node_t> qnodes; // parallel to nodes; empty if disabled
+	point qorigin;
+	vector3d qstep;
 	unsigned max_depth, max_leaf_count, num_leaf_nodes;
 
 	inline void register_leaf(unsigned num) {
@@ -28,6 +38,19 @@ protected:
 	}
 	bool check_for_leaf(unsigned num, unsigned skip_dims);
 	unsigned get_conservative_num_nodes(unsigned num) const {return (3*num/2 + 8);}
+	void build_quant_nodes();
+
+	void get_quant_node_bounds(quant_node_t const &n, float d[3][2]) const {
+		UNROLL_3X(d[i_][0] = qorigin[i_] + qstep[i_]*n.q[i_][0]; d[i_][1] = qorigin[i_] + qstep[i_]*n.q[i_][1];)
+	}
+	tree_node get_traversal_node(unsigned nix) const { // dequantized from qnodes if available
+		if (qnodes.empty()) {return nodes[nix];}
+		quant_node_t const &qn(qnodes[nix]);
+		tree_node n(qn.start, qn.end);
+		n.next_node_id = qn.next_node_id;
+		get_quant_node_bounds(qn, n.d);
+		return n;
+	}
 
 	struct node_ix_mgr {
 		point const p1, p2;
@@ -39,11 +62,21 @@ protected:
 		bool (* get_line_clip_func) (point const &p1, vector3d const &dinv, float const d[3][2]); // function pointer
 	};
 
+	struct quant_node_ix_mgr : public node_ix_mgr { // uses qnodes if available, otherwise nodes
+		cobj_tree_base const &tree;
+
+		quant_node_ix_mgr(cobj_tree_base const &tree_, point const &p1_, point const &p2_) : node_ix_mgr(tree_.nodes, p1_, p2_), tree(tree_) {}
+		bool check_node(unsigned &nix, unsigned &start, unsigned &end) const; // returns the leaf range of the node in [start, end)
+	};
+
 public:
 	cobj_tree_base() : max_depth(0), max_leaf_count(0), num_leaf_nodes(0) {}
 	bool is_empty() const {return nodes.empty();}
-	void clear() {nodes.resize(0);}
+	void clear() {nodes.resize(0); qnodes.resize(0);}
+	void clear_quant_nodes() {qnodes.clear();} // for benchmarking
+	unsigned get_nodes_mem() const {return (nodes.size()*sizeof(tree_node) + qnodes.size()*sizeof(quant_node_t));}
 	bool get_root_bcube(cube_t &bc) const;
+	static float get_cube_sa(cube_t const &c) {return (c.dx()*c.dy() + c.dy()*c.dz() + c.dz()*c.dx());} // half the surface area
 };
 
 
@@ -104,11 +137,46 @@ public:
 };
 
 
+unsigned const RAY_PACKET_SIZE = 4; // SSE width
+
+struct cobj_ray_packet_t { // group of coherent rays traced together through the BVH, used for lighting
+	point p1[RAY_PACKET_SIZE], p2[RAY_PACKET_SIZE], cpos[RAY_PACKET_SIZE];
+	vector3d cnorm[RAY_PACKET_SIZE];
+	int cindex[RAY_PACKET_SIZE], ignore_cobj[RAY_PACKET_SIZE];
+	bool skip_init_colls[RAY_PACKET_SIZE];
+	unsigned num_rays;
+
+	cobj_ray_packet_t() : num_rays(0) {}
+	bool empty  () const {return (num_rays == 0);}
+	bool is_full() const {return (num_rays == RAY_PACKET_SIZE);}
+	void clear() {num_rays = 0;}
+
+	unsigned add_ray(point const &p1_, point const &p2_, int ignore_cobj_, bool skip_init_colls_) {
+		assert(!is_full());
+		p1[num_rays] = p1_; p2[num_rays] = cpos[num_rays] = p2_;
+		cnorm[num_rays] = zero_vector;
+		cindex[num_rays] = -1;
+		ignore_cobj[num_rays] = ignore_cobj_;
+		skip_init_colls[num_rays] = skip_init_colls_;
+		return num_rays++;
+	}
+};
+
+
 class cobj_bvh_tree : public cobj_tree_base {
 
+	// compact, slightly expanded copy of the bcube of a leaf cobj used for rejection tests, so that traversal doesn't touch the much larger coll_obj
+	struct cobj_view_t : public cube_t { // size = 28
+		bool may_move; // bcube can change without a tree update, so it can't be used to reject this cobj
+
+		cobj_view_t(coll_obj const &c) : cube_t(c), may_move(c.may_be_dynamic()) {}
+	};
+
 	coll_obj_group const *cobjs;
-	vector<unsigned> cixs;
-	bool is_static, is_dynamic, occluders_only, cubes_only, inc_voxel_cobjs;
+	vector<unsigned> cixs, sorted_cids; // sorted_cids is used to detect when a refit is possible
+	vector<cobj_view_t> views; // parallel to cixs, rebuilt whenever cixs or the node bboxes change; empty if disabled
+	vector<float> build_sa; // surface area of each node when it was last built, for refit quality checks
+	bool is_static, is_dynamic, occluders_only, cubes_only, inc_voxel_cobjs, can_refit;
 
 	struct per_thread_data {
 		vector<unsigned> temp_bins[3];
@@ -128,7 +196,18 @@ class cobj_bvh_tree : public cobj_tree_base {
 	void calc_node_bbox(tree_node &n) const;
 	void build_tree_top_level_omp();
 	void build_tree(unsigned nix, unsigned skip_dims, unsigned depth, per_thread_data &ptd);
-
+	void init_build_sa();
+	void update_views();
+	void refit_node_bboxes();
+	unsigned rebuild_subtree(unsigned nix);
+	unsigned rebuild_poor_subtrees();
+
+	bool view_rejects_line(unsigned i, node_ix_mgr const &nixm) const {
+		return (!views.empty() && !views[i].may_move && !nixm.get_line_clip_func(nixm.p1, nixm.dinv, views[i].d));
+	}
+	bool view_rejects_cube(unsigned i, cube_t const &cube, float toler=0.0) const {
+		return (!views.empty() && !views[i].may_move && !cube.intersects(views[i], toler));
+	}
 	bool obj_ok(coll_obj const &c) const {
 		return (((is_static && c.status == COLL_STATIC) || (is_dynamic && c.status == COLL_DYNAMIC) || (!is_static && !is_dynamic)) &&
 			(!occluders_only || c.is_occluder()) && !(c.cp.flags & COBJ_NO_COLL) && (!cubes_only || c.type == COLL_CUBE) &&
@@ -137,15 +216,19 @@ class cobj_bvh_tree : public cobj_tree_base {
 
 public:
 	cobj_bvh_tree(coll_obj_group const *cobjs_, bool s, bool d, bool o, bool c, bool v)
-		: cobjs(cobjs_), is_static(s), is_dynamic(d), occluders_only(o), cubes_only(c), inc_voxel_cobjs(v) {assert(cobjs);}
+		: cobjs(cobjs_), is_static(s), is_dynamic(d), occluders_only(o), cubes_only(c), inc_voxel_cobjs(v), can_refit(0) {assert(cobjs);}
 
 	unsigned get_num_objs() const {return cixs.size();}
+	unsigned get_num_nodes() const {return nodes.size();}
 	void clear();
 	void add_cobj_ids(vector<unsigned> const &cids) {assert(cixs.empty() && !cids.empty()); cixs = cids;}
+	void clear_views() {views.clear();} // for benchmarking
 	void add_cobjs(bool verbose);
 	void build_tree_from_cixs(bool do_mt_build);
+	void refit_or_rebuild(vector<unsigned> const &cids);
 	bool check_coll_line(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
 		bool exact, int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const;
+	void check_coll_line_exact_packet(cobj_ray_packet_t &rp) const;
 	bool check_point_contained(point const &p, int &cindex) const;
 	void get_intersecting_cobjs(cube_t const &cube, vector<unsigned> &cobjs, int ignore_cobj, float toler, bool check_ccounter, int id_for_cobj_int) const;
 	bool is_cobj_contained(point const &viewer, point const *const pts, unsigned npts, int ignore_cobj, int &cobj) const;
@@ -135,9 +135,9 @@ class cobj_manager_t {
 	}
 
 public:
-	unsigned cobjs_removed;
+	unsigned cobjs_removed, change_count; // change_count is incremented on every cobj add and remove
 
-	cobj_manager_t(coll_obj_group &cobjs_) : cobjs(cobjs_), index_top(0), cobjs_removed(0) {
+	cobj_manager_t(coll_obj_group &cobjs_) : cobjs(cobjs_), index_top(0), cobjs_removed(0), change_count(0) {
 		extend_index_stack(0, cobjs.size());
 	}
 
@@ -159,6 +159,7 @@ public:
 		assert(cobjs[index].status == COLL_UNUSED);
 		cobjs[index].status = COLL_PENDING;
 		index_stack[index_top++] = -1;
+		++change_count;
 		return index;
 	}
 
@@ -713,6 +714,9 @@ void add_coll_point(int i, int j, int index, float zminv, float zmaxv, int add_t
 }
 
 
+unsigned get_cobj_change_count() {return cobj_manager.change_count;}
+
+
 int remove_coll_object(int index, bool reset_draw) {
 
 	if (index < 0) return 0;
@@ -723,6 +727,7 @@ int remove_coll_object(int index, bool reset_draw) {
 		return 0;
 	}
 	if (c.status == COLL_FREED) return 0;
+	++cobj_manager.change_count;
 	coll_objects.remove_index_from_ids(index);
 	if (reset_draw) {c.cp.draw = 0;}
 	c.status   = COLL_FREED;
@@ -1569,13 +1574,19 @@ void vert_coll_detector::init_reset_pos() {
 }
 
 
-int vert_coll_detector::check_coll() {
+void vert_coll_detector::init_check_coll() {
 
 	pold -= obj.velocity*tstep;
 	assert(!is_nan(pold));
 	assert(type >= 0 && type < NUM_TOT_OBJS);
 	o_radius = obj.get_true_radius();
 	init_reset_pos();
+}
+
+
+int vert_coll_detector::check_coll() {
+
+	init_check_coll();
 
 	if (only_cobj >= 0) {
 		assert((unsigned)only_cobj < coll_objects.size());
@@ -1589,6 +1600,14 @@ int vert_coll_detector::check_coll() {
 }
 
 
+int vert_coll_detector::check_coll_tree(cobj_bvh_tree const &tree) { // same as check_coll(), but only tests the cobjs in tree
+
+	init_check_coll();
+	tree.get_coll_sphere_cobjs(obj.pos, o_radius, -1, *this);
+	return coll;
+}
+
+
 // ************ end vert_coll_detector ************
 
 
@@ -5,12 +5,76 @@
 #include "3DWorld.h"
 #include "mesh.h"
 #include <cfloat> // for FLT_EPSILON
+#include <climits> // for UINT_MAX
 
 
+unsigned const EROSION_BATCH_SIZE = 1024; // droplets per batch; must not depend on the number of threads
+unsigned const EROSION_MERGE_BANDS = 64; // horizontal bands merged in parallel
+
 extern float erode_amount, water_plane_z;
 
 
+typedef pair<unsigned, float> hmap_delta_t; // {index, delta height}
+
+class erosion_overlay_t { // sparse height deltas written by one droplet, stored in an open addressing hash table
+
+	vector<unsigned> keys, used; // used holds the filled slots
+	vector<float> vals;
+	unsigned mask;
+
+	unsigned find_slot(unsigned ix) const {
+		for (unsigned slot = ((ix*2654435761U) & mask); ; slot = ((slot + 1) & mask)) {
+			if (keys[slot] == ix || keys[slot] == UINT_MAX) return slot;
+		}
+	}
+	void alloc(unsigned sz) {
+		assert((sz & (sz-1)) == 0); // must be a power of 2
+		keys.clear();
+		keys.resize(sz, UINT_MAX);
+		vals.resize(sz);
+		used.clear();
+		mask = sz - 1;
+	}
+	void grow() {
+		vector<hmap_delta_t> entries;
+		for (auto i = used.begin(); i != used.end(); ++i) {entries.emplace_back(keys[*i], vals[*i]);}
+		alloc(2*keys.size());
+		for (auto i = entries.begin(); i != entries.end(); ++i) {add(i->first, i->second);}
+	}
+public:
+	erosion_overlay_t() {alloc(4096);}
+
+	float get(unsigned ix) const {
+		unsigned const slot(find_slot(ix));
+		return ((keys[slot] == ix) ? vals[slot] : 0.0f);
+	}
+	void add(unsigned ix, float val) {
+		unsigned slot(find_slot(ix));
+
+		if (keys[slot] != ix) { // new entry
+			if (2*(used.size() + 1) > keys.size()) {grow(); slot = find_slot(ix);} // keep the load factor below 0.5
+			keys[slot] = ix;
+			vals[slot] = 0.0;
+			used.push_back(slot);
+		}
+		vals[slot] += val;
+	}
+	void extract_and_clear(vector<hmap_delta_t> &deltas) { // deltas are sorted by index
+		deltas.clear();
+
+		for (auto i = used.begin(); i != used.end(); ++i) {
+			deltas.emplace_back(keys[*i], vals[*i]);
+			keys[*i] = UINT_MAX;
+		}
+		used.clear();
+		sort(deltas.begin(), deltas.end());
+	}
+};
+
+
 // see http://ranmantaru.com/blog/2011/10/08/water-erosion-on-heightmap-terrain/
+// Droplets are run in parallel in fixed size batches. Each droplet sees the heightmap from the start of its batch plus its own changes,
+// which are recorded in an overlay and merged in droplet order at the end of the batch, so results are independent of the number of threads.
 void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsigned num_iters) {
 
 	if (num_iters == 0 || erode_amount <= 0.0) return; // erosion disabled
@@ -24,7 +88,6 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 	float const Kq=10, Kw=0.001f, Kr=0.9f, Kd=0.02f, Ki=0.1f, minSlope=0.05f, g=20, Kg=g*2;
 	int const PAD(4), NX(xsize+2*PAD), NY(ysize+2*PAD);
 	unsigned const MAX_PATH_LEN(4*NX*NY);
-	vector<vector2d> erosion(NX*NY, vector2d(0.0, 0.0));
 	vector<float> mh_padded(NX*NY);
 
 	// pad mesh by 1 unit on each side to create a buffer of trash around the edges that can be discarded
@@ -37,13 +100,11 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 	}
 
 #define HMAP_INDEX(x, y) (NX*max(min(y, NY-1), 0) + max(min(x, NX-1), 0))
-#define HMAP(x, y) mh_padded[HMAP_INDEX(x, y)]
+#define HMAP(x, y) get_height(HMAP_INDEX(x, y))
 
 #define DEPOSIT_AT(X, Z, W) { \
 	float const delta = ds*erode_amount*(W); \
-	unsigned const ix(HMAP_INDEX((X), (Z))); \
-	erosion[ix].y += delta; \
-	if (!(X < 0 || Z < 0 || X >= NX || Z >= NY)) {mh_padded[ix] += delta;} \
+	if (!(X < 0 || Z < 0 || X >= NX || Z >= NY)) {overlay.add(HMAP_INDEX((X), (Z)), delta);} \
 }
 
 #define DEPOSIT(H) \
@@ -55,16 +116,11 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 
 #define ERODE(X, Z, W) { \
 	float const delta=ds*erode_amount*(W); \
-	unsigned const ix(HMAP_INDEX((X), (Z))); \
-	mh_padded[ix]-=delta; \
-	vector2d &e=erosion[ix]; \
-	float r=e.x, d=e.y; \
-	if (delta<=d) {d-=delta;} else {r+=delta-d; d=0;} \
-	e.x=r; e.y=d; \
+	overlay.add(HMAP_INDEX((X), (Z)), -delta); \
 }
 
-#pragma omp parallel for schedule(dynamic,1)
-	for (int iter=0; iter < (int)num_iters; ++iter) {
+	auto run_droplet([&](int iter, erosion_overlay_t &overlay) {
+		auto get_height([&](unsigned ix) {return (mh_padded[ix] + overlay.get(ix));});
 		rand_gen_t rgen;
 		rgen.set_state(iter+11, 79*iter+121);
 		int xi = PAD + (rgen.rand()%xsize);
@@ -152,7 +208,36 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 			h=nh; h00=nh00; h10=nh10; h01=nh01; h11=nh11;
 		} // for numMoves
 		if (numMoves>=MAX_PATH_LEN) {cout << "droplet path is too long: " << iter << endl;}
-	} // for iter
+	}); // run_droplet
+	vector<vector<hmap_delta_t>> deltas(min(num_iters, EROSION_BATCH_SIZE)); // per droplet in the batch
+	unsigned const band_sz((NY + EROSION_MERGE_BANDS - 1)/EROSION_MERGE_BANDS);
+
+	for (unsigned batch_start = 0; batch_start < num_iters; batch_start += EROSION_BATCH_SIZE) {
+		unsigned const batch_end(min(num_iters, batch_start+EROSION_BATCH_SIZE));
+
+#pragma omp parallel
+		{
+			erosion_overlay_t overlay; // one per thread, cleared after each droplet
+
+#pragma omp for schedule(dynamic,1)
+			for (int iter = batch_start; iter < (int)batch_end; ++iter) {
+				run_droplet(iter, overlay);
+				overlay.extract_and_clear(deltas[iter - batch_start]);
+			}
+		}
+		// merge deltas into the heightmap in droplet order; bands are independent, so they can be processed in parallel
+#pragma omp parallel for schedule(dynamic,1)
+		for (int b = 0; b < (int)EROSION_MERGE_BANDS; ++b) {
+			unsigned const ix_start(min(b*band_sz, (unsigned)NY)*NX), ix_end(min((b+1)*band_sz, (unsigned)NY)*NX);
+			if (ix_start == ix_end) continue;
+
+			for (unsigned d = 0; d < (batch_end - batch_start); ++d) {
+				vector<hmap_delta_t> const &D(deltas[d]);
+				auto i(lower_bound(D.begin(), D.end(), hmap_delta_t(ix_start, -FLT_MAX)));
+				for (; i != D.end() && i->first < ix_end; ++i) {mh_padded[i->first] += i->second;}
+			}
+		}
+	} // for batch_start
 
 	// remove padding and clamp to min_zval
 	for (int y = 0; y < ysize; ++y) {
@@ -7,6 +7,7 @@
 
 struct xform_matrix;
 struct cube_with_zval_t;
+struct cobj_ray_packet_t;
 
 int omp_get_thread_num_3dw();
 
@@ -425,6 +426,7 @@ int  add_simple_coll_polygon(const point *points, int npoints, cobj_params const
 int  remove_coll_object(int index, bool reset_draw=1);
 int  remove_reset_coll_obj(int &index);
 void purge_coll_freed(bool force);
+unsigned get_cobj_change_count();
 void remove_all_coll_obj();
 void cobj_stats();
 int  collision_detect_large_sphere(point &pos, float radius, unsigned flags);
@@ -448,6 +450,7 @@ void build_static_moving_cobj_tree();
 void build_cobj_tree(bool dynamic=0, bool verbose=1);
 bool check_coll_line_exact_tree(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
 	bool dynamic=0, int test_alpha=0, bool skip_non_drawn=0, bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0, bool no_stat_moving=0);
+void check_coll_line_exact_tree_packet(cobj_ray_packet_t &rp, bool include_voxels, bool no_stat_moving);
 bool check_coll_line_tree(point const &p1, point const &p2, int &cindex, int ignore_cobj, bool dynamic=0, int test_alpha=0,
 	bool skip_non_drawn=0, bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0);
 bool cobj_contained_tree(point const &viewer, point const *const pts, unsigned npts, int ignore_cobj, int &cobj);
@@ -7,6 +7,8 @@
 
 using namespace std;
 
+extern string tex_comp_cache_dir;
+
 #ifdef ENABLE_JPEG
 #define INT32 prev_INT32 // fix conflicting typedef used in freeglut
 #include "jpeglib.h"
@@ -23,6 +25,9 @@ void wrap_png_error(png_structp, png_const_charp) {
 
 #ifdef ENABLE_DDS
 #include <gli/gli.hpp> // Note: must be after tiffio.h include due to conflicting uint32_t typedef
+#define STB_DXT_STATIC
+#define STB_DXT_IMPLEMENTATION
+#include "stb_dxt.h" // for compressed texture cache
 #endif
 
 #ifdef ENABLE_TIFF
@@ -746,6 +751,125 @@ void texture_t::deferred_load_and_bind() {
 }
 
 
+#ifdef ENABLE_DDS
+unsigned const TEX_COMP_CACHE_VERSION = 1; // increment when the compressor or key changes
+
+unsigned get_num_mipmap_levels(unsigned w, unsigned h) {
+	unsigned num(1);
+	for (unsigned sz = max(w, h); sz > 1; sz >>= 1) {++num;}
+	return num;
+}
+
+// 2x2 box filter; odd sizes clamp to the last row/column
+void downsample_image_2x(vector<unsigned char> const &src, unsigned w, unsigned h, unsigned ncolors, vector<unsigned char> &dest) {
+	unsigned const nw(max(1U, w/2)), nh(max(1U, h/2));
+	dest.resize(nw*nh*ncolors);
+
+	for (unsigned y = 0; y < nh; ++y) {
+		unsigned const y0(min(2*y, h-1)), y1(min(2*y+1, h-1));
+
+		for (unsigned x = 0; x < nw; ++x) {
+			unsigned const x0(min(2*x, w-1)), x1(min(2*x+1, w-1));
+
+			for (unsigned c = 0; c < ncolors; ++c) {
+				unsigned const sum(src[(y0*w + x0)*ncolors + c] + src[(y0*w + x1)*ncolors + c] + src[(y1*w + x0)*ncolors + c] + src[(y1*w + x1)*ncolors + c]);
+				dest[(y*nw + x)*ncolors + c] = (unsigned char)((sum + 2) >> 2);
+			}
+		}
+	}
+}
+
+// compresses an RGB (BC1/DXT1) or RGBA (BC3/DXT5) image in 4x4 blocks, clamping at the edges for sizes that aren't a multiple of 4
+void compress_image_dxt(unsigned char const *src, unsigned w, unsigned h, unsigned ncolors, unsigned char *dest) {
+	assert(ncolors == 3 || ncolors == 4);
+	bool const has_alpha(ncolors == 4);
+	unsigned const block_bytes(has_alpha ? 16 : 8);
+	unsigned char block[64]; // 4x4 RGBA
+
+	for (unsigned by = 0; by < h; by += 4) {
+		for (unsigned bx = 0; bx < w; bx += 4) {
+			for (unsigned y = 0; y < 4; ++y) {
+				for (unsigned x = 0; x < 4; ++x) {
+					unsigned char const *const p(src + (min(by+y, h-1)*w + min(bx+x, w-1))*ncolors);
+					unsigned char *const b(block + 4*(4*y + x));
+					RGB_BLOCK_COPY(b, p);
+					b[3] = (has_alpha ? p[3] : 255);
+				}
+			}
+			stb_compress_dxt_block(dest, block, has_alpha, STB_DXT_HIGHQUAL);
+			dest += block_bytes;
+		}
+	}
+}
+
+string texture_t::get_comp_cache_fn() const { // keyed by texture parameters and image data, so changed source images get a new entry
+	uint64_t hash(14695981039346656037ULL); // FNV-1a
+	auto hash_bytes([&hash](void const *ptr, size_t sz) {
+		for (size_t i = 0; i < sz; ++i) {hash = (hash ^ ((unsigned char const *)ptr)[i]) * 1099511628211ULL;}
+	});
+	int const params[5] = {width, height, ncolors, use_mipmaps, (int)TEX_COMP_CACHE_VERSION};
+	hash_bytes(name.data(), name.size());
+	hash_bytes(params, sizeof(params));
+	hash_bytes(data, num_bytes());
+	size_t const spos(name.find_last_of("/\\")), epos(name.find_last_of('.'));
+	size_t const start((spos == string::npos) ? 0 : spos+1), end((epos == string::npos || epos < start) ? name.size() : epos);
+	ostringstream oss;
+	oss << tex_comp_cache_dir << "/" << name.substr(start, end-start) << "_" << hex << hash << ".dds";
+	return oss.str();
+}
+
+// returns 1 if loaded from the cache, 2 if compressed here and written to the cache
+unsigned texture_t::load_or_create_comp_cache() {
+
+	assert(use_comp_cache());
+	bool const has_alpha(ncolors == 4);
+	gli::format const gformat(has_alpha ? gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16 : gli::FORMAT_RGB_DXT1_UNORM_BLOCK8);
+	unsigned const num_levels(use_mipmaps ? get_num_mipmap_levels(width, height) : 1);
+	string const fn(get_comp_cache_fn());
+	gli::texture2d tex(gli::load_dds(fn));
+	bool const loaded(!tex.empty() && tex.format() == gformat && tex.levels() == num_levels && tex.extent().x == width && tex.extent().y == height);
+
+	if (!loaded) { // not in the cache (or invalid), so compress it and write it
+		tex = gli::texture2d(gformat, gli::texture2d::extent_type(width, height), num_levels);
+		vector<unsigned char> level_data(data, data+num_bytes()), next_level;
+		unsigned w(width), h(height);
+
+		for (unsigned level = 0; level < num_levels; ++level) {
+			assert(tex[level].size() == ((w+3)/4)*((h+3)/4)*(has_alpha ? 16 : 8));
+			compress_image_dxt(&level_data.front(), w, h, ncolors, (unsigned char *)tex[level].data());
+			if (level+1 == num_levels) break;
+			downsample_image_2x(level_data, w, h, ncolors, next_level);
+			level_data.swap(next_level);
+			w = max(1U, w/2);
+			h = max(1U, h/2);
+		}
+		if (!gli::save_dds(tex, fn)) {cerr << "Error writing compressed texture cache file " << fn << endl;} // nonfatal
+	}
+	comp_data.clear();
+	comp_mm_offsets.clear();
+
+	for (unsigned level = 0; level < num_levels; ++level) {
+		unsigned char const *const ptr((unsigned char const *)tex[level].data());
+		comp_mm_offsets.push_back(comp_data.size());
+		comp_data.insert(comp_data.end(), ptr, ptr+tex[level].size());
+	}
+	comp_format = (has_alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT);
+	return (loaded ? 1 : 2);
+}
+
+#else
+unsigned texture_t::load_or_create_comp_cache() { // returns 0: the cache is skipped and the texture is loaded uncompressed as usual
+#pragma omp critical(comp_cache_warning)
+	{
+		static bool warned(0);
+		if (!warned) {cerr << "Warning: The compressed texture cache requires DDS support; ignoring tex_comp_cache_dir." << endl;}
+		warned = 1;
+	}
+	return 0;
+}
+#endif // ENABLE_DDS
+
+
 string read_string_ignore_comment_line(istream &in) {
 	string s;
 	in >> s;
@@ -7,6 +7,8 @@
 #include "3DWorld.h"
 #include "trigger.h"
 
+struct binary_file_reader;
+
 extern int MESH_X_SIZE, MESH_Y_SIZE, MESH_SIZE[3];
 
 #define ADD_LIGHT_CONTRIB(c, C) {C[0] += c[0]; C[1] += c[1]; C[2] += c[2];}
@@ -28,12 +30,12 @@ protected:
 
 unsigned const lmcell_ltype_off[NUM_LIGHTING_TYPES] = {0, 4, 8, 0}; // sky, global, local, sky cobj accum, dynamic
 
-struct lmcell { // size = 52
+struct lmcell { // size = 48
 
-	float sc[3], sv, gc[3], gv, lc[3], smoke; // *c[3]: RGB sky, global, local colors
+	float sc[3], sv, gc[3], gv, lc[3]; // *c[3]: RGB sky, global, local colors; smoke is stored separately in smoke.cpp
 	unsigned char pflow[3]; // flow: x, y, z
 	
-	lmcell() : sv(0.0), gv(0.0), smoke(0.0) {UNROLL_3X(sc[i_] = gc[i_] = lc[i_] = 0.0; pflow[i_] = 255;)}
+	lmcell() : sv(0.0), gv(0.0) {UNROLL_3X(sc[i_] = gc[i_] = lc[i_] = 0.0; pflow[i_] = 255;)}
 	float       *get_offset(int ltype)       {return (sc + lmcell_ltype_off[ltype]);}
 	float const *get_offset(int ltype) const {return (sc + lmcell_ltype_off[ltype]);}
 	static unsigned get_dsz(int ltype)       {return ((ltype == LIGHTING_LOCAL) ? 3 : 4);}
@@ -44,6 +46,8 @@ struct lmcell { // size = 52
 };
 
 
+// Note: cells are stored densely in memory (one lmcell per z value in each nonempty x/y column) so that get_column() and
+// get_cell_ix() can index them directly; only the lighting files use the sparse fp16 format (see write_data_to_file())
 class lmap_manager_t {
 
 	vector<lmcell> vldata_alloc;
@@ -52,6 +56,7 @@ class lmap_manager_t {
 
 	lmap_manager_t(lmap_manager_t const &) = delete; // forbidden
 	void operator=(lmap_manager_t const &) = delete; // forbidden
+	bool read_sparse_data(binary_file_reader &reader, char const *const fn, int ltype);
 
 public:
 	bool was_updated;
@@ -70,6 +75,8 @@ public:
 	lmcell &get_lmcell(int x, int y, int z) {return get_column(x, y)[z];} // Note: no bounds checking
 	lmcell *get_lmcell_round_down(point const &p);
 	lmcell *get_lmcell(point const &p);
+	unsigned get_cell_ix(lmcell const &c) const {return unsigned(&c - vldata_alloc.data());} // index into vldata_alloc
+	lmcell &get_cell_by_ix(unsigned ix) {assert(ix < vldata_alloc.size()); return vldata_alloc[ix];}
 	void reset_all(lmcell const &init_lmcell=lmcell());
 	template<typename T> void alloc(unsigned nbins, unsigned xsize, unsigned ysize, unsigned zsize, T **nonempty_bins, lmcell const &init_lmcell);
 	void init_from(lmap_manager_t const &src);
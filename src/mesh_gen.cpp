@@ -10,6 +10,7 @@
 #include "shaders.h"
 #include "gl_ext_arb.h"
 #include <glm/gtc/noise.hpp>
+#include <emmintrin.h>
 
 
 int      const NUM_FREQ_COMP      = 9;
@@ -33,6 +34,7 @@ int   const F_TABLE_SIZE = NUM_FREQ_COMP*N_RAND_SIN2;
 
 // Global Variables
 float MESH_START_MAG(0.02), MESH_START_FREQ(240.0), MESH_MAG_MULT(2.0), MESH_FREQ_MULT(0.5);
+bool mesh_gen_cpu_only(0); // for systems without compute shader support
 int cache_counter(1), start_eval_sin(0), GLACIATE(DEF_GLACIATE), mesh_gen_mode(MGEN_SINE), mesh_gen_shape(0), mesh_freq_filter(FREQ_FILTER);
 float zmax, zmin, zmax_est, zcenter(0.0), zbottom(0.0), ztop(0.0), h_sum(0.0), alt_temp(DEF_TEMPERATURE);
 float mesh_scale(1.0), tree_scale(1.0), mesh_scale_z(1.0), mesh_scale_z_inv(1.0), glaciate_exp(1.0), glaciate_exp_inv(1.0);
@@ -581,6 +583,142 @@ void gen_rx_ry(float &rx, float &ry) {
 }
 
 
+// SSE versions of glm::simplex() and glm::perlin() in 2D that evaluate 4 points at once; these follow the glm code step by step
+inline __m128 floor_ps(__m128 const v) { // SSE2 has no floor; values are well within int range
+	__m128 const t(_mm_cvtepi32_ps(_mm_cvttps_epi32(v)));
+	return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.0f)));
+}
+inline __m128 fract_ps (__m128 const v) {return _mm_sub_ps(v, floor_ps(v));}
+inline __m128 abs_ps   (__m128 const v) {return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);}
+inline __m128 mod289_ps(__m128 const v) {return _mm_sub_ps(v, _mm_mul_ps(_mm_set1_ps(289.0f), floor_ps(_mm_div_ps(v, _mm_set1_ps(289.0f)))));} // glm::mod()
+inline __m128 permute_ps(__m128 const v) { // glm::detail::permute()
+	__m128 const x(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(34.0f)), _mm_set1_ps(1.0f)), v));
+	return _mm_sub_ps(x, _mm_mul_ps(floor_ps(_mm_mul_ps(x, _mm_set1_ps(1.0f/289.0f))), _mm_set1_ps(289.0f)));
+}
+inline __m128 taylor_inv_sqrt_ps(__m128 const r) {return _mm_sub_ps(_mm_set1_ps(1.79284291400159f), _mm_mul_ps(_mm_set1_ps(0.85373472095314f), r));}
+inline __m128 mix_ps(__m128 const a, __m128 const b, __m128 const t) {return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));}
+
+__m128 simplex_noise_sse(__m128 const vx, __m128 const vy) {
+
+	__m128 const Cx(_mm_set1_ps(0.211324865405187f)), Cy(_mm_set1_ps(0.366025403784439f)), Cz(_mm_set1_ps(-0.577350269189626f)), Cw(_mm_set1_ps(0.024390243902439f));
+	__m128 const one(_mm_set1_ps(1.0f)), half(_mm_set1_ps(0.5f)), zero(_mm_setzero_ps());
+	// first corner
+	__m128 const s(_mm_add_ps(_mm_mul_ps(vx, Cy), _mm_mul_ps(vy, Cy)));
+	__m128 ix(floor_ps(_mm_add_ps(vx, s))), iy(floor_ps(_mm_add_ps(vy, s)));
+	__m128 const t(_mm_add_ps(_mm_mul_ps(ix, Cx), _mm_mul_ps(iy, Cx)));
+	__m128 const x0x(_mm_add_ps(_mm_sub_ps(vx, ix), t)), x0y(_mm_add_ps(_mm_sub_ps(vy, iy), t));
+	// other corners
+	__m128 const i1x(_mm_and_ps(_mm_cmpgt_ps(x0x, x0y), one)), i1y(_mm_sub_ps(one, i1x));
+	__m128 const px[3] = {x0x, _mm_sub_ps(_mm_add_ps(x0x, Cx), i1x), _mm_add_ps(x0x, Cz)};
+	__m128 const py[3] = {x0y, _mm_sub_ps(_mm_add_ps(x0y, Cx), i1y), _mm_add_ps(x0y, Cz)};
+	// permutations
+	ix = mod289_ps(ix);
+	iy = mod289_ps(iy);
+	__m128 const ox[3] = {zero, i1x, one}, oy[3] = {zero, i1y, one};
+	__m128 ret(zero);
+
+	for (unsigned k = 0; k < 3; ++k) {
+		__m128 const p(permute_ps(_mm_add_ps(_mm_add_ps(permute_ps(_mm_add_ps(iy, oy[k])), ix), ox[k])));
+		__m128 m(_mm_max_ps(_mm_sub_ps(half, _mm_add_ps(_mm_mul_ps(px[k], px[k]), _mm_mul_ps(py[k], py[k]))), zero));
+		m = _mm_mul_ps(m, m);
+		m = _mm_mul_ps(m, m);
+		// gradients: 41 points uniformly over a line, mapped onto a diamond
+		__m128 const x(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.0f), fract_ps(_mm_mul_ps(p, Cw))), one));
+		__m128 const h(_mm_sub_ps(abs_ps(x), half));
+		__m128 const a0(_mm_sub_ps(x, floor_ps(_mm_add_ps(x, half))));
+		m = _mm_mul_ps(m, taylor_inv_sqrt_ps(_mm_add_ps(_mm_mul_ps(a0, a0), _mm_mul_ps(h, h)))); // normalize gradients implicitly by scaling m
+		ret = _mm_add_ps(ret, _mm_mul_ps(m, _mm_add_ps(_mm_mul_ps(a0, px[k]), _mm_mul_ps(h, py[k]))));
+	}
+	return _mm_mul_ps(_mm_set1_ps(130.0f), ret);
+}
+
+__m128 perlin_noise_sse(__m128 const vx, __m128 const vy) {
+
+	__m128 const one(_mm_set1_ps(1.0f)), half(_mm_set1_ps(0.5f));
+	__m128 const pi0x(floor_ps(vx)), pi0y(floor_ps(vy));
+	__m128 const pf0x(fract_ps(vx)), pf0y(fract_ps(vy)), pf1x(_mm_sub_ps(pf0x, one)), pf1y(_mm_sub_ps(pf0y, one));
+	__m128 const pix[2] = {mod289_ps(pi0x), mod289_ps(_mm_add_ps(pi0x, one))}, piy[2] = {mod289_ps(pi0y), mod289_ps(_mm_add_ps(pi0y, one))};
+	__m128 const fx[2] = {pf0x, pf1x}, fy[2] = {pf0y, pf1y};
+	__m128 n[2][2]; // {x, y}
+
+	for (unsigned y = 0; y < 2; ++y) {
+		for (unsigned x = 0; x < 2; ++x) {
+			__m128 const i(permute_ps(_mm_add_ps(permute_ps(pix[x]), piy[y])));
+			__m128 gx(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.0f), fract_ps(_mm_div_ps(i, _mm_set1_ps(41.0f)))), one));
+			__m128 gy(_mm_sub_ps(abs_ps(gx), half));
+			gx = _mm_sub_ps(gx, floor_ps(_mm_add_ps(gx, half)));
+			__m128 const norm(taylor_inv_sqrt_ps(_mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gy, gy))));
+			n[x][y] = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(gx, norm), fx[x]), _mm_mul_ps(_mm_mul_ps(gy, norm), fy[y]));
+		}
+	}
+	__m128 fade[2] = {pf0x, pf0y};
+
+	for (unsigned d = 0; d < 2; ++d) { // t*t*t*(t*(t*6 - 15) + 10)
+		__m128 const t(fade[d]);
+		fade[d] = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f)));
+	}
+	__m128 const n_x0(mix_ps(n[0][0], n[1][0], fade[0])), n_x1(mix_ps(n[0][1], n[1][1], fade[0]));
+	return _mm_mul_ps(_mm_set1_ps(2.3f), mix_ps(n_x0, n_x1, fade[1]));
+}
+
+__m128 gen_noise_sse(__m128 const xv, __m128 const yv, int mode, int shape, float rx, float ry) { // 4-wide version of gen_noise()
+
+	__m128 zval(_mm_setzero_ps());
+	float mag(1.0), freq(1.0);
+	unsigned const end_octave(NUM_FREQ_COMP - start_eval_sin/N_RAND_SIN2);
+	float const lacunarity(1.92), gain(0.5);
+	bool const is_simplex(mode == MGEN_SIMPLEX || mode == MGEN_SIMPLEX_GPU || mode == MGEN_DWARP_GPU);
+
+	for (unsigned i = 0; i < end_octave; ++i) {
+		__m128 const fv(_mm_set1_ps(freq));
+		__m128 const px(_mm_add_ps(_mm_mul_ps(fv, xv), _mm_set1_ps(rx))), py(_mm_add_ps(_mm_mul_ps(fv, yv), _mm_set1_ps(ry)));
+		__m128 noise(is_simplex ? simplex_noise_sse(px, py) : perlin_noise_sse(px, py));
+		if      (shape == 1) {noise = _mm_sub_ps(abs_ps(noise), _mm_set1_ps(0.40f));} // billowy
+		else if (shape == 2) {noise = _mm_sub_ps(_mm_set1_ps(0.45f), abs_ps(noise));} // ridged
+		zval  = _mm_add_ps(zval, _mm_mul_ps(_mm_set1_ps(mag), noise));
+		mag  *= gain;
+		freq *= lacunarity;
+		rx   *= 1.5;
+		ry   *= 1.5;
+	}
+	return zval;
+}
+
+// batched version of get_noise_zval() for n points with the same yval
+void get_noise_zvals_row(float const *const xvals, float yval, unsigned n, int mode, int shape, float *const zvals) {
+
+	assert(mode != MGEN_SINE);
+	float const xy_scale(MESH_SCALE_FACTOR*mesh_scale), zscale(get_hmap_scale(mode));
+	float rx, ry;
+	gen_rx_ry(rx, ry);
+	__m128 const yv(_mm_set1_ps(xy_scale*yval)), xys(_mm_set1_ps(xy_scale));
+
+	for (unsigned i = 0; i < n; i += 4) {
+		unsigned const num(min(4U, n-i));
+		float xv4[4], z4[4];
+		for (unsigned j = 0; j < 4; ++j) {xv4[j] = xvals[i + min(j, num-1)];} // pad with the last value
+		__m128 xv(_mm_mul_ps(xys, _mm_loadu_ps(xv4))), yvw(yv);
+
+		if (mode == MGEN_DWARP_GPU) { // domain warping
+			__m128 const scale(_mm_set1_ps(0.2f));
+			__m128 const dx1(gen_noise_sse(xv, yv, mode, shape, rx, ry));
+			__m128 const dy1(gen_noise_sse(_mm_add_ps(xv, _mm_set1_ps(5.2f)), _mm_add_ps(yv, _mm_set1_ps(1.3f)), mode, shape, rx, ry));
+			__m128 const wx(_mm_add_ps(xv, _mm_mul_ps(scale, dx1))), wy(_mm_add_ps(yv, _mm_mul_ps(scale, dy1)));
+			__m128 const dx2(gen_noise_sse(_mm_add_ps(wx, _mm_set1_ps(1.7f)), _mm_add_ps(wy, _mm_set1_ps(9.2f)), mode, shape, rx, ry));
+			__m128 const dy2(gen_noise_sse(_mm_add_ps(wx, _mm_set1_ps(8.3f)), _mm_add_ps(wy, _mm_set1_ps(2.8f)), mode, shape, rx, ry));
+			xv  = _mm_add_ps(xv, _mm_mul_ps(scale, dx2));
+			yvw = _mm_add_ps(yv, _mm_mul_ps(scale, dy2));
+		}
+		_mm_storeu_ps(z4, gen_noise_sse(xv, yvw, mode, shape, rx, ry));
+
+		for (unsigned j = 0; j < num; ++j) {
+			postproc_noise_zval(z4[j]);
+			zvals[i+j] = z4[j]*zscale;
+		}
+	}
+}
+
+
 bool mesh_xy_grid_cache_t::build_arrays(float x0, float y0, float dx, float dy,
 	unsigned nx, unsigned ny, bool cache_values, bool force_sine_mode, bool no_wait)
 {
@@ -592,13 +730,17 @@ bool mesh_xy_grid_cache_t::build_arrays(float x0, float y0, float dx, float dy,
 	do_glaciate = 0; // must set enable_glaciate() after this call if needed
 	cached_vals.clear();
 
-	if (gen_mode >= MGEN_SIMPLEX_GPU) { // GPU simplex noise - always cache values
+	if (gen_mode >= MGEN_SIMPLEX_GPU && !mesh_gen_cpu_only) { // GPU simplex noise - always cache values
 		bool const is_running(cshader && cshader->get_is_running());
 		if (!is_running) {run_gpu_simplex();} // launch the job
 		if (no_wait && !is_running) return 0; // just started, results not yet available
 		cache_gpu_simplex_vals();
 		return 1; // results are available
 	}
+	if (gen_mode != MGEN_SINE) { // CPU simplex/perlin noise - always cache values, since batch evaluation is much faster
+		gen_cpu_noise_vals();
+		return 1;
+	}
 	yterms_start = nx*F_TABLE_SIZE;
 	xyterms.resize((nx + ny)*F_TABLE_SIZE, 0.0);
 	float const msx(mesh_scale*DX_VAL_INV), msy(mesh_scale*DY_VAL_INV), ms2(0.5*mesh_scale);
@@ -632,6 +774,18 @@ bool mesh_xy_grid_cache_t::build_arrays(float x0, float y0, float dx, float dy,
 	return 1; // results are available
 }
 
+void mesh_xy_grid_cache_t::gen_cpu_noise_vals() { // same values as eval_index(), but computed for 4 x-values at a time using SIMD
+
+	vector<float> xvals(cur_nx);
+	for (unsigned x = 0; x < cur_nx; ++x) {xvals[x] = (x*mdx + mx0)*DX_VAL_INV;}
+	cached_vals.resize(cur_nx*cur_ny);
+
+#pragma omp parallel for schedule(static,1)
+	for (int y = 0; y < (int)cur_ny; ++y) {
+		get_noise_zvals_row(&xvals.front(), (y*mdy + my0)*DY_VAL_INV, cur_nx, gen_mode, gen_shape, &cached_vals[y*cur_nx]);
+	}
+}
+
 void mesh_xy_grid_cache_t::enable_glaciate() {
 
 	do_glaciate = 1;
@@ -752,7 +906,7 @@ float mesh_xy_grid_cache_t::eval_index(unsigned x, unsigned y, int min_start_sin
 	assert(x < cur_nx && y < cur_ny);
 	float zval(0.0);
 
-	if ((use_cache || gen_mode >= MGEN_SIMPLEX_GPU) && !cached_vals.empty()) {
+	if ((use_cache || gen_mode != MGEN_SINE) && !cached_vals.empty()) { // noise values are always cached
 		zval += cached_vals[y*cur_nx + x];
 	}
 	else if (gen_mode != MGEN_SINE) { // perlin/simplex
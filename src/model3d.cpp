@@ -10,6 +10,7 @@
 #include "voxels.h" // for get_cur_model_edges_as_cubes
 #include "csg.h" // for clip_polygon_to_cube
 #include "lightmap.h" // for lmap_manager_t
+#include "binary_file_io.h" // for mapped_file_t
 #include <fstream>
 #include <queue>
 #include "meshoptimizer.h"
@@ -17,7 +18,11 @@
 bool const ENABLE_BUMP_MAPS  = 1;
 bool const ENABLE_SPEC_MAPS  = 1;
 bool const ENABLE_INTER_REFLECTIONS = 1;
-unsigned const MAGIC_NUMBER  = 42987143; // arbitrary file signature
+unsigned const MAGIC_NUMBER  = 42987143; // arbitrary file signature (version 1 stream format)
+unsigned const MAGIC_NUMBER_V2 = 42987144; // version 2 format with separate vertex/index arrays
+unsigned const MODEL3D_FILE_VERSION = 2;
+unsigned const MODEL3D_PAGE_SIZE    = 4096;
+unsigned const MODEL3D_ARRAY_ALIGN  = 16;
 unsigned const BLOCK_SIZE    = 32768; // in vertex indices
 
 bool model_calc_tan_vect(1); // slower and more memory but sometimes better quality/smoother transitions
@@ -169,6 +174,90 @@ template<typename V> void read_vector(istream &in, V &v) {
 }
 
 
+// model3d file version 2 layout: header, metadata stream, array table, then vertex and index arrays;
+// arrays start on a page boundary and are contiguous per material, so they can be copied straight out of a memory mapped file
+struct model3d_file_header_t { // size = 48
+	unsigned magic, version, header_size, vert_size, vert_tan_size, mat_params_size, num_arrays, meta_size;
+	uint64_t file_size, hash; // hash of metadata, array table, and array data
+
+	model3d_file_header_t() : magic(MAGIC_NUMBER_V2), version(MODEL3D_FILE_VERSION), header_size(sizeof(model3d_file_header_t)), vert_size(sizeof(vert_norm_tc)),
+		vert_tan_size(sizeof(vert_norm_tc_tan)), mat_params_size(sizeof(material_params_t)), num_arrays(0), meta_size(0), file_size(0), hash(0) {}
+	bool is_compatible(model3d_file_header_t const &h) const { // everything that affects the binary layout
+		return (h.magic == magic && h.version == version && h.header_size == header_size && h.vert_size == vert_size &&
+			h.vert_tan_size == vert_tan_size && h.mat_params_size == mat_params_size);
+	}
+};
+
+uint64_t model3d_data_hash(char const *data, size_t sz, uint64_t hash) { // FNV-1a on 64-bit words
+	size_t const nwords(sz/8);
+
+	for (size_t i = 0; i < nwords; ++i) {
+		uint64_t w;
+		memcpy(&w, data+8*i, 8);
+		hash = (hash ^ w)*1099511628211ULL;
+	}
+	for (size_t i = 8*nwords; i < sz; ++i) {hash = (hash ^ (unsigned char)data[i])*1099511628211ULL;}
+	return hash;
+}
+uint64_t const MODEL3D_HASH_INIT = 14695981039346656037ULL;
+
+struct model3d_array_table_t {
+	struct entry_t { // size = 16
+		uint64_t offset, size; // in bytes; offset is from the start of the file
+		entry_t(uint64_t o=0, uint64_t s=0) : offset(o), size(s) {}
+	};
+	vector<entry_t> entries;
+	vector<char const *> src_data; // write mode
+	char const *file_data; // read mode
+	size_t file_size;
+	unsigned next_entry;
+
+	model3d_array_table_t(char const *file_data_=nullptr, size_t file_size_=0) : file_data(file_data_), file_size(file_size_), next_entry(0) {}
+
+	template<typename V> void add(V const &v) {
+		entries.emplace_back(0, v.size()*sizeof(typename V::value_type));
+		src_data.push_back((char const *)v.data());
+	}
+	template<typename V> bool get(V &v, unsigned num) {
+		typedef typename V::value_type T;
+		if (next_entry >= entries.size()) return 0;
+		entry_t const &e(entries[next_entry++]);
+		if (e.size != num*sizeof(T) || e.offset + e.size > file_size) return 0; // corrupt table
+		T const *const data((T const *)(file_data + e.offset));
+		v.assign(data, data+num); // one bulk copy out of the mapped file
+		return 1;
+	}
+	void calc_offsets(uint64_t start) {
+		uint64_t cur(start);
+
+		for (auto i = entries.begin(); i != entries.end(); ++i) {
+			i->offset = cur;
+			cur += ((i->size + MODEL3D_ARRAY_ALIGN - 1)/MODEL3D_ARRAY_ALIGN)*MODEL3D_ARRAY_ALIGN;
+		}
+	}
+	uint64_t get_end_offset(uint64_t start) const {
+		if (entries.empty()) return start;
+		entry_t const &e(entries.back());
+		return ((e.offset + e.size + MODEL3D_ARRAY_ALIGN - 1)/MODEL3D_ARRAY_ALIGN)*MODEL3D_ARRAY_ALIGN;
+	}
+};
+
+// versions that store the data in the array table rather than the stream, if there is one
+template<typename V> void write_vector(ostream &out, V const &v, model3d_array_table_t *at) {
+	if (!at) {write_vector(out, v); return;}
+	write_uint(out, (unsigned)v.size());
+	at->add(v);
+}
+template<typename V> void read_vector(istream &in, V &v, model3d_array_table_t *at) {
+	if (!at) {read_vector(in, v); return;}
+	if (!at->get(v, read_uint(in))) {in.setstate(ios::failbit);}
+}
+
+struct membuf_t : public std::streambuf { // for reading from memory with an istream
+	membuf_t(char const *begin, char const *end) {setg(const_cast<char *>(begin), const_cast<char *>(begin), const_cast<char *>(end));}
+};
+
+
 // ************ vntc_vect_t/indexed_vntc_vect_t ************
 
 // explicit template instantiations of vert_norm case, used for voxel_model, where tc=0.0
@@ -540,17 +629,17 @@ template<> void indexed_vntc_vect_t<vert_norm_tc_tan>::calc_tangents(unsigned np
 }
 
 
-template<typename T> void vntc_vect_t<T>::write(ostream &out) const {
-	write_vector(out, *this);
+template<typename T> void vntc_vect_t<T>::write(ostream &out, model3d_array_table_t *at) const {
+	write_vector(out, *this, at);
 }
 
-template<typename T> void vntc_vect_t<T>::read(istream &in) {
+template<typename T> void vntc_vect_t<T>::read(istream &in, model3d_array_table_t *at) {
 
 	// Note: it would be nice to write/read without the tangent vectors and recalculate them later,
 	// but knowing which materials require tangents requires loading the material file first, but that requires the model,
 	// so we would have to read the model3d material headers, then read the material file, then read the polygon data into the correct geometry type,
 	// which would also require writing out the model3d file in two passes and smaller blocks of data at a time
-	read_vector(in, *this);
+	read_vector(in, *this, at);
 	has_tangents = (sizeof(T) == sizeof(vert_norm_tc_tan)); // HACK to get the type
 	calc_bounding_volumes();
 }
@@ -763,14 +852,14 @@ template<typename T> void indexed_vntc_vect_t<T>::invert_tcy() {
 	for (auto i = begin(); i != end(); ++i) {invert_vert_tcy(*i);}
 }
 
-template<typename T> void indexed_vntc_vect_t<T>::write(ostream &out) const {
-	vntc_vect_t<T>::write(out);
-	write_vector(out, indices);
+template<typename T> void indexed_vntc_vect_t<T>::write(ostream &out, model3d_array_table_t *at) const {
+	vntc_vect_t<T>::write(out, at);
+	write_vector(out, indices, at);
 }
 
-template<typename T> void indexed_vntc_vect_t<T>::read(istream &in) {
-	vntc_vect_t<T>::read(in);
-	read_vector(in, indices);
+template<typename T> void indexed_vntc_vect_t<T>::read(istream &in, model3d_array_table_t *at) {
+	vntc_vect_t<T>::read(in, at);
+	read_vector(in, indices, at);
 }
 
 
@@ -922,18 +1011,18 @@ template<typename T> void vntc_vect_block_t<T>::merge_into_single_vector() {
 	this->resize(1); // remove all but the first block
 }
 
-template<typename T> bool vntc_vect_block_t<T>::write(ostream &out) const {
+template<typename T> bool vntc_vect_block_t<T>::write(ostream &out, model3d_array_table_t *at) const {
 
 	write_uint(out, (unsigned)this->size());
-	for (auto i = begin(); i != end(); ++i) {i->write(out);}
+	for (auto i = begin(); i != end(); ++i) {i->write(out, at);}
 	return 1;
 }
 
-template<typename T> bool vntc_vect_block_t<T>::read(istream &in) {
+template<typename T> bool vntc_vect_block_t<T>::read(istream &in, model3d_array_table_t *at) {
 
 	this->clear();
 	this->resize(read_uint(in));
-	for (auto i = begin(); i != end(); ++i) {i->read(in);}
+	for (auto i = begin(); i != end(); ++i) {i->read(in, at);}
 	if (merge_model_objects) {merge_into_single_vector();} // model was split per object, and we don't want that; merge into a single vector
 	return 1;
 }
@@ -1225,21 +1314,21 @@ bool material_t::add_poly(polygon_t const &poly, vntc_map_t vmap[2], vntct_map_t
 }
 
 
-bool material_t::write(ostream &out) const {
+bool material_t::write(ostream &out, model3d_array_table_t *at) const {
 
 	out.write((char const *)this, sizeof(material_params_t));
 	write_vector(out, name);
 	write_vector(out, filename);
-	return (geom.write(out) && geom_tan.write(out));
+	return (geom.write(out, at) && geom_tan.write(out, at));
 }
 
 
-bool material_t::read(istream &in) {
+bool material_t::read(istream &in, model3d_array_table_t *at) {
 
 	in.read((char *)this, sizeof(material_params_t));
 	read_vector(in, name);
 	read_vector(in, filename);
-	return (geom.read(in) && geom_tan.read(in));
+	return (geom.read(in, at) && geom_tan.read(in, at));
 }
 
 
@@ -2149,22 +2238,14 @@ void model3d::show_stats() const {
 }
 
 
-bool model3d::write_to_disk(string const &fn) const { // Note: transforms not written
+bool model3d::write_body(ostream &out, model3d_array_table_t *at) const {
 
-	ofstream out(fn, ios::out | ios::binary);
-	
-	if (!out.good()) {
-		cerr << "Error opening model3d file for write: " << fn << endl;
-		return 0;
-	}
-	cout << "Writing model3d file " << fn << endl;
-	write_uint(out, MAGIC_NUMBER);
 	out.write((char const *)&bcube, sizeof(cube_t));
-	if (!unbound_geom.write(out)) return 0;
+	if (!unbound_geom.write(out, at)) return 0;
 	write_uint(out, (unsigned)materials.size());
-	
+
 	for (deque<material_t>::const_iterator m = materials.begin(); m != materials.end(); ++m) {
-		if (!m->write(out)) {
+		if (!m->write(out, at)) {
 			cerr << "Error writing material" << endl;
 			return 0;
 		}
@@ -2173,29 +2254,15 @@ bool model3d::write_to_disk(string const &fn) const { // Note: transforms not wr
 }
 
 
-bool model3d::read_from_disk(string const &fn) { // Note: transforms not read
-
-	ifstream in(fn, ios::in | ios::binary);
-	
-	if (!in.good()) {
-		cerr << "Error opening model3d file for read: " << fn << endl;
-		return 0;
-	}
-	clear(); // ???
-	unsigned const magic_number_comp(read_uint(in));
+bool model3d::read_body(istream &in, model3d_array_table_t *at) {
 
-	if (magic_number_comp != MAGIC_NUMBER) {
-		cerr << "Error reading model3d file " << fn << ": Invalid file format (magic number check failed)." << endl;
-		return 0;
-	}
-	cout << "Reading model3d file " << fn << endl;
 	from_model3d_file = 1;
 	in.read((char *)&bcube, sizeof(cube_t));
-	if (!unbound_geom.read(in)) return 0;
+	if (!unbound_geom.read(in, at)) return 0;
 	materials.resize(read_uint(in));
 	
 	for (deque<material_t>::iterator m = materials.begin(); m != materials.end(); ++m) {
-		if (!m->read(in)) {
+		if (!m->read(in, at)) {
 			cerr << "Error reading material" << endl;
 			return 0;
 		}
@@ -2206,6 +2273,103 @@ bool model3d::read_from_disk(string const &fn) { // Note: transforms not read
 }
 
 
+bool model3d::write_to_disk(string const &fn) const { // Note: transforms not written
+
+	ofstream out(fn, ios::out | ios::binary);
+	
+	if (!out.good()) {
+		cerr << "Error opening model3d file for write: " << fn << endl;
+		return 0;
+	}
+	cout << "Writing model3d file " << fn << endl;
+	ostringstream meta(ios::out | ios::binary);
+	model3d_array_table_t at;
+	if (!write_body(meta, &at)) return 0;
+	string const meta_str(meta.str());
+	model3d_file_header_t header;
+	header.num_arrays = (unsigned)at.entries.size();
+	header.meta_size  = (unsigned)meta_str.size();
+	size_t const table_bytes(at.entries.size()*sizeof(model3d_array_table_t::entry_t));
+	uint64_t const table_end(header.header_size + header.meta_size + table_bytes);
+	uint64_t const arrays_start(((table_end + MODEL3D_PAGE_SIZE - 1)/MODEL3D_PAGE_SIZE)*MODEL3D_PAGE_SIZE);
+	at.calc_offsets(arrays_start);
+	header.file_size = at.get_end_offset(arrays_start);
+	header.hash = model3d_data_hash(meta_str.data(), meta_str.size(), MODEL3D_HASH_INIT);
+	header.hash = model3d_data_hash((char const *)at.entries.data(), table_bytes, header.hash);
+	for (unsigned i = 0; i < at.entries.size(); ++i) {header.hash = model3d_data_hash(at.src_data[i], at.entries[i].size, header.hash);}
+	out.write((char const *)&header, sizeof(header));
+	out.write(meta_str.data(), meta_str.size());
+	out.write((char const *)at.entries.data(), table_bytes);
+	vector<char> const padding(MODEL3D_PAGE_SIZE, 0);
+	uint64_t pos(table_end);
+
+	for (unsigned i = 0; i < at.entries.size(); ++i) {
+		model3d_array_table_t::entry_t const &e(at.entries[i]);
+		assert(e.offset >= pos && e.offset - pos < MODEL3D_PAGE_SIZE);
+		out.write(padding.data(), (std::streamsize)(e.offset - pos));
+		out.write(at.src_data[i], (std::streamsize)e.size);
+		pos = e.offset + e.size;
+	}
+	assert(header.file_size >= pos);
+	out.write(padding.data(), (std::streamsize)(header.file_size - pos));
+	return out.good();
+}
+
+
+bool model3d::read_from_disk(string const &fn) { // Note: transforms not read
+
+	mapped_file_t mfile;
+	
+	if (!mfile.open(fn) || mfile.size() < sizeof(unsigned)) {
+		cerr << "Error opening model3d file for read: " << fn << endl;
+		return 0;
+	}
+	char const *const data(mfile.get_data());
+	clear(); // ???
+
+	if (*(unsigned const *)data == MAGIC_NUMBER) { // version 1 file: read everything from the stream
+		cout << "Reading model3d file " << fn << endl;
+		membuf_t buf(data, data+mfile.size());
+		istream in(&buf);
+		read_uint(in); // skip magic number
+		return read_body(in, nullptr);
+	}
+	model3d_file_header_t header;
+	bool valid(mfile.size() >= sizeof(header));
+	if (valid) {memcpy(&header, data, sizeof(header));}
+
+	if (!valid || !model3d_file_header_t().is_compatible(header)) {
+		cerr << "Error reading model3d file " << fn << ": Invalid or incompatible file format (magic number or version check failed)." << endl;
+		return 0;
+	}
+	size_t const table_bytes(header.num_arrays*sizeof(model3d_array_table_t::entry_t));
+	size_t const table_start(header.header_size + header.meta_size);
+
+	if (header.file_size != mfile.size() || table_start + table_bytes > mfile.size()) {
+		cerr << "Error reading model3d file " << fn << ": File is truncated." << endl;
+		return 0;
+	}
+	model3d_array_table_t at(data, mfile.size());
+	at.entries.resize(header.num_arrays);
+	memcpy(at.entries.data(), data+table_start, table_bytes);
+	uint64_t hash(model3d_data_hash(data+header.header_size, header.meta_size, MODEL3D_HASH_INIT)); // same segments as in write_to_disk()
+	hash = model3d_data_hash(data+table_start, table_bytes, hash);
+
+	for (auto i = at.entries.begin(); i != at.entries.end(); ++i) {
+		if (i->offset + i->size > mfile.size()) {hash = ~header.hash; break;} // invalid entry
+		hash = model3d_data_hash(data+i->offset, i->size, hash);
+	}
+	if (hash != header.hash) {
+		cerr << "Error reading model3d file " << fn << ": Data hash check failed." << endl;
+		return 0;
+	}
+	cout << "Reading model3d file " << fn << endl;
+	membuf_t buf(data+header.header_size, data+table_start);
+	istream in(&buf);
+	return read_body(in, &at);
+}
+
+
 void model3d::proc_model_normals(vector<counted_normal> &cn, int recalc_normals, float nmag_thresh) {
 
 	for (vector<counted_normal>::iterator i = cn.begin(); i != cn.end(); ++i) {
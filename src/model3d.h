@@ -13,6 +13,7 @@
 using namespace std;
 
 typedef map<string, unsigned> string_map_t;
+struct model3d_array_table_t; // for model3d file I/O
 
 unsigned const MAX_VMAP_SIZE     = (1 << 18); // 256K
 unsigned const BUILTIN_TID_START = (1 << 16); // 65K
@@ -246,8 +247,8 @@ public:
 	unsigned get_gpu_mem() const {return (vbo_valid() ? size()*sizeof(T) : 0);}
 	void optimize(unsigned npts) {remove_excess_cap();}
 	void remove_excess_cap() {if (20*vector<T>::size() < 19*vector<T>::capacity()) {vector<T>::shrink_to_fit();}}
-	void write(ostream &out) const;
-	void read(istream &in);
+	void write(ostream &out, model3d_array_table_t *at=nullptr) const;
+	void read(istream &in, model3d_array_table_t *at=nullptr);
 };
 
 
@@ -313,8 +314,8 @@ public:
 	void get_polygons(get_polygon_args_t &args, unsigned npts) const;
 	unsigned get_gpu_mem() const {return (vntc_vect_t<T>::get_gpu_mem() + (this->ivbo_valid() ? indices.size()*sizeof(unsigned) : 0));}
 	void invert_tcy();
-	void write(ostream &out) const;
-	void read(istream &in);
+	void write(ostream &out, model3d_array_table_t *at=nullptr) const;
+	void read(istream &in, model3d_array_table_t *at=nullptr);
 	bool indexing_enabled() const {return !indices.empty();}
 	void mark_need_normalize() {need_normalize = 1;}
 };
@@ -339,8 +340,8 @@ template<typename T> struct vntc_vect_block_t : public deque<indexed_vntc_vect_t
 	void invert_tcy();
 	void simplify_indices(float reduce_target);
 	void merge_into_single_vector();
-	bool write(ostream &out) const;
-	bool read(istream &in);
+	bool write(ostream &out, model3d_array_table_t *at=nullptr) const;
+	bool read(istream &in, model3d_array_table_t *at=nullptr);
 };
 
 
@@ -365,8 +366,8 @@ template<typename T> struct geometry_t {
 	void get_stats(model3d_stats_t &stats) const;
 	void calc_area(float &area, unsigned &ntris);
 	void simplify_indices(float reduce_target);
-	bool write(ostream &out) const {return (triangles.write(out) && quads.write(out));}
-	bool read(istream &in)         {return (triangles.read (in ) && quads.read (in ));}
+	bool write(ostream &out, model3d_array_table_t *at=nullptr) const {return (triangles.write(out, at) && quads.write(out, at));}
+	bool read(istream &in, model3d_array_table_t *at=nullptr)         {return (triangles.read (in,  at) && quads.read (in,  at));}
 };
 
 
@@ -444,8 +445,8 @@ struct material_t : public material_params_t {
 		int enable_alpha_mask, bool is_bmap_pass, point const *const xlate);
 	colorRGBA get_ad_color() const;
 	colorRGBA get_avg_color(texture_manager const &tmgr, int default_tid=-1) const;
-	bool write(ostream &out) const;
-	bool read(istream &in);
+	bool write(ostream &out, model3d_array_table_t *at=nullptr) const;
+	bool read(istream &in, model3d_array_table_t *at=nullptr);
 };
 
 
@@ -501,6 +502,8 @@ class model3d {
 
 	void update_bbox(polygon_t const &poly);
 	void create_indir_texture();
+	bool write_body(ostream &out, model3d_array_table_t *at) const;
+	bool read_body (istream &in,  model3d_array_table_t *at);
 
 public:
 	texture_manager &tmgr; // stores all textures
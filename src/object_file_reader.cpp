@@ -6,13 +6,14 @@
 #include "3DWorld.h"
 #include "model3d.h"
 #include "file_reader.h"
+#include "binary_file_io.h" // for mapped_file_t
 #include <stdint.h>
 #include <algorithm> // for transform()
 #include <cctype> // for tolower()
 #include "fast_atof.h"
 
 
-extern bool use_obj_file_bump_grayscale;
+extern bool use_obj_file_bump_grayscale, obj_file_parallel_parse;
 extern float model_auto_tc_scale, model_mat_lod_thresh;
 extern model3ds all_models;
 
@@ -111,6 +112,190 @@ bool base_file_reader::read_string(char *s, unsigned max_len) {
 }
 
 
+// parallel parse mode: the file is memory mapped and split into line-aligned chunks that are tokenized on all cores,
+// then the chunk results are merged serially in file order so that relative indices, materials, and vertex uniquing match the serial path
+unsigned const OBJ_PARSE_CHUNK_SZ = (1 << 22); // 4MB
+
+enum {OBJ_CMD_FACE=0, OBJ_CMD_OBJECT, OBJ_CMD_GROUP, OBJ_CMD_SMOOTH, OBJ_CMD_USEMTL, OBJ_CMD_MTLLIB};
+
+struct obj_face_ix_t {
+	int vix, tix, nix; // raw (unnormalized) file indices; 0 = not specified
+	obj_face_ix_t() : vix(0), tix(0), nix(0) {}
+};
+
+struct obj_cmd_t { // face or state change, replayed in file order during the merge
+	unsigned type, line, ix, npts; // ix: start in face_ixs for faces, index into strs for names, value for smoothing groups
+	unsigned nv, ntc, nn; // number of v/vt/vn in this chunk before this record, for resolving relative indices
+	obj_cmd_t(unsigned type_, unsigned line_, unsigned ix_, unsigned nv_, unsigned ntc_, unsigned nn_) :
+		type(type_), line(line_), ix(ix_), npts(0), nv(nv_), ntc(ntc_), nn(nn_) {}
+};
+
+struct obj_file_chunk_t {
+	vector<point> v; // already transformed
+	vector<vector3d> n; // already transformed; empty if normals are recalculated
+	vector<point2d<float> > tc;
+	vector<colorRGB> colors; // empty if no vertex in this chunk has a color, otherwise one per vertex
+	vector<obj_face_ix_t> face_ixs;
+	vector<obj_cmd_t> cmds;
+	vector<string> strs;
+	string error, first_unknown;
+	unsigned num_lines, error_line, num_unknown;
+	obj_file_chunk_t() : num_lines(0), error_line(0), num_unknown(0) {}
+};
+
+class obj_chunk_parser_t {
+	char const *pos, *end;
+	char buf[128]; // null terminated copy of the current number for fast_atof()
+
+	static bool is_space(char c) {return (c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r');} // excludes newline
+	static bool is_digit(char c) {return (c >= '0' && c <= '9');}
+	void skip_space() {while (pos < end && is_space(*pos)) {++pos;}}
+	void skip_line () {while (pos < end && *pos != '\n') {++pos;}} // stops at the newline
+
+	char const *get_token_end() const {
+		char const *e(pos);
+		while (e < end && !is_space(*e) && *e != '\n') {++e;}
+		return e;
+	}
+	bool read_float(float &val) {
+		skip_space();
+		char const *const e(get_token_end());
+		if (e == pos || (!is_digit(*pos) && *pos != '.' && *pos != '-')) return 0; // not a fp number
+		size_t const len(min(size_t(e - pos), sizeof(buf)-1));
+		memcpy(buf, pos, len);
+		buf[len] = 0;
+		val = Assimp::fast_atof(buf);
+		pos = e;
+		return 1;
+	}
+	bool read_point(point &p, unsigned req_num=3) {
+		for (unsigned i = 0; i < 3; ++i) {
+			if (!read_float(p[i])) {return (i >= req_num);} // success if we read enough values
+		}
+		return 1;
+	}
+	bool read_int(int &v) { // no leading whitespace allowed
+		char const *p(pos);
+		bool const is_neg(p < end && *p == '-');
+		if (is_neg) {++p;}
+		if (p == end || !is_digit(*p)) return 0;
+		int val(0);
+		for (; p < end && is_digit(*p); ++p) {val = 10*val + int(*p - '0');}
+		v   = (is_neg ? -val : val);
+		pos = p;
+		return 1;
+	}
+	string read_str_to_newline() {
+		skip_space();
+		char const *const start(pos);
+		skip_line();
+		char const *e(pos);
+		while (e > start && is_space(e[-1])) {--e;} // strip trailing whitespace
+		return string(start, e);
+	}
+	bool set_error(obj_file_chunk_t &chunk, char const *const error) {
+		chunk.error      = error;
+		chunk.error_line = chunk.num_lines;
+		return 0;
+	}
+	bool keyword_is(char const *const kw_end, char const *const str) const {
+		size_t const len(strlen(str));
+		return (size_t(kw_end - pos) == len && memcmp(pos, str, len) == 0);
+	}
+public:
+	obj_chunk_parser_t(char const *start, char const *end_) : pos(start), end(end_) {assert(start <= end);}
+
+	bool parse(obj_file_chunk_t &chunk, geom_xform_t const &xf, bool keep_normals) {
+		while (pos < end) {
+			++chunk.num_lines;
+			skip_space();
+			char const *const kw_end(get_token_end());
+
+			if (kw_end == pos || *pos == '#') {} // empty line or comment
+			else if (keyword_is(kw_end, "f")) {
+				pos = kw_end;
+				obj_cmd_t cmd(OBJ_CMD_FACE, chunk.num_lines, chunk.face_ixs.size(), chunk.v.size(), chunk.tc.size(), chunk.n.size());
+
+				while (1) {
+					skip_space();
+					obj_face_ix_t ix;
+					if (!read_int(ix.vix)) break;
+
+					if (pos < end && *pos == '/') {
+						++pos;
+						read_int(ix.tix); // ok to fail
+						if (pos < end && *pos == '/') {++pos; read_int(ix.nix);} // ok to fail
+					}
+					chunk.face_ixs.push_back(ix);
+					++cmd.npts;
+				}
+				chunk.cmds.push_back(cmd);
+			}
+			else if (keyword_is(kw_end, "v")) {
+				pos = kw_end;
+				point p;
+				if (!read_point(p)) {return set_error(chunk, "Error reading vertex");}
+				colorRGB color;
+				float val(0.0);
+
+				if (read_float(val)) { // optional vertex color
+					color.R = val;
+					if (!read_float(color.G) || !read_float(color.B)) {return set_error(chunk, "Error reading vertex color");}
+					if (chunk.colors.empty()) {chunk.colors.resize(chunk.v.size(), WHITE);} // pad colors up to this point with white
+					chunk.colors.push_back(color);
+				}
+				else if (!chunk.colors.empty()) {chunk.colors.push_back(WHITE);}
+				xf.xform_pos(p);
+				chunk.v.push_back(p);
+			}
+			else if (keyword_is(kw_end, "vt")) {
+				pos = kw_end;
+				point tc3d;
+				if (!read_point(tc3d, 2)) {return set_error(chunk, "Error reading texture coord");}
+				chunk.tc.push_back(point2d<float>(tc3d.x, tc3d.y)); // discard tc3d.z
+			}
+			else if (keyword_is(kw_end, "vn")) {
+				pos = kw_end;
+				vector3d normal;
+				if (!read_point(normal)) {return set_error(chunk, "Error reading normal");}
+
+				if (keep_normals) {
+					xf.xform_pos_rm(normal);
+					chunk.n.push_back(normal);
+				}
+			}
+			else if (keyword_is(kw_end, "o") || keyword_is(kw_end, "g")) { // object or group; name is unused
+				chunk.cmds.push_back(obj_cmd_t(((*pos == 'o') ? OBJ_CMD_OBJECT : OBJ_CMD_GROUP), chunk.num_lines, 0, 0, 0, 0));
+			}
+			else if (keyword_is(kw_end, "s")) { // smoothing/shading (off/on or 0/1)
+				pos = kw_end;
+				skip_space();
+				int val(0);
+
+				if (!read_int(val)) {
+					if (!keyword_is(get_token_end(), "off")) {return set_error(chunk, "Error reading smoothing group");}
+					val = 0;
+				}
+				else if (val < 0) {return set_error(chunk, "Error reading smoothing group");}
+				chunk.cmds.push_back(obj_cmd_t(OBJ_CMD_SMOOTH, chunk.num_lines, val, 0, 0, 0));
+			}
+			else if (keyword_is(kw_end, "usemtl") || keyword_is(kw_end, "mtllib")) {
+				unsigned const type((*pos == 'u') ? OBJ_CMD_USEMTL : OBJ_CMD_MTLLIB);
+				pos = kw_end;
+				chunk.cmds.push_back(obj_cmd_t(type, chunk.num_lines, chunk.strs.size(), 0, 0, 0));
+				chunk.strs.push_back(read_str_to_newline());
+			}
+			else if (!keyword_is(kw_end, "l")) { // lines are ignored
+				if (chunk.num_unknown++ == 0) {chunk.first_unknown = string(pos, kw_end);}
+			}
+			skip_line();
+			if (pos < end) {++pos;} // skip the newline
+		} // while
+		return 1;
+	}
+};
+
+
 class object_file_reader : public base_file_reader {
 
 	bool invalid_index_warned;
@@ -169,11 +354,49 @@ protected:
 		c.R = val;
 		return ((read_float(c.G) && read_float(c.B)) ? 1 : 2); // success or error
 	}
+	void print_parse_rate(size_t num_bytes, int time_ms, char const *const mode) const {
+		cout << mode << " parse of " << filename << ": " << (num_bytes >> 20) << " MB at " << (num_bytes/1048576.0)/(0.001*max(time_ms, 1)) << " MB/s" << endl;
+	}
+	bool parse_chunks_parallel(mapped_file_t &file, vector<obj_file_chunk_t> &chunks, geom_xform_t const &xf, bool keep_normals) {
+		if (!file.open(filename)) {cerr << "Error: Could not open object file " << filename << endl; return 0;}
+		char const *const data(file.get_data());
+		size_t const sz(file.size());
+		vector<size_t> bounds(1, 0);
+
+		for (size_t ix = OBJ_PARSE_CHUNK_SZ; ix < sz; ix += OBJ_PARSE_CHUNK_SZ) { // split after the first newline past each chunk boundary
+			size_t const start(max(ix, bounds.back()));
+			if (start >= sz) break;
+			char const *const nl((char const *)memchr(data + start, '\n', sz - start));
+			if (nl == nullptr) break; // in the last line
+			bounds.push_back(nl - data + 1);
+		}
+		bounds.push_back(sz);
+		chunks.resize(bounds.size()-1);
+#pragma omp parallel for schedule(dynamic,1)
+		for (int i = 0; i < (int)chunks.size(); ++i) {
+			obj_chunk_parser_t parser(data + bounds[i], data + bounds[i+1]);
+			parser.parse(chunks[i], xf, keep_normals);
+		}
+		unsigned line_start(0);
+
+		for (auto i = chunks.begin(); i != chunks.end(); ++i) { // report errors in file order
+			if (!i->error.empty()) {
+				cerr << i->error << " from object file " << filename << " near line " << (line_start + i->error_line) << endl;
+				return 0;
+			}
+			if (i->num_unknown > 0) {
+				cerr << "Error: Undefined entry '" << i->first_unknown << "' in object file " << filename << " near line " << line_start << " (" << i->num_unknown << " times)" << endl;
+			}
+			line_start += i->num_lines;
+		}
+		return 1;
+	}
 
 public:
 	object_file_reader(string const &fn) : base_file_reader(fn), invalid_index_warned(0) {}
 
 	bool read(vector<coll_tquad> *ppts, geom_xform_t const &xf, bool verbose) {
+		if (obj_file_parallel_parse) {return read_parallel(ppts, xf, verbose);}
 		RESET_TIME;
 		if (!open_file()) return 0;
 		cout << "Reading object file " << filename << endl;
@@ -218,6 +441,38 @@ public:
 				read_to_newline(fp); // ignore everything else
 			}
 		} // while
+		print_parse_rate(ftell(fp), GET_DELTA_TIME, "Serial");
+		PRINT_TIME("Polygons Load");
+		if (verbose) cout << "v: " << v.size() << ", f: " << (ppts ? ppts->size() : 0) << endl;
+		return 1;
+	}
+	bool read_parallel(vector<coll_tquad> *ppts, geom_xform_t const &xf, bool verbose) {
+		RESET_TIME;
+		cout << "Reading object file " << filename << endl;
+		mapped_file_t file;
+		vector<obj_file_chunk_t> chunks;
+		if (!parse_chunks_parallel(file, chunks, xf, 0)) return 0;
+		print_parse_rate(file.size(), GET_DELTA_TIME, "Parallel");
+		vector<point> v; // vertices
+		polygon_t poly;
+
+		for (auto c = chunks.begin(); c != chunks.end(); ++c) {
+			unsigned const v_base(v.size());
+			vector_add_to(c->v, v);
+			if (!ppts) continue;
+
+			for (auto i = c->cmds.begin(); i != c->cmds.end(); ++i) {
+				if (i->type != OBJ_CMD_FACE) continue;
+				poly.resize(0);
+
+				for (unsigned p = 0; p < i->npts; ++p) {
+					int vix(c->face_ixs[i->ix + p].vix);
+					normalize_index(vix, (v_base + i->nv));
+					poly.emplace_back(v[vix], zero_vector, 0.0, 0.0);
+				}
+				split_polygon(poly, *ppts, POLY_COPLANAR_THRESH);
+			}
+		} // for c
 		PRINT_TIME("Polygons Load");
 		if (verbose) cout << "v: " << v.size() << ", f: " << (ppts ? ppts->size() : 0) << endl;
 		return 1;
@@ -529,13 +784,10 @@ public:
 		return 1;
 	}
 
-	bool read(geom_xform_t const &xf, int recalc_normals, bool verbose) {
-		RESET_TIME;
-		if (!open_file()) return 0;
-		cout << "Reading object file " << filename << endl;
-		unsigned const block_size = (1 << 18); // 256K
-		int cur_mat_id(-1);
-		unsigned smoothing_group(0), prev_smoothing_group(0), num_faces(0), num_objects(0), num_groups(0), obj_group_id(0);
+	struct parse_state_t { // geometry and state accumulated while parsing, shared by the serial and parallel parsers
+		int cur_mat_id;
+		unsigned smoothing_group, prev_smoothing_group, num_objects, num_groups, obj_group_id;
+		bool is_textured, had_npts_error;
 		vector<point> v; // vertices
 		vector<vector3d> n; // normals
 		// weighted_normal can also be used, but doesn't work well; see face_weight_avg mode selected by recalc_normals==2
@@ -544,12 +796,104 @@ public:
 		vector<colorRGB> colors; // vertex colors
 		deque<poly_data_block> pblocks;
 		set<string> loaded_mat_libs;
+
+		parse_state_t() : cur_mat_id(-1), smoothing_group(0), prev_smoothing_group(0), num_objects(0), num_groups(0), obj_group_id(0), is_textured(0), had_npts_error(0) {
+			tc.push_back(point2d<float>(0.0, 0.0)); // default tex coords
+			n.push_back(zero_vector); // default normal
+		}
+	};
+
+	poly_data_block &start_face(parse_state_t &ps) {
+		unsigned const block_size = (1 << 18); // 256K
+		model.mark_mat_as_used(ps.cur_mat_id);
+
+		if (ps.pblocks.empty() || ps.pblocks.back().pts.size() >= block_size || ps.smoothing_group != ps.prev_smoothing_group) { // create a new block
+			if (!ps.pblocks.empty()) {
+				remove_excess_cap(ps.pblocks.back().polys);
+				remove_excess_cap(ps.pblocks.back().pts);
+			}
+			ps.pblocks.push_back(poly_data_block());
+			ps.prev_smoothing_group = ps.smoothing_group;
+		}
+		poly_data_block &pb(ps.pblocks.back());
+		pb.polys.push_back(poly_header_t(ps.cur_mat_id, ps.obj_group_id));
+		return pb;
+	}
+	void finish_face(parse_state_t &ps, unsigned pix, unsigned approx_line, int recalc_normals) { // pix is the first point of the face
+		poly_data_block &pb(ps.pblocks.back());
+		unsigned const npts(pb.polys.back().npts);
+
+		if (npts < 3) {
+			if (!ps.had_npts_error) {cerr << "Error near line " << approx_line << ": face has only " << npts << " vertices." << endl; ps.had_npts_error = 1;}
+			pb.pts.resize(pix);
+			pb.polys.pop_back(); // remove pts and polygon
+			return; // skip it
+		}
+		vector<point> const &v(ps.v);
+		vector3d &normal(pb.polys.back().n);
+				
+		for (unsigned i = pix; i < pix+npts-2; ++i) { // find a nonzero normal
+			normal = cross_product((v[pb.pts[i+1].vix] - v[pb.pts[i].vix]), (v[pb.pts[i+2].vix] - v[pb.pts[i].vix])); // backwards?
+			// if we disable this normalize() we will weight normal contributions by polygon area,
+			// but we have to change the code below and it causes problems with vertex uniquing
+			normal.normalize();
+			if (normal != zero_vector) break; // got a good normal
+		}
+		if (recalc_normals) {
+			bool const face_weight_avg(recalc_normals == 2 && (npts == 3 || npts == 4)); // only works for quads and triangles
+			float face_area(0.0);
+
+			if (face_weight_avg) {
+				point face_pts[4];
+				for (unsigned i = 0; i < npts; ++i) {face_pts[i] = v[pb.pts[i+pix].vix];}
+				face_area = polygon_area(face_pts, npts);
+			}
+			for (unsigned i = pix; i < pix+npts; ++i) {
+				unsigned const vix(pb.pts[i].vix);
+				assert((unsigned)vix < ps.vn.size());
+				bool const using_texgen(ps.is_textured && model_auto_tc_scale > 0.0 && pb.pts[i].tix == 0);
+				counted_normal &cn(ps.vn[vix]);
+
+				if (cn.is_valid() && (using_texgen || dot_product(normal, cn.get_norm()) < 0.25)) { // normals in disagreement (or using texgen)
+					cn = zero_vector; // zero it out so that it becomes invalid later
+				}
+				else if (face_weight_avg) {cn.add_normal(face_area*normal);} // face weighted average
+				else {cn.add_normal(normal);} // unweighted average of normals
+			}
+		}
+	}
+	bool use_material(parse_state_t &ps, string const &material_name, unsigned approx_line) {
+		if (material_name.empty()) {
+			if (!had_empty_mat_error) {cerr << "Error reading material from object file " << filename << " near line " << approx_line << endl;}
+			had_empty_mat_error = 1;
+			return 0;
+		}
+		ps.cur_mat_id = model.find_material(material_name);
+				
+		if (ps.cur_mat_id >= 0) { // material was valid
+			int const tid(model.get_material(ps.cur_mat_id).d_tid);
+			ps.is_textured = (tid >= 0 && model.tmgr.get_tex_avg_color(tid) != WHITE); // no texture, or all white texture
+		}
+		return 1;
+	}
+	bool use_mat_lib(parse_state_t &ps, string const &mat_lib, unsigned approx_line) {
+		if (mat_lib.empty()) {
+			cerr << "Error reading material library from object file " << filename << " near line " << approx_line << endl;
+			return 0;
+		}
+		if (!try_load_mat_lib(mat_lib, ps.loaded_mat_libs, approx_line)) {
+			//return 0; // nonfatal
+		}
+		return 1;
+	}
+
+	bool parse_serial(parse_state_t &ps, geom_xform_t const &xf, int recalc_normals) {
+		RESET_TIME;
+		if (!open_file()) return 0;
 		char s[MAX_CHARS];
 		string material_name, mat_lib, group_name, object_name;
-		tc.push_back(point2d<float>(0.0, 0.0)); // default tex coords
-		n.push_back(zero_vector); // default normal
 		unsigned approx_line(0);
-		bool is_textured(0), had_npts_error(0);
+		vector<point> &v(ps.v);
 
 		while (read_string(s, MAX_CHARS)) {
 			++approx_line;
@@ -562,20 +906,9 @@ public:
 				read_to_newline(fp); // ignore
 			}
 			else if (strcmp(s, "f") == 0) { // face
-				model.mark_mat_as_used(cur_mat_id);
-
-				if (pblocks.empty() || pblocks.back().pts.size() >= block_size || smoothing_group != prev_smoothing_group) { // create a new block
-					if (!pblocks.empty()) {
-						remove_excess_cap(pblocks.back().polys);
-						remove_excess_cap(pblocks.back().pts);
-					}
-					pblocks.push_back(poly_data_block());
-					prev_smoothing_group = smoothing_group;
-				}
-				poly_data_block &pb(pblocks.back());
-				pb.polys.push_back(poly_header_t(cur_mat_id, obj_group_id));
+				poly_data_block &pb(start_face(ps));
 				unsigned &npts(pb.polys.back().npts);
-				unsigned const pix((unsigned)pb.pts.size()), pts_start(pb.pts.size());
+				unsigned const pts_start(pb.pts.size());
 				int vix(0), tix(0), nix(0);
 
 				while (read_int(vix)) { // read vertex index
@@ -585,14 +918,14 @@ public:
 
 					if (c == '/') {
 						if (read_int(tix)) { // read text coord index
-							normalize_index(tix, (unsigned)tc.size()-1); // account for tc[0]
+							normalize_index(tix, (unsigned)ps.tc.size()-1); // account for tc[0]
 							vntc_ix.tix = tix+1; // account for tc[0]
 						}
 						int const c2(get_next_char());
 
 						if (c2 == '/') {
 							if (read_int(nix) && !recalc_normals) { // read normal index
-								normalize_index(nix, (unsigned)n.size()-1); // account for n[0]
+								normalize_index(nix, (unsigned)ps.n.size()-1); // account for n[0]
 								vntc_ix.nix = nix+1; // account for n[0]
 							} // else the normal will be recalculated later
 						}
@@ -602,46 +935,11 @@ public:
 					pb.pts.push_back(vntc_ix);
 					++npts;
 				} // end while vertex
-				if (npts < 3) {
-					if (!had_npts_error) {cerr << "Error near line " << approx_line << ": face has only " << npts << " vertices." << endl; had_npts_error = 1;}
-					pb.pts.resize(pts_start);
-					pb.polys.pop_back(); // remove pts and polygon
-					continue; // skip it
-				}
-				vector3d &normal(pb.polys.back().n);
-				
-				for (unsigned i = pix; i < pix+npts-2; ++i) { // find a nonzero normal
-					normal = cross_product((v[pb.pts[i+1].vix] - v[pb.pts[i].vix]), (v[pb.pts[i+2].vix] - v[pb.pts[i].vix])); // backwards?
-					// if we disable this normalize() we will weight normal contributions by polygon area,
-					// but we have to change the code below and it causes problems with vertex uniquing
-					normal.normalize();
-					if (normal != zero_vector) break; // got a good normal
-				}
-				if (recalc_normals) {
-					bool const face_weight_avg(recalc_normals == 2 && (npts == 3 || npts == 4)); // only works for quads and triangles
-					float face_area(0.0);
-
-					if (face_weight_avg) {
-						point face_pts[4];
-						for (unsigned i = 0; i < npts; ++i) {face_pts[i] = v[pb.pts[i+pix].vix];}
-						face_area = polygon_area(face_pts, npts);
-					}
-					for (unsigned i = pix; i < pix+npts; ++i) {
-						unsigned const vix(pb.pts[i].vix);
-						assert((unsigned)vix < vn.size());
-						bool const using_texgen(is_textured && model_auto_tc_scale > 0.0 && pb.pts[i].tix == 0);
-
-						if (vn[vix].is_valid() && (using_texgen || dot_product(normal, vn[vix].get_norm()) < 0.25)) { // normals in disagreement (or using texgen)
-							vn[vix] = zero_vector; // zero it out so that it becomes invalid later
-						}
-						else if (face_weight_avg) {vn[vix].add_normal(face_area*normal);} // face weighted average
-						else {vn[vix].add_normal(normal);} // unweighted average of normals
-					}
-				}
+				finish_face(ps, pts_start, approx_line, recalc_normals);
 			}
 			else if (strcmp(s, "v") == 0) { // vertex
 				v.push_back(point());
-				if (recalc_normals) {vn.push_back(counted_normal());} // vertex normal
+				if (recalc_normals) {ps.vn.push_back(counted_normal());} // vertex normal
 			
 				if (!read_point(v.back())) {
 					cerr << "Error reading vertex from object file " << filename << " near line " << approx_line << endl;
@@ -651,10 +949,10 @@ public:
 				int const color_ret(read_optional_color_RGB(color));
 				if (color_ret == 2) {cerr << "Error reading vertex color from object file " << filename << " near line " << approx_line << endl; return 0;}
 				else if (color_ret == 1) {
-					if (colors.empty()) {colors.resize(v.size()-1, WHITE);} // pad colors up to this point with white
-					colors.push_back(color);
+					if (ps.colors.empty()) {ps.colors.resize(v.size()-1, WHITE);} // pad colors up to this point with white
+					ps.colors.push_back(color);
 				}
-				else if (!colors.empty()) {colors.push_back(WHITE);} // color not specified, and in colors mode, pad with white
+				else if (!ps.colors.empty()) {ps.colors.push_back(WHITE);} // color not specified, and in colors mode, pad with white
 				xf.xform_pos(v.back());
 			}
 			else if (strcmp(s, "vt") == 0) { // tex coord
@@ -664,7 +962,7 @@ public:
 					cerr << "Error reading texture coord from object file " << filename << " near line " << approx_line << endl;
 					return 0;
 				}
-				tc.push_back(point2d<float>(tc3d.x, tc3d.y)); // discard tc3d.z
+				ps.tc.push_back(point2d<float>(tc3d.x, tc3d.y)); // discard tc3d.z
 			}
 			else if (strcmp(s, "vn") == 0) { // normal
 				vector3d normal;
@@ -675,7 +973,7 @@ public:
 				}
 				if (!recalc_normals) {
 					xf.xform_pos_rm(normal);
-					n.push_back(normal);
+					ps.n.push_back(normal);
 				}
 			}
 			else if (strcmp(s, "l") == 0) { // line
@@ -683,48 +981,30 @@ public:
 			}
 			else if (strcmp(s, "o") == 0) { // object definition
 				read_str_to_newline(fp, object_name); // can be empty?
-				++num_objects;
-				++obj_group_id;
+				++ps.num_objects;
+				++ps.obj_group_id;
 			}
 			else if (strcmp(s, "g") == 0) { // group
 				read_str_to_newline(fp, group_name); // can be empty
-				++num_groups;
-				++obj_group_id;
+				++ps.num_groups;
+				++ps.obj_group_id;
 			}
 			else if (strcmp(s, "s") == 0) { // smoothing/shading (off/on or 0/1)
-				if (!read_uint(smoothing_group)) {
+				if (!read_uint(ps.smoothing_group)) {
 					if (!read_string(s, MAX_CHARS) || strcmp(s, "off") != 0) {
 						cerr << "Error reading smoothing group from object file " << filename << " near line " << approx_line << endl;
 						return 0;
 					}
-					smoothing_group = 0;
+					ps.smoothing_group = 0;
 				}
 			}
 			else if (strcmp(s, "usemtl") == 0) { // use material
 				read_str_to_newline(fp, material_name);
-
-				if (material_name.empty()) {
-					if (!had_empty_mat_error) {cerr << "Error reading material from object file " << filename << " near line " << approx_line << endl;}
-					had_empty_mat_error = 1;
-					return 0;
-				}
-				cur_mat_id = model.find_material(material_name);
-				
-				if (cur_mat_id >= 0) { // material was valid
-					int const tid(model.get_material(cur_mat_id).d_tid);
-					is_textured = (tid >= 0 && model.tmgr.get_tex_avg_color(tid) != WHITE); // no texture, or all white texture
-				}
+				if (!use_material(ps, material_name, approx_line)) return 0;
 			}
 			else if (strcmp(s, "mtllib") == 0) { // material library
 				read_str_to_newline(fp, mat_lib);
-
-				if (mat_lib.empty()) {
-					cerr << "Error reading material library from object file " << filename << " near line " << approx_line << endl;
-					return 0;
-				}
-				if (!try_load_mat_lib(mat_lib, loaded_mat_libs, approx_line)) {
-					//return 0; // nonfatal
-				}
+				if (!use_mat_lib(ps, mat_lib, approx_line)) return 0;
 			}
 			else {
 				cerr << "Error: Undefined entry '" << s << "' in object file " << filename << " near line " << approx_line << endl;
@@ -732,11 +1012,83 @@ public:
 				//return 0;
 			}
 		} // while
-		remove_excess_cap(v);
-		remove_excess_cap(n);
-		remove_excess_cap(tc);
+		print_parse_rate(ftell(fp), GET_DELTA_TIME, "Serial");
+		return 1;
+	}
+
+	bool parse_parallel(parse_state_t &ps, geom_xform_t const &xf, int recalc_normals) {
+		RESET_TIME;
+		mapped_file_t file;
+		vector<obj_file_chunk_t> chunks;
+		if (!parse_chunks_parallel(file, chunks, xf, !recalc_normals)) return 0;
+		unsigned line_start(0);
+
+		for (auto c = chunks.begin(); c != chunks.end(); ++c) { // merge chunks in file order
+			unsigned const v_base(ps.v.size()), tc_base(ps.tc.size()-1), n_base(ps.n.size()-1); // account for tc[0] and n[0]
+			vector_add_to(c->v,  ps.v);
+			vector_add_to(c->tc, ps.tc);
+			vector_add_to(c->n,  ps.n);
+			if (recalc_normals) {ps.vn.resize(ps.v.size());}
+
+			if (!c->colors.empty()) { // pad colors up to this chunk with white
+				ps.colors.resize(v_base, WHITE);
+				vector_add_to(c->colors, ps.colors);
+			}
+			else if (!ps.colors.empty()) {ps.colors.resize(ps.v.size(), WHITE);} // in colors mode, pad with white
+			
+			for (auto i = c->cmds.begin(); i != c->cmds.end(); ++i) {
+				unsigned const approx_line(line_start + i->line);
+
+				switch (i->type) {
+				case OBJ_CMD_FACE: {
+					poly_data_block &pb(start_face(ps));
+					unsigned const pts_start(pb.pts.size());
+
+					for (unsigned p = 0; p < i->npts; ++p) {
+						obj_face_ix_t const &ix(c->face_ixs[i->ix + p]);
+						int vix(ix.vix), tix(ix.tix), nix(ix.nix);
+						normalize_index(vix, (v_base + i->nv));
+						vntc_ix_t vntc_ix(vix, 0, 0);
+						if (tix != 0) {normalize_index(tix, (tc_base + i->ntc)); vntc_ix.tix = tix+1;} // account for tc[0]
+						if (nix != 0 && !recalc_normals) {normalize_index(nix, (n_base + i->nn)); vntc_ix.nix = nix+1;} // account for n[0]
+						pb.pts.push_back(vntc_ix);
+					}
+					pb.polys.back().npts = i->npts;
+					finish_face(ps, pts_start, approx_line, recalc_normals);
+					break;
+				}
+				case OBJ_CMD_OBJECT: ++ps.num_objects; ++ps.obj_group_id; break;
+				case OBJ_CMD_GROUP:  ++ps.num_groups;  ++ps.obj_group_id; break;
+				case OBJ_CMD_SMOOTH: ps.smoothing_group = i->ix; break;
+				case OBJ_CMD_USEMTL: if (!use_material(ps, c->strs[i->ix], approx_line)) return 0; break;
+				case OBJ_CMD_MTLLIB: if (!use_mat_lib (ps, c->strs[i->ix], approx_line)) return 0; break;
+				default: assert(0);
+				}
+			} // for i
+			line_start += c->num_lines;
+			*c = obj_file_chunk_t(); // free memory
+		} // for c
+		print_parse_rate(file.size(), GET_DELTA_TIME, "Parallel");
+		return 1;
+	}
+
+	bool read(geom_xform_t const &xf, int recalc_normals, bool verbose) {
+		RESET_TIME;
+		cout << "Reading object file " << filename << endl;
+		parse_state_t ps;
+		if (!(obj_file_parallel_parse ? parse_parallel(ps, xf, recalc_normals) : parse_serial(ps, xf, recalc_normals))) return 0;
+		vector<point> const &v(ps.v);
+		vector<vector3d> const &n(ps.n);
+		vector<counted_normal> &vn(ps.vn);
+		vector<point2d<float> > const &tc(ps.tc);
+		vector<colorRGB> const &colors(ps.colors);
+		deque<poly_data_block> &pblocks(ps.pblocks);
+		unsigned num_faces(0);
+		remove_excess_cap(ps.v);
+		remove_excess_cap(ps.n);
+		remove_excess_cap(ps.tc);
 		remove_excess_cap(vn);
-		remove_excess_cap(colors);
+		remove_excess_cap(ps.colors);
 		PRINT_TIME("Object File Load");
 		model.load_all_used_tids(); // need to load the textures here to get the colors
 		PRINT_TIME("Model Texture Load");
@@ -790,7 +1142,7 @@ public:
 		if (verbose) {
 			size_t const nn(recalc_normals ? vn.size() : n.size());
 			cout << "verts: " << v.size() << ", normals: " << nn << ", tcs: " << tc.size() << ", colors: " << colors.size() << ", faces: " << num_faces
-				 << ", objects: " << num_objects << ", groups: " << num_groups << ", blocks: " << num_blocks << endl;
+				 << ", objects: " << ps.num_objects << ", groups: " << ps.num_groups << ", blocks: " << num_blocks << endl;
 			model.show_stats();
 		}
 		return 1;
@@ -124,11 +124,14 @@ void register_ped_coll(pedestrian_t &p1, pedestrian_t &p2, unsigned pid1, unsign
 	p2.collided = p2.ped_coll = 1; p2.colliding_ped = pid1;
 }
 
-bool pedestrian_t::check_ped_ped_coll_range(vector<pedestrian_t> &peds, unsigned pid, unsigned ped_start, unsigned target_plot, float prox_radius, vector3d &force) {
+// cands are nearby peds from the ped grid, in increasing index order
+bool pedestrian_t::check_ped_ped_coll_range(vector<pedestrian_t> &peds, unsigned pid, vector<unsigned> const &cands, unsigned min_ix, unsigned target_plot, float prox_radius, vector3d &force) {
 	float const prox_radius_sq(prox_radius*prox_radius);
 
-	for (auto i = peds.begin()+ped_start; i != peds.end(); ++i) { // check every ped until we exit target_plot
-		if (i->plot != target_plot) break; // moved to a new plot, no collision, done; since plots are globally unique across cities, we don't need to check cities
+	for (auto ix = cands.begin(); ix != cands.end(); ++ix) {
+		if (*ix < min_ix) continue;
+		auto const i(peds.begin() + *ix);
+		if (i->plot != target_plot) continue; // since plots are globally unique across cities, we don't need to check cities
 		float const dist_sq(p2p_dist_xy_sq(pos, i->pos));
 		if (dist_sq > prox_radius_sq) continue; // proximity test
 		float const r_sum(0.6f*(radius + i->radius)); // using a smaller radius to allow peds to get close to each other
@@ -155,25 +158,29 @@ bool pedestrian_t::check_ped_ped_coll(ped_manager_t const &ped_mgr, vector<pedes
 	float const timestep(2.0*TICKS_PER_SECOND), lookahead_dist(timestep*speed); // how far we can travel in 2s
 	float const prox_radius(1.2*radius + lookahead_dist); // assume other ped has a similar radius
 	vector3d force(zero_vector);
-	if (check_ped_ped_coll_range(peds, pid, pid+1, plot, prox_radius, force)) return 1;
+	static thread_local vector<unsigned> cands;
+	ped_mgr.get_ped_grid().get_peds_near(pos, prox_radius, cands);
+	if (check_ped_ped_coll_range(peds, pid, cands, pid+1, plot, prox_radius, force)) return 1; // only check peds after this one
 
 	if (in_the_road && next_plot != plot) {
 		// need to check for coll between two peds crossing the street from different sides, since they won't be in the same plot while in the street
-		unsigned const ped_ix(ped_mgr.get_first_ped_at_plot(next_plot));
-		assert(ped_ix <= peds.size()); // could be at the end
-		if (check_ped_ped_coll_range(peds, pid, ped_ix, next_plot, prox_radius, force)) return 1;
+		if (check_ped_ped_coll_range(peds, pid, cands, 0, next_plot, prox_radius, force)) return 1;
 	}
 	if (force != zero_vector) {set_velocity((0.1*delta_dir)*force + ((1.0 - delta_dir)/speed)*vel);} // apply ped repulsive force
 	return 0;
 }
 
-bool pedestrian_t::check_ped_ped_coll_stopped(vector<pedestrian_t> &peds, unsigned pid) {
+bool pedestrian_t::check_ped_ped_coll_stopped(ped_manager_t const &ped_mgr, vector<pedestrian_t> &peds, unsigned pid) {
 	if (in_building) return 0; // no ped-ped collisions in buildings (yet)
 	assert(pid < peds.size());
+	static thread_local vector<unsigned> cands;
+	ped_mgr.get_ped_grid().get_peds_near(pos, 1.2*radius, cands); // assume other ped has a similar radius
 
 	// Note: shouldn't have to check peds in the next plot, assuming that if we're stopped, they likely are as well, and won't be walking toward us
-	for (auto i = peds.begin()+pid+1; i != peds.end(); ++i) { // check every ped until we exit target_plot
-		if (i->plot != plot) break; // moved to a new plot, no collision, done; since plots are globally unique across cities, we don't need to check cities
+	for (auto ix = cands.begin(); ix != cands.end(); ++ix) {
+		if (*ix <= pid) continue; // only check peds after this one
+		auto const i(peds.begin() + *ix);
+		if (i->plot != plot) continue; // since plots are globally unique across cities, we don't need to check cities
 		if (!dist_xy_less_than(pos, i->pos, 0.6f*(radius + i->radius))) continue; // no collision
 		i->collided = i->ped_coll = 1; i->colliding_ped = pid;
 		return 1; // Note: could omit this return and continue processing peds
@@ -181,6 +188,67 @@ bool pedestrian_t::check_ped_ped_coll_stopped(vector<pedestrian_t> &peds, unsign
 	return 0;
 }
 
+
+void ped_grid_t::build(vector<pedestrian_t> const &peds) {
+	unsigned const num(peds.size());
+	float max_prox_radius(0.0), max_radius(0.0);
+
+	for (auto i = peds.begin(); i != peds.end(); ++i) { // size cells to the largest ped-ped query radius, so that queries only touch 3x3 cells
+		max_eq(max_prox_radius, (1.2f*i->radius + 2.0f*TICKS_PER_SECOND*i->speed));
+		max_eq(max_radius, i->radius);
+	}
+	cell_sz     = max(max_prox_radius, TOLERANCE);
+	cell_sz_inv = 1.0/cell_sz;
+	pad         = max_radius; // peds move much less than their radius per frame
+	unsigned table_sz(1);
+	while (table_sz < 2*num) {table_sz <<= 1;}
+	hash_mask = table_sz - 1;
+	px.resize(num);
+	py.resize(num);
+	vector<unsigned> bucket(num);
+
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < (int)num; ++i) {
+		point const &pos(peds[i].pos);
+		px[i] = pos.x;
+		py[i] = pos.y;
+		bucket[i] = get_bucket(get_cell(pos.x), get_cell(pos.y));
+	}
+	// counting sort of ped indices by bucket
+	cell_start.clear();
+	cell_start.resize(table_sz+1, 0);
+	for (unsigned i = 0; i < num; ++i) {++cell_start[bucket[i]+1];}
+	for (unsigned b = 0; b < table_sz; ++b) {cell_start[b+1] += cell_start[b];}
+	ped_ixs.resize(num);
+	vector<unsigned> pos(cell_start.begin(), cell_start.end()-1);
+	for (unsigned i = 0; i < num; ++i) {ped_ixs[pos[bucket[i]]++] = i;} // peds are in increasing order within each bucket
+}
+
+void ped_grid_t::get_peds_near(point const &pos, float radius, vector<unsigned> &ixs) const { // returns ped indices in increasing order
+	ixs.clear();
+	if (empty()) return;
+	float const r(radius + pad), r_sq(r*r);
+	int const x1(get_cell(pos.x - r)), x2(get_cell(pos.x + r)), y1(get_cell(pos.y - r)), y2(get_cell(pos.y + r));
+	unsigned num_buckets(0);
+
+	for (int y = y1; y <= y2; ++y) {
+		for (int x = x1; x <= x2; ++x, ++num_buckets) {
+			unsigned const b(get_bucket(x, y));
+
+			for (unsigned n = cell_start[b]; n < cell_start[b+1]; ++n) {
+				unsigned const i(ped_ixs[n]);
+				float const dx(px[i] - pos.x), dy(py[i] - pos.y);
+				if (dx*dx + dy*dy <= r_sq) {ixs.push_back(i);}
+			}
+		}
+	}
+	if (num_buckets > 1) { // multiple cells may map to the same bucket
+		sort(ixs.begin(), ixs.end());
+		ixs.erase(unique(ixs.begin(), ixs.end()), ixs.end());
+	}
+}
+
+
 bool pedestrian_t::try_place_in_plot(cube_t const &plot_cube, vect_cube_t const &colliders, unsigned plot_id, rand_gen_t &rgen) {
 	pos    = rand_xy_pt_in_cube(plot_cube, radius, rgen);
 	pos.z += radius; // place on top of the plot
@@ -331,6 +399,33 @@ bool path_finder_t::find_best_path() {
 	return found_path();
 }
 
+unsigned const MAX_PATH_CACHE_SIZE = 16384; // flush the cache when it gets this large; stale collider sets simply stop matching
+float    const PATH_CACHE_QUANT    = 10.0; // entry/dest quantization cell size, in units of gap (gap is 0.1*radius for city peds)
+
+path_finder_t::path_cache_key_t path_finder_t::get_path_cache_key() const {
+	// hash everything the path search depends on other than pos and dest; this includes the plot bounds, so it acts as the plot ID
+	uint64_t hash(14695981039346656037ULL); // FNV-1a
+	auto hash_floats([&hash](float const *v, unsigned num) {
+		for (unsigned n = 0; n < num; ++n) {
+			uint32_t bits;
+			memcpy(&bits, (v + n), sizeof(uint32_t));
+			hash = (hash ^ bits)*1099511628211ULL;
+		}
+	});
+	for (auto i = avoid.begin(); i != avoid.end(); ++i) {hash_floats(&i->d[0][0], 4);} // x/y only
+	hash_floats(&plot_bcube.d[0][0], 4);
+	hash_floats(&gap, 1);
+	path_cache_key_t key;
+	key.avoid_hash = hash;
+	float const qinv(1.0/(PATH_CACHE_QUANT*max(gap, TOLERANCE)));
+
+	for (unsigned d = 0; d < 2; ++d) {
+		key.entry[d] = int(floor(pos [d]*qinv));
+		key.dest [d] = int(floor(dest[d]*qinv));
+	}
+	return key;
+}
+
 // Note: avoid must be non-overlapping and should be non-adjacent; even better if cubes are separated enough that peds can pass between them (> 2*ped radius)
 // return values: 0=failed, 1=valid path, 2=init contained, 3=straight path (no collisions)
 unsigned path_finder_t::run(point const &pos_, point const &dest_, cube_t const &plot_bcube_, float gap_, point &new_dest) {
@@ -368,7 +463,34 @@ unsigned path_finder_t::run(point const &pos_, point const &dest_, cube_t const
 			}
 		} // for i
 	}
-	if (!find_best_path()) return 0; // if we fail to find a path, leave new_dest unchanged
+	// peds in the same plot tend to path around the same colliders to the same few destinations, so reuse earlier results;
+	// the init contained and clamped cases depend on the exact pos, and the debug path finder needs the full search state, so don't cache those
+	bool const use_cache(!debug && next_pt_ix == 1);
+	path_cache_key_t key;
+
+	if (use_cache) {
+		key = get_path_cache_key();
+		auto it(path_cache.find(key));
+
+		if (it != path_cache.end()) {
+			vector<point> const &path(it->second);
+			assert(path.size() > 1);
+			point const next_pt(path[1].x, path[1].y, pos.z);
+			// the cached path was computed from a nearby pos; only use it if we can walk straight to its next point
+			if (!line_int_cubes_xy(pos, next_pt, avoid)) {new_dest = next_pt; return 1;}
+		}
+	}
+	bool const found(find_best_path());
+
+	if (use_cache) { // add or replace the cache entry
+		// only cache successes: a failure depends on the exact pos and dest, and another pos in the same cell may still have a path
+		if (!found) {path_cache.erase(key);}
+		else {
+			if (path_cache.size() >= MAX_PATH_CACHE_SIZE) {path_cache.clear();}
+			path_cache[key] = get_best_path();
+		}
+	}
+	if (!found) return 0; // if we fail to find a path, leave new_dest unchanged
 	vector<point> const &path(get_best_path());
 	assert(next_pt_ix < path.size());
 	new_dest = path[next_pt_ix]; // set dest to next point on the best path
@@ -498,7 +620,7 @@ void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds
 			go(); // back up or turn so that we don't walk forward into the street? move() should attempt to rotate in place
 		}
 		else {
-			check_ped_ped_coll_stopped(peds, pid); // still need to check for other peds colliding with us; this doesn't always work
+			check_ped_ped_coll_stopped(ped_mgr, peds, pid); // still need to check for other peds colliding with us; this doesn't always work
 			collided = ped_coll = 0;
 			return;
 		}
@@ -700,7 +822,7 @@ void ped_manager_t::sort_by_city_and_plot() {
 		for (unsigned city = 0; city+1 < by_city.size(); ++city) {
 			if (!need_to_sort_city[city]) continue;
 			need_to_sort_city[city] = 0;
-			sort((peds.begin() + by_plot[by_city[city].plot_ix]), (peds.begin() + by_plot[by_city[city+1].plot_ix]), ped_by_plot());
+			resort_mostly_sorted((peds.begin() + by_plot[by_city[city].plot_ix]), (peds.begin() + by_plot[by_city[city+1].plot_ix]), ped_by_plot()); // only peds that changed plots move
 		}
 	}
 	// construct by_plot
@@ -815,6 +937,7 @@ void ped_manager_t::next_frame() {
 		if (first_frame) { // choose initial ped destinations (must be after building setup, etc.)
 			for (auto i = peds.begin(); i != peds.end(); ++i) {choose_dest_building_or_parked_car(*i);}
 		}
+		ped_grid.build(peds);
 		for (auto i = peds.begin(); i != peds.end(); ++i) {i->next_frame(*this, peds, (i - peds.begin()), rgen, delta_dir);}
 		if (need_to_sort_peds) {sort_by_city_and_plot();}
 		first_frame = 0;
@@ -12,6 +12,7 @@ float const DECAL_OFFSET       = 0.001;
 extern float CAMERA_RADIUS, C_STEP_HEIGHT;
 
 struct quad_batch_draw;
+class cobj_bvh_tree;
 
 
 struct spark_t {
@@ -271,6 +272,7 @@ class vert_coll_detector {
 	bool safe_norm_div(float rad, float radius, vector3d &norm);
 	void check_cobj_intersect(int index, bool enable_cfs, bool player_step);
 	void init_reset_pos();
+	void init_check_coll();
 public:
 	vert_coll_detector(dwobject &obj_, int obj_index_, int do_coll_funcs_, int iter_, vector3d *cnorm_,
 		vector3d const &mdir=zero_vector, bool skip_dynamic_=0, bool only_drawn_=0, int only_cobj_=-1, bool skip_movable_=0) :
@@ -281,6 +283,7 @@ public:
 
 	void check_cobj(int index);
 	int check_coll();
+	int check_coll_tree(cobj_bvh_tree const &tree); // for benchmarking
 };
 
 
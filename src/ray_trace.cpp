@@ -8,6 +8,8 @@
 #include "binary_file_io.h"
 #include <atomic>
 #include <thread>
+#include <unordered_map>
+#include <glm/gtc/packing.hpp> // for packHalf1x16()/unpackHalf1x16()
 
 
 bool const COLOR_FROM_COBJ_TEX = 0; // 0 = fast/average color, 1 = true color
@@ -25,6 +27,12 @@ unsigned NPTS(50000), NRAYS(40000), LOCAL_RAYS(1000000), GLOBAL_RAYS(1000000), D
 std::atomic<unsigned long long> tot_rays(0), num_hits(0), cells_touched(0);
 unsigned const NUM_RAY_SPLITS [NUM_LIGHTING_TYPES] = {1, 1, 1, 1, 1}; // sky, global, local, cobj_accum, dynamic
 unsigned const INIT_RAY_SPLITS[NUM_LIGHTING_TYPES] = {1, 4, 1, 1, 1}; // sky, global, local, cobj_accum, dynamic
+unsigned const LMAP_FILE_MAGIC    = 0x50414D4C; // "LMAP"; older files start with the cell count instead, which can never be this large
+unsigned const LMAP_FILE_VERSION  = 1;
+float    const LMAP_FILE_HALF_MAX = 60000.0; // values above this can't be stored as fp16
+unsigned const RT_NUM_WORK_BLOCKS = 64; // for offline lighting; independent of thread count so that results are reproducible
+unsigned const LMCELL_ACCUM_TILE  = 4096; // cells per lazily allocated tile of the shared fixed point accumulation grid
+double const LMCELL_FIXED_SCALE   = 4294967296.0; // 2^32; fixed point accumulation makes the sum independent of the order of adds
 
 extern bool has_snow, combined_gu, global_lighting_update, lighting_update_offline, store_cobj_accum_lighting_as_blocked;
 extern int read_light_files[], write_light_files[], display_mode, DISABLE_WATER;
@@ -191,6 +199,74 @@ struct cobj_ray_accum_map_t : public map<unsigned, cobj_ray_accum_t> {
 cobj_ray_accum_map_t merged_accum_map;
 
 
+// shared fixed point lighting sums, written by all threads and added to the lmap at the end of the job;
+// uses 8 bytes per cell per channel, but only for tiles of cells that are actually hit, since many lights only reach part of the scene
+class lmcell_accum_grid_t {
+	typedef std::atomic<long long> accum_t;
+	unsigned num_cells, dsz;
+	vector<std::atomic<accum_t *>> tiles; // each has LMCELL_ACCUM_TILE*dsz values, or is null if unused
+
+	accum_t *get_tile(unsigned tix) {
+		accum_t *tile(tiles[tix].load(std::memory_order_acquire));
+		if (tile != nullptr) return tile;
+		accum_t *const new_tile(new accum_t[LMCELL_ACCUM_TILE*dsz]()); // zero initialized
+		if (tiles[tix].compare_exchange_strong(tile, new_tile, std::memory_order_acq_rel)) return new_tile;
+		delete [] new_tile; // another thread allocated it first, and tile now points to that one
+		return tile;
+	}
+public:
+	lmcell_accum_grid_t(unsigned num_cells_, int ltype) : num_cells(num_cells_), dsz(lmcell::get_dsz(ltype)), tiles((num_cells + LMCELL_ACCUM_TILE - 1)/LMCELL_ACCUM_TILE) {}
+	lmcell_accum_grid_t(lmcell_accum_grid_t const &) = delete;
+	~lmcell_accum_grid_t() {
+		for (auto i = tiles.begin(); i != tiles.end(); ++i) {delete [] i->load();}
+	}
+	void add(unsigned cell_ix, long long const v[4]) {
+		assert(cell_ix < num_cells);
+		accum_t *const cv(get_tile(cell_ix/LMCELL_ACCUM_TILE) + (cell_ix%LMCELL_ACCUM_TILE)*dsz);
+		for (unsigned n = 0; n < dsz; ++n) {if (v[n] != 0) {cv[n].fetch_add(v[n], std::memory_order_relaxed);}}
+	}
+	void add_to_lmap(lmap_manager_t &lmgr, int ltype) const {
+		assert(lmcell::get_dsz(ltype) == dsz);
+
+		for (unsigned t = 0; t < tiles.size(); ++t) {
+			accum_t const *const tile(tiles[t].load());
+			if (tile == nullptr) continue; // no cells in this tile were hit
+			unsigned const cell_start(t*LMCELL_ACCUM_TILE), cell_end(min(num_cells, cell_start+LMCELL_ACCUM_TILE));
+
+			for (unsigned i = cell_start; i < cell_end; ++i) {
+				float *color(lmgr.get_cell_by_ix(i).get_offset(ltype));
+				accum_t const *const cv(tile + (i - cell_start)*dsz);
+				for (unsigned n = 0; n < dsz; ++n) {color[n] += float(cv[n].load(std::memory_order_relaxed)/LMCELL_FIXED_SCALE);}
+			}
+		}
+	}
+};
+
+// per-thread lighting sums for the current work block, so that repeated hits of the same cell don't contend on the shared atomics
+class lmcell_accum_buffer_t {
+	struct accum_t {
+		long long v[4];
+		accum_t() {v[0] = v[1] = v[2] = v[3] = 0;}
+	};
+	std::unordered_map<unsigned, accum_t> cells;
+	lmcell_accum_grid_t &grid;
+public:
+	lmcell_accum_buffer_t(lmcell_accum_grid_t &grid_) : grid(grid_) {}
+
+	void add(unsigned cell_ix, colorRGBA const &cw, float weight, int ltype) {
+		long long *const v(cells[cell_ix].v);
+		UNROLL_3X(v[i_] += llround(cw[i_]*LMCELL_FIXED_SCALE);)
+		if (ltype != LIGHTING_LOCAL) {v[3] += llround(weight*LMCELL_FIXED_SCALE);}
+	}
+	void flush() {
+		for (auto i = cells.begin(); i != cells.end(); ++i) {grid.add(i->first, i->second.v);}
+		cells.clear();
+	}
+};
+
+thread_local lmcell_accum_buffer_t *thread_lmcell_accum(nullptr); // set by worker threads of work block jobs
+
+
 float get_scene_radius() {return sqrt(2.0f*(X_SCENE_SIZE*X_SCENE_SIZE + Y_SCENE_SIZE*Y_SCENE_SIZE + Z_SCENE_SIZE*Z_SCENE_SIZE));}
 float get_step_size()    {return 0.3f*ray_step_size_mult*(DX_VAL + DY_VAL + DZ_VAL);}
 
@@ -241,7 +317,11 @@ unsigned add_path_to_lmcs(lmap_manager_t *lmgr, cube_t *bcube, point p1, point c
 		for (unsigned s = 0; s < nsteps; ++s) {
 			lmcell *lmc(lmgr->get_lmcell_round_down(p1));
 		
-			if (lmc != NULL) { // could use a mutex here, but it seems too slow
+			if (lmc == NULL) {}
+			else if (thread_lmcell_accum) { // deferred, order independent update
+				thread_lmcell_accum->add(lmgr->get_cell_ix(*lmc), cw, weight, ltype);
+			}
+			else { // could use a mutex here, but it seems too slow
 				float *color(lmc->get_offset(ltype));
 				ADD_LIGHT_CONTRIB(cw, color);
 				if (ltype != LIGHTING_LOCAL) {color[3] += weight;}
@@ -258,8 +338,14 @@ unsigned add_path_to_lmcs(lmap_manager_t *lmgr, cube_t *bcube, point p1, point c
 }
 
 
-void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, float weight0, colorRGBA color, float line_length,
-	int ignore_cobj, int ltype, unsigned depth, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, cube_t *bcube=nullptr)
+bool clip_light_ray(point &p1, point &p2) { // returns false if the ray is outside the scene or starts under the mesh
+	if (!do_line_clip_scene(p1, p2, min(zbottom, czmin), max(ztop, czmax))) return 0;
+	return !((display_mode & 0x01) && is_under_mesh(p1));
+}
+
+// rp/rp_ix: optional ray packet containing the precomputed cobj intersection for this ray (depth 0 only)
+void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, float weight0, colorRGBA color, float line_length, int ignore_cobj, int ltype,
+	unsigned depth, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, cube_t *bcube=nullptr, cobj_ray_packet_t const *rp=nullptr, unsigned rp_ix=0)
 {
 	if (depth > MAX_RAY_BOUNCES) return;
 	if (ltype == LIGHTING_DYNAMIC && depth > 4) return; // use a sensible default since this is running during rendering
@@ -268,15 +354,24 @@ void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, floa
 
 	// find intersection point with scene cobjs
 	point orig_p1(p1);
-	if (!do_line_clip_scene(p1, p2, min(zbottom, czmin), max(ztop, czmax))) return;
-	if ((display_mode & 0x01) && is_under_mesh(p1)) return;
+	if (!clip_light_ray(p1, p2)) return;
 	int cindex(-1), xpos(0), ypos(0);
 	point cpos(p2);
 	vector3d cnorm;
 	float t(0.0), zval(0.0);
-	bool snow_coll(0), ice_coll(0), water_coll(0), mesh_coll(0);
+	bool coll(0), snow_coll(0), ice_coll(0), water_coll(0), mesh_coll(0);
 	vector3d const dir((p2 - p1).get_norm());
-	bool coll(check_coll_line_exact(p1, p2, cpos, cnorm, cindex, 0.0, ignore_cobj, 1, 0, 1, 1, (p1 == orig_p1), no_stat_moving)); // fast=1, exclude voxels, maybe skip init colls
+
+	if (rp) { // already computed as part of a ray packet
+		assert(rp_ix < rp->num_rays && rp->p1[rp_ix] == p1 && rp->p2[rp_ix] == p2);
+		cindex = rp->cindex[rp_ix];
+		cpos   = rp->cpos  [rp_ix];
+		cnorm  = rp->cnorm [rp_ix];
+		coll   = (cindex >= 0);
+	}
+	else {
+		coll = check_coll_line_exact(p1, p2, cpos, cnorm, cindex, 0.0, ignore_cobj, 1, 0, 1, 1, (p1 == orig_p1), no_stat_moving); // fast=1, exclude voxels, maybe skip init colls
+	}
 	assert(coll ? (cindex >= 0 && cindex < (int)coll_objects.size()) : (cindex == -1));
 
 	// find the intersection point with the model3ds
@@ -494,6 +589,53 @@ void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, floa
 }
 
 
+// groups coherent primary rays (same light source, nearby directions) so that their cobj intersections can be found with a packet query
+class light_ray_batch_t {
+
+	struct ray_t {
+		point p1, p2;
+		colorRGBA color;
+		float weight;
+		int pix; // index into packet, or -1 if the ray was clipped
+	};
+	ray_t rays[RAY_PACKET_SIZE];
+	cobj_ray_packet_t packet;
+	unsigned num_rays;
+	lmap_manager_t *lmgr;
+	float line_length;
+	int ltype;
+	rand_gen_t &rgen;
+	cobj_ray_accum_map_t *accum_map;
+
+public:
+	light_ray_batch_t(lmap_manager_t *lmgr_, float line_length_, int ltype_, rand_gen_t &rgen_, cobj_ray_accum_map_t *accum_map_) :
+		num_rays(0), lmgr(lmgr_), line_length(line_length_), ltype(ltype_), rgen(rgen_), accum_map(accum_map_) {}
+	~light_ray_batch_t() {flush();}
+
+	void add_ray(point const &p1, point const &p2, colorRGBA const &color, float weight) {
+		ray_t &ray(rays[num_rays++]);
+		ray.p1 = p1; ray.p2 = p2; ray.color = color; ray.weight = weight;
+		if (num_rays == RAY_PACKET_SIZE) {flush();}
+	}
+	void flush() {
+		if (num_rays == 0) return;
+		packet.clear();
+
+		for (unsigned r = 0; r < num_rays; ++r) { // clip the same way as cast_light_ray() so that the packet rays match exactly
+			point p1(rays[r].p1), p2(rays[r].p2);
+			rays[r].pix = (clip_light_ray(p1, p2) ? (int)packet.add_ray(p1, p2, -1, (p1 == rays[r].p1)) : -1);
+		}
+		check_coll_line_exact_tree_packet(packet, 1, no_stat_moving);
+
+		for (unsigned r = 0; r < num_rays; ++r) {
+			ray_t const &ray(rays[r]);
+			cast_light_ray(lmgr, ray.p1, ray.p2, ray.weight, ray.weight, ray.color, line_length, -1, ltype, 0, rgen, accum_map, nullptr, ((ray.pix >= 0) ? &packet : nullptr), max(ray.pix, 0));
+		}
+		num_rays = 0;
+	}
+};
+
+
 struct rt_data {
 	unsigned ix, num, job_id, checksum;
 	int rseed, ltype;
@@ -505,6 +647,10 @@ struct rt_data {
 	rt_data(unsigned i=0, unsigned n=0, int s=1, bool t=0, bool v=0, bool r=0, int lt=0, unsigned jid=0)
 		: ix(i), num(n), job_id(jid), checksum(0), rseed(s), ltype(lt), is_thread(t), verbose(v), randomized(r), is_running(0), lmgr(nullptr) {update_bcube.set_to_zeros();}
 
+	unsigned get_block_count(unsigned tot) const { // this block's share of tot items; the first (tot % num) blocks get one extra
+		assert(num > 0);
+		return (tot/num + ((ix < tot%num) ? 1 : 0));
+	}
 	void pre_run(rand_gen_t &rgen) {
 		assert(lmgr);
 		assert(num > 0);
@@ -587,6 +733,33 @@ void check_for_lighting_finished() { // to be called about once per frame
 }
 
 
+void run_rt_work_blocks(vector<rt_data> &blocks, std::atomic<unsigned> &next_block, void (*func)(rt_data *), lmcell_accum_grid_t &grid) {
+
+	lmcell_accum_buffer_t accum(grid);
+	thread_lmcell_accum = &accum;
+
+	while (!kill_raytrace) {
+		unsigned const bix(next_block++); // grab the next unprocessed block
+		if (bix >= blocks.size()) break; // no more work
+		func(&blocks[bix]);
+		accum.flush();
+	}
+	thread_lmcell_accum = nullptr;
+}
+
+// dynamically load balanced threads; each block has its own random seed and all lmcell updates are fixed point sums, so the result doesn't depend on the number of threads
+void launch_work_block_job(unsigned num_threads, void (*func)(rt_data *), vector<rt_data> &blocks, lmap_manager_t &lmgr, int ltype) {
+
+	lmcell_accum_grid_t grid(lmgr.size(), ltype);
+	std::atomic<unsigned> next_block(0);
+	vector<std::thread> threads;
+	for (unsigned t = 1; t < num_threads; ++t) {threads.emplace_back(run_rt_work_blocks, std::ref(blocks), std::ref(next_block), func, std::ref(grid));}
+	run_rt_work_blocks(blocks, next_block, func, grid); // the calling thread does work as well
+	for (auto i = threads.begin(); i != threads.end(); ++i) {i->join();}
+	grid.add_to_lmap(lmgr, ltype);
+}
+
+
 // see https://computing.llnl.gov/tutorials/pthreads/ (for old pthread implementation - now using std::thread)
 void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bool verbose, bool blocking, bool use_temp_lmap, bool randomized, int ltype, unsigned job_id=0) {
 
@@ -594,17 +767,22 @@ void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bo
 	assert(num_threads > 0 && num_threads < 100);
 	assert(!keep_beams || num_threads == 1); // could use a mutex instead to make this legal
 	bool const single_thread(num_threads == 1);
+	// offline sky/global/local lighting is split into many small blocks rather than one per thread
+	bool const use_work_blocks(blocking && !use_temp_lmap && !keep_beams && (ltype == LIGHTING_SKY || ltype == LIGHTING_GLOBAL || ltype == LIGHTING_LOCAL));
+	unsigned const num_data(use_work_blocks ? RT_NUM_WORK_BLOCKS : num_threads);
 	if (verbose) {cout << "Computing lighting on " << num_threads << " threads." << endl;}
-	thread_manager.create(num_threads);
+	thread_manager.create(num_data);
 	vector<rt_data> &data(thread_manager.data);
 	if (use_temp_lmap) {thread_temp_lmap.init_from(lmap_manager);}
 
 	for (unsigned t = 0; t < data.size(); ++t) {
-		// create a custom lmap_manager_t for each thread then merge them together?
-		data[t] = rt_data(t, num_threads, 234323*(t+1), !single_thread, (verbose && t == 0), randomized, ltype, job_id);
+		data[t] = rt_data(t, num_data, 234323*(t+1), !single_thread, (verbose && t == 0), randomized, ltype, job_id);
 		data[t].lmgr = (use_temp_lmap ? &thread_temp_lmap : &lmap_manager);
 	}
-	if (single_thread && blocking) { // threads disabled
+	if (use_work_blocks) {
+		launch_work_block_job(num_threads, start_func, data, lmap_manager, ltype);
+	}
+	else if (single_thread && blocking) { // threads disabled
 		start_func((rt_data *)(&data[0]));
 	}
 	else {
@@ -640,18 +818,18 @@ bool cube_light_src_vect::ray_intersects_any(point const &start_pt, point const
 }
 
 
-void trace_one_global_ray(lmap_manager_t *lmgr, point const &pos, point const &pt, colorRGBA const &color, float ray_wt,
-	int ltype, bool is_scene_cube, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, float line_length)
-{
+void trace_one_global_ray(light_ray_batch_t &batch, point const &pos, point const &pt, colorRGBA const &color, float ray_wt, bool is_scene_cube, float line_length) {
+
 	point const end_pt(pt + (pt - pos).get_norm()*line_length);
 	if (is_scene_cube && global_cube_lights.ray_intersects_any(pt, end_pt)) return; // don't double count
-	cast_light_ray(lmgr, pos, end_pt, ray_wt, ray_wt, color, line_length, -1, ltype, 0, rgen, accum_map);
+	batch.add_ray(pos, end_pt, color, ray_wt);
 }
 
 
 void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point const &pos, colorRGBA const &color, float ray_wt,
 	unsigned nrays, int ltype, unsigned disabled_edges, bool is_scene_cube, bool verbose, bool randomized, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map)
 {
+	if (nrays == 0) return; // this block has no rays
 	float const line_length(2.0*get_scene_radius());
 	vector3d const ldir((bnds.get_cube_center() - pos).get_norm());
 	float proj_area[3] = {0}, tot_area(0.0);
@@ -672,6 +850,7 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 		unsigned const num_rays(unsigned(nrays*proj_area[i]/tot_area + 0.5));
 		point pt;
 		pt[i] = bnds.d[i][dir];
+		light_ray_batch_t batch(lmgr, line_length, ltype, rgen, accum_map); // rays in this face have a common origin and similar directions
 		if (verbose) {cout << "Dim " << i+1 << " of 3, num (this thread): " << num_rays << ", progress (of " << 1+num_rays/1000 << "): 0";}
 
 		if (randomized) {
@@ -680,7 +859,7 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 				if (verbose && ((s%1000) == 0)) {increment_printed_number(s/1000);}
 				pt[d0] = rgen.rand_uniform(bnds.d[d0][0], bnds.d[d0][1]);
 				pt[d1] = rgen.rand_uniform(bnds.d[d1][0], bnds.d[d1][1]);
-				trace_one_global_ray(lmgr, pos, pt, color, ray_wt, ltype, is_scene_cube, rgen, accum_map, line_length);
+				trace_one_global_ray(batch, pos, pt, color, ray_wt, is_scene_cube, line_length);
 			}
 		}
 		else {
@@ -697,10 +876,11 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 					if (kill_raytrace) break;
 					if (verbose && ((num%1000) == 0)) increment_printed_number(num/1000);
 					pt[d1] = bnds.d[d1][0] + (s1 + rgen.rand_uniform(0.0, 1.0))*len1/n1;
-					trace_one_global_ray(lmgr, pos, pt, color, ray_wt, ltype, is_scene_cube, rgen, accum_map, line_length);
+					trace_one_global_ray(batch, pos, pt, color, ray_wt, is_scene_cube, line_length);
 				}
 			}
 		}
+		batch.flush();
 		if (verbose) {cout << endl;}
 	} // for i
 }
@@ -718,12 +898,12 @@ void trace_ray_block_global_light(rt_data *data, point const &pos, colorRGBA con
 		float const ray_wt(RAY_WEIGHT*weight*color.alpha/GLOBAL_RAYS);
 		assert(ray_wt > 0.0);
 		cube_t const bnds(get_scene_bounds());
-		trace_ray_block_global_cube(data->lmgr, bnds, pos, color, ray_wt, max(1U, GLOBAL_RAYS/data->num), LIGHTING_GLOBAL, 0, 1, data->verbose, data->randomized, rgen, &data->accum_map);
+		trace_ray_block_global_cube(data->lmgr, bnds, pos, color, ray_wt, data->get_block_count(GLOBAL_RAYS), LIGHTING_GLOBAL, 0, 1, data->verbose, data->randomized, rgen, &data->accum_map);
 	}
 	for (cube_light_src_vect::const_iterator i = global_cube_lights.begin(); i != global_cube_lights.end(); ++i) {
 		if (data->num == 0 || i->num_rays == 0) continue; // disabled
 		if (data->verbose) {cout << "Cube volume light source " << (i - global_cube_lights.begin()) << " of " << global_cube_lights.size() << endl;}
-		unsigned const num_rays(i->num_rays/data->num);
+		unsigned const num_rays(data->get_block_count(i->num_rays));
 		float const cube_weight(RAY_WEIGHT*weight*i->intensity/i->num_rays);
 		trace_ray_block_global_cube(data->lmgr, i->bounds, pos, color, cube_weight, num_rays, LIGHTING_GLOBAL, i->disabled_edges, 0, data->verbose, data->randomized, rgen, &data->accum_map);
 		cube_start_rays += num_rays;
@@ -759,7 +939,7 @@ void trace_ray_block_sky(rt_data *data) {
 
 	if (NPTS > 0 && NRAYS > 0) {
 		float const ray_wt(get_sky_light_ray_weight());
-		unsigned const block_npts(max(1U, NPTS/data->num));
+		unsigned const block_npts(data->get_block_count(NPTS));
 		vector<point> pts(block_npts);
 		vector<vector3d> dirs(NRAYS);
 
@@ -775,6 +955,7 @@ void trace_ray_block_sky(rt_data *data) {
 			if (kill_raytrace) break;
 			if (data->verbose) {increment_printed_number(p);}
 			point const &pt(pts[p]);
+			light_ray_batch_t batch(data->lmgr, line_length, LIGHTING_SKY, rgen, &data->accum_map); // sorted rays from the same point are coherent
 
 			for (unsigned r = 0; r < NRAYS; ++r) {
 				point const target_pt(X_SCENE_SIZE*rgen.signed_rand_float(), Y_SCENE_SIZE*rgen.signed_rand_float(), rgen.rand_uniform(czmin, czmax));
@@ -788,7 +969,7 @@ void trace_ray_block_sky(rt_data *data) {
 				if (dot_product(dirs[r], pt) >= 0.0) continue; // can get here when (-Z_SCENE_SIZE, Z_SCENE_SIZE) does not contain (czmin, czmax)
 				point const end_pt(pt + dirs[r]*line_length);
 				if (sky_cube_lights.ray_intersects_any(pt, end_pt)) continue; // don't double count
-				cast_light_ray(data->lmgr, pt, end_pt, ray_wt, ray_wt, WHITE, line_length, -1, LIGHTING_SKY, 0, rgen, &data->accum_map);
+				batch.add_ray(pt, end_pt, WHITE, ray_wt);
 				++start_rays;
 			}
 		}
@@ -797,7 +978,7 @@ void trace_ray_block_sky(rt_data *data) {
 	for (cube_light_src_vect::const_iterator i = sky_cube_lights.begin(); i != sky_cube_lights.end(); ++i) {
 		if (kill_raytrace) break;
 		if (data->num == 0 || i->num_rays == 0) continue; // disabled
-		unsigned const num_rays(i->num_rays/data->num);
+		unsigned const num_rays(data->get_block_count(i->num_rays));
 		float const cube_weight(RAY_WEIGHT*i->intensity/i->num_rays);
 		if (data->verbose) {cout << "Cube volume light source " << (i - sky_cube_lights.begin()) << " of " << sky_cube_lights.size() << ", progress (of " << 1+num_rays/1000 << "): 0";}
 		cube_start_rays += num_rays;
@@ -1009,7 +1190,8 @@ void trace_ray_block_local(rt_data *data) {
 	}
 	for (unsigned i = 0; i < light_sources_a.size(); ++i) {
 		if (data->verbose) {increment_printed_number(i);}
-		unsigned const light_nrays(light_sources_a[i].get_num_rays()), NRAYS(light_nrays ? light_nrays : LOCAL_RAYS), num_rays(max(1U, NRAYS/data->num));
+		unsigned const light_nrays(light_sources_a[i].get_num_rays()), NRAYS(light_nrays ? light_nrays : LOCAL_RAYS), num_rays(data->get_block_count(NRAYS));
+		if (num_rays == 0) continue; // fewer rays than blocks, and this block has none
 		ray_trace_local_light_source(data->lmgr, light_sources_a[i], line_length, num_rays, rgen, data->ltype, NRAYS);
 	}
 	if (data->verbose) {cout << endl;}
@@ -1033,7 +1215,8 @@ void trace_ray_block_dynamic(rt_data *data) {
 		light_source_trig const &ls(light_sources_d[*i]);
 		//if (!ls.is_enabled()) continue; // error?
 		float const line_length(min(4.0f*ls.get_radius(), max_line_length)); // limit ray length to improve perf
-		unsigned const light_nrays(ls.get_num_rays()), NRAYS(light_nrays ? light_nrays : DYNAMIC_RAYS), num_rays(max(1U, NRAYS/data->num));
+		unsigned const light_nrays(ls.get_num_rays()), NRAYS(light_nrays ? light_nrays : DYNAMIC_RAYS), num_rays(data->get_block_count(NRAYS));
+		if (num_rays == 0) continue; // fewer rays than threads, and this thread has none
 		ray_trace_local_light_source(nullptr, ls, line_length, num_rays, rgen, data->ltype, NRAYS); // lmgr is unused, so leave it as null
 	}
 	data->post_run();
@@ -1131,6 +1314,58 @@ void check_all_platform_cobj_lighting_update() {
 // lmap_manager_t
 
 
+// sparse lighting file format: header {magic, version, num_cells, values_per_cell, use_fp16}, followed by
+// {num_zero_cells, num_cells, values...} runs until all cells are covered; cells with all zero values are skipped
+bool lmap_manager_t::read_sparse_data(binary_file_reader &reader, char const *const fn, int ltype) {
+
+	unsigned header[4] = {0}; // version, num_cells, values_per_cell, use_fp16
+	if (!reader.read(header, sizeof(unsigned), 4)) return 0;
+	unsigned const sz(lmcell::get_dsz(ltype));
+
+	if (header[0] != LMAP_FILE_VERSION || header[2] != sz || header[3] > 1) {
+		cerr << "Error: Unsupported lighting file version or format in " << fn << endl;
+		return 0;
+	}
+	if (header[1] != vldata_alloc.size()) {
+		cerr << "Error: Lighting file " << fn << " data size of " << header[1]
+			 << " does not equal the expected size of " << vldata_alloc.size() << ". Ignoring file." << endl;
+		return 0;
+	}
+	bool const use_fp16(header[3] != 0);
+	vector<unsigned short> hdata;
+	vector<float> data;
+
+	for (unsigned cur = 0; cur < vldata_alloc.size();) {
+		unsigned run[2] = {0}; // num_zero_cells, num_cells
+		if (!reader.read(run, sizeof(unsigned), 2)) return 0;
+
+		if (run[0] > vldata_alloc.size() - cur || run[1] > vldata_alloc.size() - cur - run[0]) {
+			cerr << "Error: Invalid run in lighting file " << fn << endl;
+			return 0;
+		}
+		for (unsigned i = 0; i < run[0]; ++i, ++cur) {
+			float *ptr(vldata_alloc[cur].get_offset(ltype));
+			for (unsigned n = 0; n < sz; ++n) {ptr[n] = 0.0;}
+		}
+		if (run[1] == 0) continue;
+		data.resize(run[1]*sz);
+
+		if (use_fp16) {
+			hdata.resize(data.size());
+			if (!reader.read(hdata.data(), sizeof(unsigned short), hdata.size())) return 0;
+			for (unsigned i = 0; i < data.size(); ++i) {data[i] = glm::unpackHalf1x16(hdata[i]);}
+		}
+		else if (!reader.read(data.data(), sizeof(float), data.size())) return 0;
+
+		for (unsigned i = 0, pos = 0; i < run[1]; ++i, ++cur) {
+			float *ptr(vldata_alloc[cur].get_offset(ltype));
+			for (unsigned n = 0; n < sz; ++n) {ptr[n] = data[pos++];}
+		}
+	}
+	return 1;
+}
+
+
 bool lmap_manager_t::read_data_from_file(char const *const fn, int ltype) {
 
 	assert(fn != nullptr);
@@ -1140,6 +1375,12 @@ bool lmap_manager_t::read_data_from_file(char const *const fn, int ltype) {
 	unsigned data_size(0);
 	if (!reader.read(&data_size, sizeof(unsigned), 1)) return 0;
 
+	if (data_size == LMAP_FILE_MAGIC) {
+		if (read_sparse_data(reader, fn, ltype)) return 1;
+		cerr << "Error reading data from ligthing file " << fn << endl;
+		return 0;
+	}
+	// older dense file format with all float values
 	if (data_size != vldata_alloc.size()) {
 		cerr << "Error: Lighting file " << fn << " data size of " << data_size
 			 << " does not equal the expected size of " << vldata_alloc.size() << ". Ignoring file." << endl;
@@ -1168,12 +1409,46 @@ bool lmap_manager_t::write_data_to_file(char const *const fn, int ltype) const {
 	binary_file_writer writer;
 	if (!writer.open(fn)) return 0;
 	cout << "Writing lighting file to " << fn << endl;
-	unsigned const data_size((unsigned)vldata_alloc.size()); // should be size_t?
-	if (!writer.write(&data_size, sizeof(unsigned), 1)) return 0;
-	unsigned const sz(lmcell::get_dsz(ltype));
+	unsigned const sz(lmcell::get_dsz(ltype)), num_cells((unsigned)vldata_alloc.size());
+	bool use_fp16(1);
+
+	for (auto i = vldata_alloc.begin(); i != vldata_alloc.end() && use_fp16; ++i) { // fp16 is only used if all values are in range
+		float const *ptr(i->get_offset(ltype));
+		for (unsigned n = 0; n < sz; ++n) {use_fp16 &= (fabs(ptr[n]) < LMAP_FILE_HALF_MAX);}
+	}
+	unsigned const header[5] = {LMAP_FILE_MAGIC, LMAP_FILE_VERSION, num_cells, sz, use_fp16};
+	if (!writer.write(header, sizeof(unsigned), 5)) return 0;
+	vector<unsigned short> hdata;
+	vector<float> data;
+
+	for (unsigned cur = 0; cur < num_cells;) {
+		unsigned run[2] = {0}; // num_zero_cells, num_cells
+
+		for (; cur < num_cells; ++cur, ++run[0]) { // skip zero cells
+			float const *ptr(vldata_alloc[cur].get_offset(ltype));
+			bool is_zero(1);
+			for (unsigned n = 0; n < sz; ++n) {is_zero &= (ptr[n] == 0.0);}
+			if (!is_zero) break;
+		}
+		data.clear();
+
+		for (; cur < num_cells; ++cur, ++run[1]) { // add nonzero cells
+			float const *ptr(vldata_alloc[cur].get_offset(ltype));
+			bool is_zero(1);
+			for (unsigned n = 0; n < sz; ++n) {is_zero &= (ptr[n] == 0.0);}
+			if (is_zero) break;
+			data.insert(data.end(), ptr, ptr+sz);
+		}
+		bool success(writer.write(run, sizeof(unsigned), 2));
+
+		if (use_fp16) {
+			hdata.resize(data.size());
+			for (unsigned i = 0; i < data.size(); ++i) {hdata[i] = glm::packHalf1x16(data[i]);}
+			success &= (hdata.empty() || writer.write(hdata.data(), sizeof(unsigned short), hdata.size()));
+		}
+		else {success &= (data.empty() || writer.write(data.data(), sizeof(float), data.size()));}
 
-	for (vector<lmcell>::const_iterator i = vldata_alloc.begin(); i != vldata_alloc.end(); ++i) { // const_iterator?
-		if (!writer.write(i->get_offset(ltype), sizeof(float), sz)) {
+		if (!success) {
 			cerr << "Error writing data to ligthing file " << fn << endl;
 			return 0;
 		}
@@ -8,24 +8,24 @@
 #include "shaders.h"
 #include "draw_utils.h"
 #include "physics_objects.h" // for fire_elem_t
+#include <climits>
 
 
 bool const DYNAMIC_SMOKE     = 1; // looks cool
-int const SMOKE_SKIPVAL      = 8;
-int const SMOKE_SEND_SKIP    = 8;
+int const SMOKE_BRICK_SZ     = 8; // smoke is simulated and sent to the GPU in bricks of this many cells on a side
 int const INDIR_LT_SEND_SKIP = 12;
 
 float const SMOKE_DENSITY    = 1.0;
 float const SMOKE_MAX_CELL   = 0.125;
 float const SMOKE_MAX_VAL    = 100.0;
-float const SMOKE_DIS_XY     = 0.05;
-float const SMOKE_DIS_ZU     = 0.08;
-float const SMOKE_DIS_ZD     = 0.03;
+float const SMOKE_DIS_XY     = 0.05; // diffusion rates are per frame
+float const SMOKE_DIS_ZU     = 0.01;
+float const SMOKE_DIS_ZD     = 0.00375;
 float const SMOKE_THRESH     = 1.0/255.0;
 
 
 bool smoke_visible(0), smoke_exists(0), have_indir_smoke_tex(0);
-unsigned smoke_tid(0), last_smoke_update(0);
+unsigned smoke_tid(0);
 colorRGB const_indir_color(BLACK);
 cube_t cur_smoke_bb;
 vector<unsigned char> smoke_tex_data; // several MB
@@ -41,6 +41,8 @@ extern lmap_manager_t lmap_manager;
 extern vector<cube_t> smoke_bounds;
 extern llv_vect local_light_volumes;
 
+void sync_smoke_tex_region(unsigned x_start, unsigned x_end, unsigned y_start, unsigned y_end, unsigned z_start, unsigned z_end);
+
 
 
 bool check_smoke_bounds(point const &pt) {
@@ -51,34 +53,92 @@ bool check_smoke_bounds(point const &pt) {
 	return smoke_bounds.empty(); // if empty we assume unbounded
 }
 
+bool check_smoke_bounds(cube_t const &c) {
 
-struct smoke_entry_t {
-	short zmin, zmax;
-	smoke_entry_t() {clear();}
-	bool valid() const {return (zmin < zmax);}
-	void clear() {zmin = 10000; zmax = 0;}
-	void update(short zval) {zmin = min(zmin, zval); zmax = max(zmax, short(zval+1));}
-};
+	for (vector<cube_t>::const_iterator i = smoke_bounds.begin(); i != smoke_bounds.end(); ++i) {
+		if (i->intersects(c)) return 1;
+	}
+	return smoke_bounds.empty(); // if empty we assume unbounded
+}
+
+
+inline void adjust_smoke_val(float &val, float delta) {val = max(0.0f, min(SMOKE_MAX_VAL, (val + delta)));}
+inline unsigned char get_smoke_alpha(float smoke) {return ((smoke == 0.0) ? 0 : (unsigned char)(255*CLIP_TO_01(smoke/SMOKE_MAX_CELL)));}
+
+
+struct smoke_manager;
+
+// double buffered smoke density volume, stored {z, x, y} to match the smoke texture and lmap layout;
+// only bricks with smoke and their neighbors are updated, and only updated bricks are sent to the GPU
+class smoke_volume_t {
+
+	struct brick_stats_t {
+		float tot_smoke;
+		int bounds[3][2]; // cell range containing smoke, inclusive
+		brick_stats_t() : tot_smoke(0.0) {UNROLL_3X(bounds[i_][0] = INT_MAX; bounds[i_][1] = INT_MIN;)}
+		void add(int x, int y, int z, float val) {
+			tot_smoke += val;
+			int const p[3] = {x, y, z};
+			UNROLL_3X(bounds[i_][0] = min(bounds[i_][0], p[i_]); bounds[i_][1] = max(bounds[i_][1], p[i_]);)
+		}
+	};
+	vector<float> data[2];
+	vector<unsigned char> active, dirty, needed; // per-brick flags
+	vector<unsigned> proc_bricks, dirty_bricks;
+	vector<brick_stats_t> stats; // one per entry in proc_bricks
+	int nx, ny, nz, bnum[3];
+	unsigned cur;
+
+	unsigned get_ix(int x, int y, int z) const {return ((y*nx + x)*nz + z);} // same as the lmap and smoke texture
+	unsigned get_brick_ix(int bx, int by, int bz) const {return ((by*bnum[0] + bx)*bnum[2] + bz);}
+	unsigned get_brick_ix_for_cell(int x, int y, int z) const {return get_brick_ix(x/SMOKE_BRICK_SZ, y/SMOKE_BRICK_SZ, z/SMOKE_BRICK_SZ);}
+
+	void mark_dirty(unsigned bix) {
+		if (!dirty[bix]) {dirty[bix] = 1; dirty_bricks.push_back(bix);}
+	}
+	void get_brick_pos(unsigned bix, int bpos[3]) const {
+		bpos[2] = bix % bnum[2]; bix /= bnum[2];
+		bpos[0] = bix % bnum[0];
+		bpos[1] = bix / bnum[0];
+	}
+	float calc_cell_update(int x, int y, int z, lmcell const *col, float xy_rate, float zu_rate, float zd_rate) const;
+	void update_brick(unsigned bix, brick_stats_t &bstats, float xy_rate, float zu_rate, float zd_rate);
 
-class smoke_grid_t {
-	vector<smoke_entry_t> zrng; // z smoke ranges for each xy grid element
 public:
-	void ensure_zrng() {
-		if (zrng.empty()) {zrng.resize(XY_MULT_SIZE);} else {assert((int)zrng.size() == XY_MULT_SIZE);}
+	smoke_volume_t() : nx(0), ny(0), nz(0), cur(0) {UNROLL_3X(bnum[i_] = 0;)}
+	bool is_allocated() const {return !data[0].empty();}
+	bool has_dirty_bricks() const {return !dirty_bricks.empty();}
+
+	void ensure_alloc() {
+		if (is_allocated()) return;
+		nx = MESH_X_SIZE; ny = MESH_Y_SIZE; nz = MESH_SIZE[2];
+		bnum[0] = (nx + SMOKE_BRICK_SZ - 1)/SMOKE_BRICK_SZ;
+		bnum[1] = (ny + SMOKE_BRICK_SZ - 1)/SMOKE_BRICK_SZ;
+		bnum[2] = (nz + SMOKE_BRICK_SZ - 1)/SMOKE_BRICK_SZ;
+		unsigned const num_bricks(bnum[0]*bnum[1]*bnum[2]);
+		for (unsigned d = 0; d < 2; ++d) {data[d].resize(nx*ny*nz, 0.0);}
+		active.resize(num_bricks, 0);
+		dirty.resize(num_bricks, 0);
+		needed.resize(num_bricks, 0);
 	}
-	void register_smoke(int x, int y, int z) {
-		ensure_zrng();
-		assert(!point_outside_mesh(x, y));
-		zrng[y*MESH_X_SIZE + x].update(z);
+	float get(int x, int y, int z) const {return (is_allocated() ? data[cur][get_ix(x, y, z)] : 0.0f);}
+
+	void add(int x, int y, int z, float val) {
+		ensure_alloc();
+		adjust_smoke_val(data[cur][get_ix(x, y, z)], val);
+		unsigned const bix(get_brick_ix_for_cell(x, y, z));
+		active[bix] = 1;
+		mark_dirty(bix);
 	}
-	smoke_entry_t &get_z_range(int x, int y) {
-		ensure_zrng();
-		assert(!point_outside_mesh(x, y));
-		return zrng[y*MESH_X_SIZE + x];
+	void step(float xy_rate, float zu_rate, float zd_rate, smoke_manager &sman);
+	void upload_dirty_bricks(vector<unsigned char> &tex_data);
+	void clear_dirty() {
+		for (auto i = dirty_bricks.begin(); i != dirty_bricks.end(); ++i) {dirty[*i] = 0;}
+		dirty_bricks.clear();
 	}
 };
 
-smoke_grid_t smoke_grid;
+smoke_volume_t smoke_vol;
 
 
 struct smoke_manager {
@@ -98,13 +158,15 @@ struct smoke_manager {
 		enabled   = 0;
 		smoke_vis = 0;
 	}
-	void add_smoke(int x, int y, int z, float smoke_amt) {
+	void add_smoke(cube_t const &cube, float smoke_amt) { // cube contains the centers of all cells with smoke
 		if (smoke_amt == 0) return; // can't happen?
-		point const pos(get_xval(x), get_yval(y), get_zval(z));
 
-		if (is_smoke_visible(pos) && check_smoke_bounds(pos)) {
-			bbox.union_with_pt(pos);
-			cur_smoke_bb.union_with_pt(pos);
+		cube_t vis_cube(cube);
+		vis_cube.expand_by(HALF_DXY);
+
+		if (camera_pdu.cube_visible(vis_cube) && check_smoke_bounds(vis_cube)) {
+			bbox.union_with_cube(cube);
+			cur_smoke_bb.union_with_cube(cube);
 			smoke_vis = 1;
 		}
 		tot_smoke += smoke_amt;
@@ -119,66 +181,148 @@ struct smoke_manager {
 	}
 };
 
-smoke_manager smoke_man, next_smoke_man;
+smoke_manager smoke_man;
 
 
-inline void adjust_smoke_val(float &val, float delta) {val = max(0.0f, min(SMOKE_MAX_VAL, (val + delta)));}
-
 void add_smoke(point const &pos, float val) {
 
 	if (!DYNAMIC_SMOKE || (display_mode & 0x80) || !game_mode || val == 0.0 || pos.z >= czmax) return;
-	lmcell *const lmc(lmap_manager.get_lmcell(pos));
-	if (!lmc) return;
+	if (!lmap_manager.get_lmcell(pos)) return;
 	int const xpos(get_xpos(pos.x)), ypos(get_ypos(pos.y));
 	if (point_outside_mesh(xpos, ypos) || pos.z >= v_collision_matrix[ypos][xpos].zmax || pos.z < mesh_height[ypos][xpos]) return; // above all cobjs/outside
 	if (no_smoke_over_mesh && !is_mesh_disabled(xpos, ypos)) return;
 	if (!check_smoke_bounds(pos)) return;
 	//if (!check_coll_line(pos, point(pos.x, pos.y, czmax), cindex, -1, 1, 0)) return; // too slow
-	adjust_smoke_val(lmc->smoke, SMOKE_DENSITY*val);
+	smoke_vol.add(xpos, ypos, get_zpos(pos.z), SMOKE_DENSITY*val);
 	smoke_exists |= smoke_man.is_smoke_visible(pos);
-	smoke_grid.register_smoke(xpos, ypos, get_zpos(pos.z));
 }
 
-void diffuse_smoke_xy(int x, int y, int z, lmcell &adj, float rate, int dim, int dir) {
 
+// Note: flow between a cell and its +x/+y/+z neighbor is controlled by pflow of the lower cell; each pair flux is computed
+// identically from both sides using only the previous values, so cells can be updated in any order/in parallel
+float smoke_volume_t::calc_cell_update(int x, int y, int z, lmcell const *col, float xy_rate, float zu_rate, float zd_rate) const {
+
+	vector<float> const &cdata(data[cur]);
+	float const val(cdata[get_ix(x, y, z)]);
 	float delta(0.0); // Note: not using fticks due to instability
-	lmcell *vldata(point_outside_mesh(x, y) ? nullptr : lmap_manager.get_column(x, y));
-
-	if (vldata) {
-		lmcell &lmc(vldata[z]);
-		unsigned char const flow(dir ? adj.pflow[dim] : lmc.pflow[dim]);
-		if (flow == 0) return;
-		float const cur_smoke(lmc.smoke);
-		delta  = rate*(flow/255.0f)*(adj.smoke - cur_smoke); // diffusion out of current cell and into cell xyz (can be negative)
-		adjust_smoke_val(lmc.smoke, delta);
-		delta  = (lmc.smoke - cur_smoke); // actual change
-		if (lmc.smoke > 0.0) {smoke_grid.register_smoke(x, y, z);}
-	}
-	else { // edge cell has infinite smoke capacity and zero total smoke
-		delta = rate;
-	}
-	adjust_smoke_val(adj.smoke, -delta);
+	int const adj[4][3] = {{x-1, y, 0}, {x+1, y, 0}, {x, y-1, 1}, {x, y+1, 1}}; // {x, y, dim}
+
+	for (unsigned n = 0; n < 4; ++n) { // diffuse in x and y
+		int const ax(adj[n][0]), ay(adj[n][1]), dim(adj[n][2]);
+		lmcell const *const acol(point_outside_mesh(ax, ay) ? nullptr : lmap_manager.get_column(ax, ay));
+
+		if (acol == nullptr) { // edge cell has infinite smoke capacity and zero total smoke
+			if (val > 0.0) {delta -= xy_rate;}
+			continue;
+		}
+		bool const is_lower(ax < x || ay < y);
+		unsigned char const flow(is_lower ? acol[z].pflow[dim] : col[z].pflow[dim]);
+		if (flow > 0) {delta += xy_rate*(flow/255.0f)*(cdata[get_ix(ax, ay, z)] - val);}
+	}
+	if (z > 0) { // diffuse to/from the cell below
+		float const flux((col[z-1].pflow[2]/255.0f)*(cdata[get_ix(x, y, z-1)] - val)); // positive = upward
+		delta += flux*((flux > 0.0) ? zu_rate : zd_rate);
+	}
+	else if (val > 0.0) {delta -= 0.5f*(zu_rate + zd_rate);} // edge
+	
+	if (z+1 < nz) { // diffuse to/from the cell above
+		float const flux((col[z].pflow[2]/255.0f)*(val - cdata[get_ix(x, y, z+1)])); // positive = upward
+		delta -= flux*((flux > 0.0) ? zu_rate : zd_rate);
+	}
+	else if (val > 0.0) {delta -= 0.5f*(zu_rate + zd_rate);} // edge
+	float new_val(val);
+	adjust_smoke_val(new_val, delta);
+	return ((new_val < SMOKE_THRESH) ? 0.0f : new_val);
 }
 
-void diffuse_smoke_z(int x, int y, int z, lmcell &adj, lmcell *vldata, float pos_rate, float neg_rate, int dim, int dir) {
+void smoke_volume_t::update_brick(unsigned bix, brick_stats_t &bstats, float xy_rate, float zu_rate, float zd_rate) {
 
-	float delta(0.0); // Note: not using fticks due to instability
+	int bpos[3];
+	get_brick_pos(bix, bpos);
+	int const x1(bpos[0]*SMOKE_BRICK_SZ), y1(bpos[1]*SMOKE_BRICK_SZ), z1(bpos[2]*SMOKE_BRICK_SZ);
+	int const x2(min(nx, x1+SMOKE_BRICK_SZ)), y2(min(ny, y1+SMOKE_BRICK_SZ)), z2(min(nz, z1+SMOKE_BRICK_SZ));
+	vector<float> &ndata(data[1-cur]);
+
+	for (int y = y1; y < y2; ++y) {
+		for (int x = x1; x < x2; ++x) {
+			lmcell const *const col(lmap_manager.get_column(x, y));
+			unsigned const ix(get_ix(x, y, 0));
 
-	if (z >= 0 && z < MESH_SIZE[2]) {
-		lmcell &lmc(vldata[z]);
-		unsigned char const flow(dir ? adj.pflow[dim] : lmc.pflow[dim]);
-		if (flow == 0) return;
-		float const cur_smoke(lmc.smoke);
-		delta  = (flow/255.0f)*(adj.smoke - cur_smoke); // diffusion out of current cell and into cell xyz (can be negative)
-		delta *= ((delta < 0.0) ? neg_rate : pos_rate);
-		adjust_smoke_val(lmc.smoke, delta);
-		delta  = (lmc.smoke - cur_smoke); // actual change
-		if (lmc.smoke > 0.0) {smoke_grid.register_smoke(x, y, z);}
-	}
-	else { // edge cell has infinite smoke capacity and zero total smoke
-		delta = 0.5f*(pos_rate + neg_rate);
-	}
-	adjust_smoke_val(adj.smoke, -delta);
+			if (col == nullptr) { // no lmap column, so no smoke
+				for (int z = z1; z < z2; ++z) {ndata[ix + z] = 0.0;}
+				continue;
+			}
+			for (int z = z1; z < z2; ++z) {
+				float const val(calc_cell_update(x, y, z, col, xy_rate, zu_rate, zd_rate));
+				ndata[ix + z] = val;
+				if (val > 0.0) {bstats.add(x, y, z, val);}
+			}
+		} // for x
+	} // for y
+}
+
+void smoke_volume_t::step(float xy_rate, float zu_rate, float zd_rate, smoke_manager &sman) {
+
+	if (!is_allocated()) return;
+	// process active bricks and their neighbors; bricks are processed for one extra step after that to ensure both buffers are zero for skipped bricks
+	vector<unsigned char> const was_needed(needed);
+	proc_bricks.clear();
+
+	for (int by = 0; by < bnum[1]; ++by) {
+		for (int bx = 0; bx < bnum[0]; ++bx) {
+			for (int bz = 0; bz < bnum[2]; ++bz) {
+				unsigned const bix(get_brick_ix(bx, by, bz));
+				bool need(0);
+
+				for (int dy = max(0, by-1); dy <= min(bnum[1]-1, by+1) && !need; ++dy) {
+					for (int dx = max(0, bx-1); dx <= min(bnum[0]-1, bx+1) && !need; ++dx) {
+						for (int dz = max(0, bz-1); dz <= min(bnum[2]-1, bz+1) && !need; ++dz) {need = (active[get_brick_ix(dx, dy, dz)] != 0);}
+					}
+				}
+				needed[bix] = need;
+				if (need || was_needed[bix]) {proc_bricks.push_back(bix);}
+			} // for bz
+		} // for bx
+	} // for by
+	stats.clear();
+	stats.resize(proc_bricks.size());
+
+#pragma omp parallel for schedule(dynamic,1)
+	for (int i = 0; i < (int)proc_bricks.size(); ++i) { // reads from data[cur] and writes only this brick's cells in data[1-cur]
+		update_brick(proc_bricks[i], stats[i], xy_rate, zu_rate, zd_rate);
+	}
+	cur = 1 - cur; // swap buffers
+
+	for (unsigned i = 0; i < proc_bricks.size(); ++i) {
+		unsigned const bix(proc_bricks[i]);
+		brick_stats_t const &bs(stats[i]);
+		active[bix] = (bs.tot_smoke > 0.0);
+		mark_dirty(bix);
+		if (!active[bix]) continue;
+		cube_t const cube(get_xval(bs.bounds[0][0]), get_xval(bs.bounds[0][1]), get_yval(bs.bounds[1][0]), get_yval(bs.bounds[1][1]), get_zval(bs.bounds[2][0]), get_zval(bs.bounds[2][1]));
+		sman.add_smoke(cube, bs.tot_smoke);
+	}
+}
+
+void smoke_volume_t::upload_dirty_bricks(vector<unsigned char> &tex_data) {
+
+	unsigned const ncomp(4);
+
+	for (auto i = dirty_bricks.begin(); i != dirty_bricks.end(); ++i) {
+		int bpos[3];
+		get_brick_pos(*i, bpos);
+		int const x1(bpos[0]*SMOKE_BRICK_SZ), y1(bpos[1]*SMOKE_BRICK_SZ), z1(bpos[2]*SMOKE_BRICK_SZ);
+		int const x2(min(nx, x1+SMOKE_BRICK_SZ)), y2(min(ny, y1+SMOKE_BRICK_SZ)), z2(min(nz, z1+SMOKE_BRICK_SZ));
+
+		for (int y = y1; y < y2; ++y) {
+			for (int x = x1; x < x2; ++x) {
+				unsigned const ix(get_ix(x, y, 0));
+				for (int z = z1; z < z2; ++z) {tex_data[ncomp*(ix + z) + 3] = get_smoke_alpha(data[cur][ix + z]);} // alpha: smoke
+			}
+		}
+		sync_smoke_tex_region(x1, x2, y1, y2, z1, z2);
+	}
+	clear_dirty();
 }
 
 
@@ -186,64 +330,13 @@ void distribute_smoke() { // called at most once per frame
 
 	//RESET_TIME;
 	if (!DYNAMIC_SMOKE || !smoke_exists || !animate2) return;
-	assert(SMOKE_SKIPVAL > 0);
-	static int cur_skip(0);
-	static rand_gen_t rgen;
-	
-	if (cur_skip == 0) {
-		//cout << "tot_smoke: " << smoke_man.tot_smoke << ", enabled: " << smoke_exists << ", visible: " << smoke_visible << endl;
-		smoke_man     = next_smoke_man;
-		smoke_man.adj_bbox();
-		smoke_visible = smoke_man.smoke_vis;
-		smoke_exists  = smoke_man.enabled;
-		next_smoke_man.reset();
-	}
-	/*if ((display_mode & 0x10) && !smoke_bounds.empty()) {
-		cur_smoke_bb = smoke_bounds[0];
-		for (vector<cube_t>::const_iterator i = smoke_bounds.begin()+1; i != smoke_bounds.end(); ++i) {cur_smoke_bb.union_with_cube(*i);}
-	}*/
-	float const xy_rate(SMOKE_DIS_XY*SMOKE_SKIPVAL);
-	int const dx(rgen.rand() & 1), dy(rgen.rand() & 1); // randomize the processing order
-	
-	// openmp doesn't really help here
-	for (int y = cur_skip; y < MESH_Y_SIZE; y += SMOKE_SKIPVAL) { // split the computation across several frames
-		for (int x = 0; x < MESH_X_SIZE; ++x) {
-			lmcell *vldata(lmap_manager.get_column(x, y));
-			if (vldata == NULL) continue;
-			smoke_entry_t &zrange(smoke_grid.get_z_range(x, y));
-			//smoke_entry_t zrange; zrange.zmin = 0; zrange.zmax = MESH_Z_SIZE;
-			if (!zrange.valid()) continue;
-			bool any_z_has_smoke(0);
-			
-			for (int z = zrange.zmin; z < zrange.zmax; ++z) {
-				lmcell &lmc(vldata[z]);
-				if (lmc.smoke < SMOKE_THRESH) {lmc.smoke = 0.0;}
-				if (lmc.smoke == 0.0) continue;
-				//if (get_zval(z) > v_collision_matrix[y][x].zmax) {lmc.smoke = 0.0; continue;} // open space above - smoke goes up
-				next_smoke_man.add_smoke(x, y, z, lmc.smoke);
-
-				if (dx) {
-					diffuse_smoke_xy(x+1, y, z, lmc, xy_rate, 0, 1);
-					diffuse_smoke_xy(x-1, y, z, lmc, xy_rate, 0, 0);
-				} else {
-					diffuse_smoke_xy(x-1, y, z, lmc, xy_rate, 0, 0);
-					diffuse_smoke_xy(x+1, y, z, lmc, xy_rate, 0, 1);
-				}
-				if (dy) {
-					diffuse_smoke_xy(x, y+1, z, lmc, xy_rate, 1, 1);
-					diffuse_smoke_xy(x, y-1, z, lmc, xy_rate, 1, 0);
-				} else {
-					diffuse_smoke_xy(x, y-1, z, lmc, xy_rate, 1, 0);
-					diffuse_smoke_xy(x, y+1, z, lmc, xy_rate, 1, 1);
-				}
-				diffuse_smoke_z(x, y, (z - 1), lmc, vldata, SMOKE_DIS_ZD, SMOKE_DIS_ZU, 2, 0);
-				diffuse_smoke_z(x, y, (z + 1), lmc, vldata, SMOKE_DIS_ZU, SMOKE_DIS_ZD, 2, 1);
-				any_z_has_smoke = 1;
-			} // for z
-			if (!any_z_has_smoke) {zrange.clear();} // mark this xy as not having smoke
-		} // for x
-	} // for y
-	cur_skip = (cur_skip+1) % SMOKE_SKIPVAL;
+	smoke_manager next_smoke_man;
+	smoke_vol.step(SMOKE_DIS_XY, SMOKE_DIS_ZU, SMOKE_DIS_ZD, next_smoke_man);
+	//cout << "tot_smoke: " << next_smoke_man.tot_smoke << ", enabled: " << next_smoke_man.enabled << ", visible: " << next_smoke_man.smoke_vis << endl;
+	smoke_man     = next_smoke_man;
+	smoke_man.adj_bbox();
+	smoke_visible = smoke_man.smoke_vis;
+	smoke_exists  = smoke_man.enabled;
 	//PRINT_TIME("Distribute Smoke");
 }
 
@@ -254,21 +347,16 @@ float get_smoke_at_pos(point const &pos) {
 	if (pos.z <= czmin0 || pos.z >= czmax) return 0.0;
 	int const x(get_xpos(pos.x)), y(get_ypos(pos.y)), z(get_zpos(pos.z));
 	if (point_outside_mesh(x, y) || z < 0 || z >= MESH_SIZE[2]) return 0.0;
-	lmcell const *const vldata(lmap_manager.get_column(x, y));
-	return ((vldata == NULL) ? 0.0 : vldata[z].smoke);
+	return ((lmap_manager.get_column(x, y) == NULL) ? 0.0 : smoke_vol.get(x, y, z));
 }
 
-
 void reset_smoke_tex_data() {smoke_tex_data.clear();}
 
 
-#define CLEAR_Z_RANGE(z1, z2) for (int z = z1; z < (int)z2; ++z) {data[4*(off + z)+3] = 0;}
-
 void update_smoke_row(vector<unsigned char> &data, vector<unsigned> const &llvol_ixs, lmcell const &default_lmc,
 	unsigned x_start, unsigned x_end, unsigned z_start, unsigned z_end, unsigned y, bool update_lighting)
 {
 	unsigned const zsize(MESH_SIZE[2]), ncomp(4);
-	float const smoke_scale(1.0/SMOKE_MAX_CELL);
 	bool const do_lighting(update_lighting || lmap_manager.was_updated);
 	colorRGB default_color;
 	default_lmc.get_final_color(default_color, 1.0);
@@ -286,22 +374,9 @@ void update_smoke_row(vector<unsigned char> &data, vector<unsigned> const &llvol
 				if (local_light_volumes[llvol_ixs[i]]->check_xy_bounds(x, y)) {llv_ix_s = min(i, llv_ix_s); llv_ix_e = max(i+1, llv_ix_e);}
 			}
 		}
-		else { // update smoke only
-			smoke_entry_t const &zrange(smoke_grid.get_z_range(x, y));
-			
-			if (!zrange.valid()) { // no smoke in this row
-				CLEAR_Z_RANGE(z_start, z_end);
-				continue;
-			}
-			CLEAR_Z_RANGE(z_start, zrange.zmin);
-			CLEAR_Z_RANGE(zrange.zmax, z_end);
-			z_start = zrange.zmin;
-			z_end   = zrange.zmax;
-		}
 		for (unsigned z = z_start; z < z_end; ++z) {
 			unsigned const off2(ncomp*(off + z));
-			if (vlm == NULL || vlm[z].smoke == 0.0) {data[off2+3] = 0;}
-			else {data[off2+3] = (unsigned char)(255*CLIP_TO_01(smoke_scale*vlm[z].smoke));} // alpha: smoke
+			data[off2+3] = ((vlm == NULL) ? 0 : get_smoke_alpha(smoke_vol.get(x, y, z))); // alpha: smoke
 			if (!do_lighting) continue; // lighting not needed
 				
 			if (check_z_thresh && get_zval(z+1) < mh) { // adjust by one because GPU will interpolate the texel
@@ -352,15 +427,19 @@ void update_smoke_indir_tex_range(unsigned x_start, unsigned x_end, unsigned y_s
 		was_printed = 1;
 		smoke_tid = create_3d_texture(MESH_SIZE[2], MESH_X_SIZE, MESH_Y_SIZE, ncomp, smoke_tex_data, GL_LINEAR, GL_CLAMP_TO_EDGE);
 	}
-	else { // update region/sync texture
-		unsigned const off(ncomp*(z_start + (x_start + y_start*MESH_X_SIZE)*MESH_SIZE[2]));
-		assert(off < smoke_tex_data.size());
-		glPixelStorei(GL_UNPACK_ROW_LENGTH,   MESH_SIZE[2]);
-		glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, MESH_X_SIZE);
-		update_3d_texture(smoke_tid, z_start, x_start, y_start, (z_end - z_start), (x_end - x_start), (y_end - y_start), ncomp, &smoke_tex_data[off]); // stored as {z, x, y}
-		glPixelStorei(GL_UNPACK_ROW_LENGTH,   0); // reset to 0
-		glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0); // reset to 0
-	}
+	else {sync_smoke_tex_region(x_start, x_end, y_start, y_end, z_start, z_end);}
+}
+
+void sync_smoke_tex_region(unsigned x_start, unsigned x_end, unsigned y_start, unsigned y_end, unsigned z_start, unsigned z_end) {
+
+	assert(smoke_tid != 0);
+	unsigned const ncomp(4), off(ncomp*(z_start + (x_start + y_start*MESH_X_SIZE)*MESH_SIZE[2]));
+	assert(off < smoke_tex_data.size());
+	glPixelStorei(GL_UNPACK_ROW_LENGTH,   MESH_SIZE[2]);
+	glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, MESH_X_SIZE);
+	update_3d_texture(smoke_tid, z_start, x_start, y_start, (z_end - z_start), (x_end - x_start), (y_end - y_start), ncomp, &smoke_tex_data[off]); // stored as {z, x, y}
+	glPixelStorei(GL_UNPACK_ROW_LENGTH,   0); // reset to 0
+	glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0); // reset to 0
 }
 
 
@@ -371,7 +450,6 @@ bool upload_smoke_indir_texture() {
 		have_indir_smoke_tex = 0;
 		return 0;
 	}
-	assert((MESH_Y_SIZE%SMOKE_SEND_SKIP) == 0);
 	// ok when texture z size is not a power of 2
 	unsigned const sz(MESH_X_SIZE*MESH_Y_SIZE*MESH_SIZE[2]), ncomp(4);
 
@@ -394,12 +472,18 @@ bool upload_smoke_indir_texture() {
 		if ((*i)->needs_update()) {(*i)->mark_updated(); lighting_changed = 1;}
 	}
 	bool const full_update(smoke_tid == 0 || (!no_sun_lpos_update && lighting_changed));
-	bool const could_have_smoke(smoke_exists || last_smoke_update > 0);
-	if (!full_update && !could_have_smoke && !lmap_manager.was_updated && !lighting_changed) return 0; // return 1?
-	if (full_update ) {last_cur_ambient  = cur_ambient; last_cur_diffuse = cur_diffuse;}
-	if (smoke_exists) {last_smoke_update = SMOKE_SEND_SKIP;} else if (last_smoke_update > 0) {--last_smoke_update;}
+
+	if (full_update) { // smoke is sent along with lighting below
+		last_cur_ambient = cur_ambient; last_cur_diffuse = cur_diffuse;
+		smoke_vol.clear_dirty();
+	}
+	else {
+		if (!smoke_vol.has_dirty_bricks() && !lmap_manager.was_updated) return 0; // return 1?
+		smoke_vol.upload_dirty_bricks(smoke_tex_data); // only the smoke bricks that changed
+		if (!lmap_manager.was_updated) {have_indir_smoke_tex = 1; return 1;} // lighting is unchanged
+	}
 	static int cur_block(0);
-	unsigned const skipval(could_have_smoke ? SMOKE_SEND_SKIP : INDIR_LT_SEND_SKIP);
+	unsigned const skipval(INDIR_LT_SEND_SKIP);
 	unsigned const block_size(MESH_Y_SIZE/skipval);
 	unsigned const y_start(full_update ? 0           :  cur_block*block_size);
 	unsigned const y_end  (full_update ? MESH_Y_SIZE : (y_start + block_size));
@@ -6,6 +6,8 @@
 #include "gl_ext_arb.h"
 #include "shaders.h"
 #include "model3d.h"
+#include "file_utils.h"
+#include <unordered_map>
 
 
 unsigned const VOXELS_PER_DIV = 8; // 1024 for 128 vertex mesh
@@ -45,6 +47,12 @@ struct zval_avg {
 	//       so we can have at max 64M snowflakes.
 	//       However, we can get snow to stack up at a vertical edge so we need to clamp the count
 	void update(float zval) {if (c < MAX_COUNT) {++c; z += zval;}}
+	void merge(zval_avg const &v) { // add the counts from another accumulator, with the same clamping as update()
+		if (!v.valid() || c >= MAX_COUNT) return;
+		unsigned const num_add(min((unsigned)v.c, (MAX_COUNT - c)));
+		z += ((num_add == v.c) ? v.z : v.z*float(num_add)/v.c); // approximate for partial adds
+		c += num_add;
+	}
 	bool valid() const {return (c > 0);}
 	float getz() const {return z/c;}
 };
@@ -75,6 +83,9 @@ struct voxel_t {
 };
 
 
+typedef std::unordered_map<voxel_t, zval_avg, hash_by_bytes<voxel_t>> voxel_hash_map; // unsorted, for accumulation
+
+
 struct voxel_z_pair {
 	voxel_t v;
 	zval_avg z;
@@ -494,54 +505,58 @@ void create_snow_map(voxel_map &vmap) {
 	float const xscale(2.0*X_SCENE_SIZE/num_per_dim), yscale(2.0*Y_SCENE_SIZE/num_per_dim);
 	all_models.build_cobj_trees(1);
 	cout << "Snow accumulation progress (out of " << num_per_dim << "):     0";
-
-#pragma omp parallel for schedule(dynamic,1)
-	for (int y = 0; y < num_per_dim; ++y) {
-		if (omp_get_thread_num_3dw() == 0) {increment_printed_number(y);} // progress for thread 0
-		rand_gen_t rgen;
-		rgen.set_state(123, y);
-
-		for (int x = 0; x < num_per_dim; ++x) {
-			point pos1(-X_SCENE_SIZE + x*xscale, -Y_SCENE_SIZE + y*yscale, zval);
-			// add slightly more randomness for numerical precision reasons
-			for (unsigned d = 0; d < 2; ++d) {pos1[d] += SMALL_NUMBER*rgen.signed_rand_float();}
-			point pos2;
-			if (!get_mesh_ice_pt(pos1, pos2)) continue; // invalid point
-			assert(pos2.z < pos1.z);
-			pos1 += get_rand_snow_vect(rgen, 1.0); // add some gaussian randomness for better distribution
-			point cpos;
-			vector3d cnorm;
-			bool invalid(0);
-			unsigned iter(0);
+	// each thread accumulates hits into its own hash map rather than using a critical section per snowflake; these are merged at the end
+#pragma omp parallel
+	{
+		voxel_hash_map tmap;
+
+#pragma omp for schedule(dynamic,1)
+		for (int y = 0; y < num_per_dim; ++y) {
+			if (omp_get_thread_num_3dw() == 0) {increment_printed_number(y);} // progress for thread 0
+			rand_gen_t rgen;
+			rgen.set_state(123, y);
+
+			for (int x = 0; x < num_per_dim; ++x) {
+				point pos1(-X_SCENE_SIZE + x*xscale, -Y_SCENE_SIZE + y*yscale, zval);
+				// add slightly more randomness for numerical precision reasons
+				for (unsigned d = 0; d < 2; ++d) {pos1[d] += SMALL_NUMBER*rgen.signed_rand_float();}
+				point pos2;
+				if (!get_mesh_ice_pt(pos1, pos2)) continue; // invalid point
+				assert(pos2.z < pos1.z);
+				pos1 += get_rand_snow_vect(rgen, 1.0); // add some gaussian randomness for better distribution
+				point cpos;
+				vector3d cnorm;
+				bool invalid(0);
+				unsigned iter(0);
 			
-			while (check_snow_line_coll(pos1, pos2, cpos, cnorm)) {
-				if (cnorm.z > 0.0) { // collision with a surface that points up - we're done
-					pos2 = cpos;
-					break;
-				}
-				if (snow_random == 0.0 || iter > 100) { // something odd happened
-					invalid = 1;
-					break;
-				}
-				// collision with vertical or bottom surface
-				float const val(CLIP_TO_01((pos1.z - zbottom)*zv_scale));
-				vector3d const delta(get_rand_snow_vect(rgen, 0.1*val));
-				pos1 = cpos - (pos2 - pos1).get_norm()*SMALL_NUMBER; // push a small amount back from the object
-				pos2 = pos1 + ((dot_product(delta, cnorm) < 0.0) ? -delta : delta);
+				while (check_snow_line_coll(pos1, pos2, cpos, cnorm)) {
+					if (cnorm.z > 0.0) { // collision with a surface that points up - we're done
+						pos2 = cpos;
+						break;
+					}
+					if (snow_random == 0.0 || iter > 100) { // something odd happened
+						invalid = 1;
+						break;
+					}
+					// collision with vertical or bottom surface
+					float const val(CLIP_TO_01((pos1.z - zbottom)*zv_scale));
+					vector3d const delta(get_rand_snow_vect(rgen, 0.1*val));
+					pos1 = cpos - (pos2 - pos1).get_norm()*SMALL_NUMBER; // push a small amount back from the object
+					pos2 = pos1 + ((dot_product(delta, cnorm) < 0.0) ? -delta : delta);
 				
-				if (!get_mesh_ice_pt(pos2, pos2)) { // invalid point
-					invalid = 1;
-					break;
-				}
-				++iter;
-			} // end while
-			if (!invalid) {
-				voxel_t const voxel(pos2);
+					if (!get_mesh_ice_pt(pos2, pos2)) { // invalid point
+						invalid = 1;
+						break;
+					}
+					++iter;
+				} // end while
+				if (!invalid) {tmap[voxel_t(pos2)].update(pos2.z);}
+			} // for x
+		} // for y
+
 #pragma omp critical(snow_map_update)
-				vmap[voxel].update(pos2.z);
-			}
-		} // for x
-	} // for y
+		for (auto i = tmap.begin(); i != tmap.end(); ++i) {vmap[i->first].merge(i->second);}
+	} // end omp parallel
 	cout << endl;
 }
 
@@ -670,18 +685,31 @@ void gen_snow_coverage() {
 
 	// setup voxel scales
 	vox_delta.assign(VOXELS_PER_DIV/DX_VAL, VOXELS_PER_DIV/DY_VAL, 1.0/(max(DZ_VAL/VOXELS_PER_DIV, snow_depth)));
-	
-	if (read_snow_file) {
+	// cache mode (read_snow_file == 2): read the file if it exists and matches the current voxel scale, otherwise create it and write it
+	bool const cache_mode(read_snow_file == 2);
+	bool was_read(0);
+
+	if (read_snow_file && (!cache_mode || check_file_exists(snow_file))) {
 		RESET_TIME;
-		if (!vmap.read(snow_file)) {has_snow = 0; return;}
+		point const calc_vox_delta(vox_delta);
+		
+		if (!vmap.read(snow_file)) {
+			if (!cache_mode) {has_snow = 0; return;}
+		}
+		else if (cache_mode && vox_delta != calc_vox_delta) { // stale cache file
+			cout << "Snow file " << snow_file << " was created with different scene parameters and will be regenerated" << endl;
+			vmap.clear();
+			vox_delta = calc_vox_delta;
+		}
+		else {was_read = 1;}
 		PRINT_TIME("Read Snow Voxel Map");
 	}
-	else {
+	if (!was_read) {
 		RESET_TIME;
 		create_snow_map(vmap);
 		PRINT_TIME("Build Snow Voxel Map");
 	}
-	if (write_snow_file) {
+	if (write_snow_file && !(cache_mode && was_read)) {
 		RESET_TIME;
 		vmap.write(snow_file);
 		PRINT_TIME("Write Snow Voxel Map");
@@ -227,6 +227,12 @@ public:
 	void create_rocky_texture(unsigned size);
 	void create_gas_giant_texture();
 	void gen_texture_data_and_heightmap(unsigned char *data, unsigned size);
+	void build_sine_tables(float *xtable, float *ytable, unsigned num_sines) const;
+	void gen_texture_rows(unsigned char *data, float *heightmap, float const *xtable, float const *ytable,
+		unsigned size, unsigned num_sines, unsigned row_start, unsigned row_end);
+	bool gen_texture_data_progressive(unsigned size, vector<unsigned char> &data);
+	void upload_rocky_texture(unsigned size, vector<unsigned char> const &data);
+	bool has_cached_surface(unsigned size) const;
 	bool has_heightmap() const {return (surface != nullptr && surface->has_heightmap() && !use_procedural_shader());}
 	bool surface_test(float rad, point const &p, float &coll_r, bool simple) const;
 	float get_radius_at(point const &p, bool exact=0) const;
@@ -467,7 +473,7 @@ public:
 	std::shared_ptr<vector<ugalaxy> > galaxies; // must be a pointer to a vector to avoid deep copies
 
 	ucell() : last_bkg_color(BLACK), last_player_pos(all_zeros), last_star_cache_ix(0), cached_stars_valid(0) {}
-	void gen_cell(int const ii[3]);
+	void gen_cell(int const ii[3], point const &scaled_upt);
 	void draw_nebulas(ushader_group &usg) const;
 	void draw_systems(ushader_group &usg, s_object const &clobj, unsigned pass, bool no_move, bool skip_closest, bool sel_cell, bool gen_only, bool no_asteroid_dust);
 	void free_uobj();
@@ -540,8 +546,19 @@ public:
 };
 
 
-struct cell_block {
-	ucell cells[U_BLOCKS][U_BLOCKS][U_BLOCKS];
+struct cell_block { // cells are accessed through pointers so that shifting the universe moves pointers rather than copying cells
+	ucell cell_data[U_BLOCKS_CU + U_BLOCKS_SQ]; // includes one extra slab of spare cells used for prefetching
+	ucell *cells[U_BLOCKS][U_BLOCKS][U_BLOCKS];
+	ucell *spare_cells[U_BLOCKS_SQ];
+
+	cell_block() {
+		for (unsigned i = 0; i < U_BLOCKS; ++i) {
+			for (unsigned j = 0; j < U_BLOCKS; ++j) {
+				for (unsigned k = 0; k < U_BLOCKS; ++k) {cells[i][j][k] = cell_data + (i*U_BLOCKS + j)*U_BLOCKS + k;}
+			}
+		}
+		for (unsigned i = 0; i < U_BLOCKS_SQ; ++i) {spare_cells[i] = cell_data + U_BLOCKS_CU + i;}
+	}
 };
 
 struct coll_test { // size = 16
@@ -560,11 +577,17 @@ struct line_query_state {
 class universe_t : protected cell_block {
 
 	icosphere_manager_t planet_manager;
-	cell_block temp; // used for shift_cells
+	int prefetch_dir[3], prefetch_uxyz[3]; // shift direction and post-shift uxyz that the spare cells are being generated for
+	unsigned num_prefetched; // spare_cells[0..num_prefetched) are generated, in get_new_slab_ixs() order
+
+	void get_new_slab_ixs(int dx, int dy, int dz, cell_ixs_t ixs[U_BLOCKS_SQ]) const;
+	void reset_prefetch();
 
 public:
+	universe_t() : num_prefetched(0) {UNROLL_3X(prefetch_dir[i_] = prefetch_uxyz[i_] = 0;)}
 	void init();
 	void shift_cells(int dx, int dy, int dz);
+	void prefetch_cells(point const &camera, vector3d const &velocity);
 	void free_context();
 	void draw_all_cells(s_object const &clobj, bool skip_closest, bool no_move, int no_distant, bool gen_only, bool no_asteroid_dust);
 	int get_closest_object(s_object &result, point pos, int max_level, bool include_asteroids, bool offset, float expand,
@@ -586,11 +609,11 @@ public:
 	}
 	ucell const &get_cell(int const cxyz[3]) const {
 		assert(!bad_cell_xyz(cxyz));
-		return cells[cxyz[2]][cxyz[1]][cxyz[0]];
+		return *cells[cxyz[2]][cxyz[1]][cxyz[0]];
 	}
 	ucell &get_cell(int const cxyz[3]) {
 		assert(!bad_cell_xyz(cxyz));
-		return cells[cxyz[2]][cxyz[1]][cxyz[0]];
+		return *cells[cxyz[2]][cxyz[1]][cxyz[0]];
 	}
 	ucell const &get_cell(s_object const &so) const {return get_cell(so.cellxyz);}
 	ucell       &get_cell(s_object const &so)       {return get_cell(so.cellxyz);}
@@ -6,10 +6,15 @@
 #include "universe.h"
 #include "sinf.h"
 #include "textures.h"
+#include <list>
 
 
 float const M_ATTEN_FACTOR = 0.5;
 float const F_ATTEN_FACTOR = 0.4;
+size_t const MAX_SURFACE_CACHE_MEM = (64 << 20); // 64MB
+unsigned const PROGRESSIVE_GEN_PIXELS = (1 << 12); // texels generated per call to gen_texture_data_progressive()
+unsigned const SINE_TABLE_SIZE = (MAX_TEXTURE_SIZE << 1); // larger is more accurate
+static_assert(PROGRESSIVE_GEN_PIXELS < (MAX_TEXTURE_SIZE*MAX_TEXTURE_SIZE)/4, "progressive planet texture generation must take multiple calls");
 
 extern int display_mode;
 
@@ -123,19 +128,25 @@ void upsurface::gen(float mag, float freq, unsigned ntests, float mm_scale) {
 }
 
 
-void upsurface::setup(unsigned size, float mcut, bool alloc_hmap) {
+unsigned upsurface::calc_num_sines(unsigned size) {
 
-	ssize      = size;
-	min_cutoff = mcut;
-	if (alloc_hmap) heightmap.resize(ssize*ssize);
 	unsigned max_freq(MAX_FREQ_BINS - 4);
 
 	for (unsigned i = 8; i <= MAX_TEXTURE_SIZE; i <<= 1) {
-		if (ssize <= i) break;
+		if (size <= i) break;
 		++max_freq;
 	}
-	max_freq  = max(1u, min(MAX_FREQ_BINS, max_freq));
-	num_sines = max_freq*SINES_PER_FREQ;
+	max_freq = max(1u, min(MAX_FREQ_BINS, max_freq));
+	return max_freq*SINES_PER_FREQ;
+}
+
+
+void upsurface::setup(unsigned size, float mcut, bool alloc_hmap) {
+
+	ssize      = size;
+	min_cutoff = mcut;
+	if (alloc_hmap) heightmap.resize(ssize*ssize);
+	num_sines  = calc_num_sines(ssize);
 }
 
 
@@ -186,6 +197,93 @@ void urev_body::gen_surface() {
 }
 
 
+struct surface_cache_key_t { // everything that affects the generated texture and heightmap of a planet or moon
+	int rseed1, rseed2, type;
+	unsigned size, colorA, colorB; // colors are packed 8-bit RGB, as used for texture generation
+	float water, lava, snow_thresh, temp, atmos;
+
+	bool operator<(surface_cache_key_t const &k) const {
+		if (rseed1 != k.rseed1) return (rseed1 < k.rseed1);
+		if (rseed2 != k.rseed2) return (rseed2 < k.rseed2);
+		if (type   != k.type  ) return (type   < k.type  );
+		if (size   != k.size  ) return (size   < k.size  );
+		if (colorA != k.colorA) return (colorA < k.colorA);
+		if (colorB != k.colorB) return (colorB < k.colorB);
+		if (water  != k.water ) return (water  < k.water );
+		if (lava   != k.lava  ) return (lava   < k.lava  );
+		if (temp   != k.temp  ) return (temp   < k.temp  );
+		if (atmos  != k.atmos ) return (atmos  < k.atmos );
+		return (snow_thresh < k.snow_thresh);
+	}
+};
+
+class surface_cache_t { // LRU cache of generated surfaces so that revisiting a planet doesn't regenerate them; bounded by memory usage
+	struct entry_t {
+		vector<unsigned char> tex_data;
+		vector<float> heightmap;
+		size_t get_mem() const {return (tex_data.size() + heightmap.size()*sizeof(float));}
+	};
+	typedef std::list<pair<surface_cache_key_t, entry_t> > lru_list_t;
+	lru_list_t lru; // most recently used first
+	map<surface_cache_key_t, lru_list_t::iterator> entries;
+	size_t mem_used;
+
+public:
+	surface_cache_t() : mem_used(0) {}
+	bool contains(surface_cache_key_t const &key) const {return (entries.find(key) != entries.end());}
+
+	bool lookup(surface_cache_key_t const &key, unsigned char *data, vector<float> &heightmap) {
+		auto it(entries.find(key));
+		if (it == entries.end()) return 0;
+		lru.splice(lru.begin(), lru, it->second); // move to front
+		entry_t const &e(it->second->second);
+		assert(heightmap.size() == e.heightmap.size());
+		memcpy(data, &e.tex_data.front(), e.tex_data.size());
+		heightmap = e.heightmap;
+		return 1;
+	}
+	void add(surface_cache_key_t const &key, unsigned char const *data, vector<float> const &heightmap) {
+		if (contains(key)) return; // shouldn't get here
+		lru.emplace_front(key, entry_t());
+		entry_t &e(lru.front().second);
+		e.tex_data.assign(data, data + 3*key.size*key.size);
+		e.heightmap = heightmap;
+		mem_used   += e.get_mem();
+		entries[key] = lru.begin();
+
+		while (mem_used > MAX_SURFACE_CACHE_MEM && lru.size() > 1) { // evict least recently used, but keep the one we just added
+			mem_used -= lru.back().second.get_mem();
+			entries.erase(lru.back().first);
+			lru.pop_back();
+		}
+	}
+};
+
+surface_cache_t surface_cache;
+
+unsigned pack_rgb(unsigned char const c[3]) {return ((unsigned(c[0]) << 16) | (unsigned(c[1]) << 8) | unsigned(c[2]));}
+
+surface_cache_key_t get_surface_cache_key(urev_body const &body, unsigned size) {
+	unsigned char ca[3], cb[3];
+	body.get_colors(ca, cb);
+	surface_cache_key_t key;
+	key.rseed1 = body.rgen.rseed1;
+	key.rseed2 = body.rgen.rseed2;
+	key.type   = body.type;
+	key.size   = size;
+	key.colorA = pack_rgb(ca);
+	key.colorB = pack_rgb(cb);
+	key.water  = body.water;
+	key.lava   = body.lava;
+	key.temp   = body.temp;
+	key.atmos  = body.atmos;
+	key.snow_thresh = body.snow_thresh;
+	return key;
+}
+
+bool urev_body::has_cached_surface(unsigned size) const {return surface_cache.contains(get_surface_cache_key(*this, size));}
+
+
 // Note: many planet/sphere renderers use a texture with width = 2*height, which yields square regions at the equator
 // here we use a square texture for simplicity, so that this code can be shared with (and be similar to)
 // the rest of the 3DWorld sphere generation and drawing code; it also produces more uniform regions near the poles
@@ -197,17 +295,26 @@ void urev_body::gen_texture_data_and_heightmap(unsigned char *data, unsigned siz
 	for (unsigned sz = size; sz > 1; sz >>= 1, ++size_p2);
 	assert((1U<<size_p2) == size); // size must be a power of 2
 	assert(surface != nullptr);
-	unsigned const table_size(MAX_TEXTURE_SIZE << 1); // larger is more accurate
-	static float xtable[TOT_NUM_SINES*table_size], ytable[TOT_NUM_SINES*table_size];
 	surface->setup(size, max(water, lava), 1); // use_heightmap=1
-	unsigned const num_sines(surface->num_sines);
-	float const *const rdata(surface->rdata);
-	float const mt2(0.5*(table_size-1)), scale(1.5/surface->max_mag);
-	float const delta(TWO_PI/size), sin_ds(sin(delta)), cos_ds(cos(delta));
-	unsigned const pole_thresh(size>>3);
 	wr_scale = 1.0/max(0.01, (1.0 - water));
+	surface_cache_key_t const cache_key(get_surface_cache_key(*this, size));
+	if (surface_cache.lookup(cache_key, data, surface->heightmap)) return; // previously generated
+	static float xtable[TOT_NUM_SINES*SINE_TABLE_SIZE], ytable[TOT_NUM_SINES*SINE_TABLE_SIZE];
+	build_sine_tables(xtable, ytable, surface->num_sines);
+	gen_texture_rows(data, &surface->heightmap.front(), xtable, ytable, size, surface->num_sines, 0, size);
+	surface_cache.add(cache_key, data, surface->heightmap);
+	//if (size >= MAX_TEXTURE_SIZE) PRINT_TIME("Gen");
+}
+
+
+// fills xtable and ytable, each with SINE_TABLE_SIZE*num_sines values
+void urev_body::build_sine_tables(float *xtable, float *ytable, unsigned num_sines) const {
+
+	assert(surface != nullptr);
+	float const *const rdata(surface->rdata);
+	float const mt2(0.5*(SINE_TABLE_SIZE-1));
 
-	for (unsigned i = 0; i < table_size; ++i) { // build sin table
+	for (unsigned i = 0; i < SINE_TABLE_SIZE; ++i) { // build sin table
 		unsigned const offset(i*num_sines);
 		float const sarg(i/mt2 - 1.0);
 
@@ -217,9 +324,22 @@ void urev_body::gen_texture_data_and_heightmap(unsigned char *data, unsigned siz
 			ytable[offset+k] = SINF(rdata[index2+3]*sarg + rdata[index2+4]);
 		}
 	}
+}
+
+
+// generates texture data and heightmap values for phi rows [row_start, row_end) using tables from build_sine_tables(); requires a, b, and wr_scale to be set
+void urev_body::gen_texture_rows(unsigned char *data, float *heightmap, float const *xtable, float const *ytable,
+	unsigned size, unsigned num_sines, unsigned row_start, unsigned row_end)
+{
+	assert(surface != nullptr);
+	assert(row_start < row_end && row_end <= size);
+	float const *const rdata(surface->rdata);
+	float const mt2(0.5*(SINE_TABLE_SIZE-1)), scale(1.5/surface->max_mag);
+	float const delta(TWO_PI/size), sin_ds(sin(delta)), cos_ds(cos(delta));
+	unsigned const pole_thresh(size>>3);
 
 	#pragma omp parallel for schedule(dynamic,1)
-	for (int i = 0; i < (int)size; ++i) { // phi values
+	for (int i = (int)row_start; i < (int)row_end; ++i) { // phi values
 		unsigned const hmoff(i*size), ti(size-i-1), texoff(ti*size);
 		float const phi((float(i)/(size-1))*PI);
 		float const sin_phi((i == int(size-1)) ? 0.0 : sinf(phi)), zval((i == int(size-1)) ? -1.0 : cosf(phi));
@@ -248,13 +368,45 @@ void urev_body::gen_texture_data_and_heightmap(unsigned char *data, unsigned siz
 				for (unsigned k = 0; k < num_sines; ++k) {val += ztable[k]*xtable[ox1+k]*ytable[oy1+k];}
 			}
 			val = 0.5*(max(-1.0f, min(1.0f, scale*val)) + 1.0);
-			surface->heightmap[hmoff + j] = val;
+			heightmap[hmoff + j] = val;
 			get_surface_color((data + index), val, phi);
 			sin_s = s*cos_ds + c*sin_ds;
 			cos_s = c*cos_ds - s*sin_ds;
 		} // for j
 	} // for i
-	//if (size >= MAX_TEXTURE_SIZE) PRINT_TIME("Gen");
+}
+
+
+// generates the texture data and heightmap for a new size over multiple calls, leaving the current surface in use until done;
+// returns 1 when complete, in which case the new heightmap has been swapped into the surface and data holds the texture data
+bool urev_body::gen_texture_data_progressive(unsigned size, vector<unsigned char> &data) {
+
+	assert(surface != nullptr);
+	upsurface::pending_gen_t &pg(surface->pending_gen);
+
+	unsigned const num_sines(upsurface::calc_num_sines(size));
+
+	if (pg.size != size) { // start a new generation, discarding any previous one
+		pg.clear();
+		pg.size = size;
+		pg.tex_data.resize(3*size*size);
+		pg.heightmap.resize(size*size);
+		pg.xtable.resize(SINE_TABLE_SIZE*num_sines);
+		pg.ytable.resize(SINE_TABLE_SIZE*num_sines);
+		build_sine_tables(&pg.xtable.front(), &pg.ytable.front(), num_sines); // reused for all calls
+	}
+	get_colors(a, b);
+	wr_scale = 1.0/max(0.01, (1.0 - water));
+	unsigned const row_end(min(size, (pg.next_row + max(1U, PROGRESSIVE_GEN_PIXELS/size))));
+	gen_texture_rows(&pg.tex_data.front(), &pg.heightmap.front(), &pg.xtable.front(), &pg.ytable.front(), size, num_sines, pg.next_row, row_end);
+	pg.next_row = row_end;
+	if (pg.next_row < size) return 0; // more rows to generate
+	surface->setup(size, max(water, lava), 0); // use_heightmap=0, since we swap in our own
+	surface->heightmap.swap(pg.heightmap);
+	data.swap(pg.tex_data);
+	pg.clear();
+	surface_cache.add(get_surface_cache_key(*this, size), &data.front(), surface->heightmap);
+	return 1;
 }
 
 
@@ -73,9 +73,24 @@ public:
 	sphere_point_norm spn;
 	sd_sphere_vbo_d sd;
 
+	struct pending_gen_t { // texture data and heightmap for a new size, generated across multiple frames while the current ones are still in use
+		unsigned size, next_row;
+		vector<unsigned char> tex_data;
+		vector<float> heightmap, xtable, ytable; // sine tables are built once for all rows
+
+		pending_gen_t() : size(0), next_row(0) {}
+		void clear() {
+			size = next_row = 0;
+			vector<unsigned char>().swap(tex_data);
+			vector<float>().swap(heightmap); vector<float>().swap(xtable); vector<float>().swap(ytable);
+		}
+	};
+	pending_gen_t pending_gen;
+
 	upsurface(int type_=0) : type(type_), ssize(0), max_mag(0.0), rmax(0.0), min_cutoff(0.0) {}
 	~upsurface();
 	void gen(float mag, float freq, unsigned ntests=N_RAND_MAG_TESTS, float mm_scale=1.0);
+	static unsigned calc_num_sines(unsigned size);
 	void setup(unsigned size, float mcut, bool alloc_hmap);
 	float get_one_minus_cutoff() const {return 1.0/max(0.01, (1.0 - min_cutoff));} // avoid div-by-zero
 	float get_height_at(point const &pt, bool use_cache=0) const;